@@ -8,24 +8,75 @@
 // 	Round information - Match ID, cycles elapsed, etc.
 // All of this is wrapped in the required border frames.
 
-// We do this by making a bunch of Display classes. Then we update each and blit
-// them all into the main display. This is very slow and should be replaced, but
-// it's delaying release. Hopefully, abstracting this in an OOP manner should
-// make it easier to replace when it does need to be.
-
-// In an utopia, this would be in another thread.
+// Each component is drawn into a view of its part of the real display (see
+// display.cc), so everything goes straight into the one framebuffer and
+// nothing has to be blitted. The borders are only drawn when the layout
+// changes (at the start or after a resize), and only what has changed since
+// the last frame is redrawn and shown:
+//	- a statlet, when any value it shows has changed,
+//	- the round information, when any of it has changed,
+//	- the arena, around each thing that's moved, appeared or disappeared
+//	  (robots, their scans and sonar, missiles, mines and blasts).
+// For the arena, we clear the box around each such thing and draw whatever
+// is in the box again, clipped to it.
 
 #include "display.cc"
 #include "widgets.cc"
 #include "missile.cc"
 #include "random.cc"
 #include "tools.cc"
+#include <algorithm>
+#include <string>
 #include <vector>
 
 using namespace std;
 
 typedef enum { ST_LARGE, ST_SMALL } statlet_type;
 
+// Something that's drawn in the arena, and where. Two items that are equal
+// look the same on screen. They sort in the order they're drawn: the walls,
+// then each robot with its sonar and scan, then missiles, mines and blasts.
+typedef enum { AI_WALLS, AI_ROBOT, AI_SONAR, AI_SCAN, AI_MISSILE, AI_MINE,
+	AI_BLAST } arena_item_kind;
+
+typedef struct arena_item {
+	arena_item_kind kind;
+	int index;		// Of the robot, for robots, sonar and scans.
+	SDL_Rect box;		// In pixels of the arena.
+	coordinate pos;		// Normalized.
+	double radius, angle, breadth, turret, opacity;
+	bool shielded;
+	const missile * shell;	// For missiles. Not compared.
+
+	int layer() const;
+	bool operator<(const arena_item & other) const;
+	bool operator==(const arena_item & other) const {
+		return(!(*this < other) && !(other < *this)); }
+};
+
+int arena_item::layer() const {
+	if (kind == AI_SONAR || kind == AI_SCAN) return(AI_ROBOT);
+	return(kind);
+}
+
+bool arena_item::operator<(const arena_item & other) const {
+	if (layer() != other.layer()) return(layer() < other.layer());
+	if (index != other.index) return(index < other.index);
+	if (kind != other.kind) return(kind < other.kind);
+	if (box.x != other.box.x) return(box.x < other.box.x);
+	if (box.y != other.box.y) return(box.y < other.box.y);
+	if (box.w != other.box.w) return(box.w < other.box.w);
+	if (box.h != other.box.h) return(box.h < other.box.h);
+	if (pos.x != other.pos.x) return(pos.x < other.pos.x);
+	if (pos.y != other.pos.y) return(pos.y < other.pos.y);
+	if (radius != other.radius) return(radius < other.radius);
+	if (angle != other.angle) return(angle < other.angle);
+	if (breadth != other.breadth) return(breadth < other.breadth);
+	if (turret != other.turret) return(turret < other.turret);
+	if (opacity != other.opacity) return(opacity < other.opacity);
+	return(shielded < other.shielded);
+}
+
 class arena_disp {
 
 	private:
@@ -33,52 +84,91 @@ class arena_disp {
 		int max_large_onscreen;
 
 		Display * display_out;		// Screen output.
+		statlet_type cur_statlet_type;
+		Color inactive_background;
+
+		// Sizes of the components, in pixels, and how many statlets
+		// there are room for.
+		coordinate arena_px, round_info_px, statlet_px;
+		int num_statlets;
+
+		// Views of display_out for each component, and where they
+		// are on it. They're set up by lay_out on the first frame
+		// after the sizes change. Statlets that don't fit on screen
+		// get no view.
+		bool laid_out;
 		Display arena_field, round_info;
 		vector<Display> statlets;
-		statlet_type cur_statlet_type;
+		SDL_Rect arena_area, round_info_area;
+		vector<SDL_Rect> statlet_areas;
+
+		// What's on screen now.
+		vector<string> statlets_shown;
+		string round_info_shown;
+		vector<arena_item> arena_shown;	// Sorted
+
+		// The parts of display_out to show on the next display(), or
+		// all of it if full_update is true.
+		vector<SDL_Rect> updated;
+		bool full_update;
 
 		Font typeface;
 
 		Widgets widget;
 
-		vector<Display> construct_statlets(const Display & real_display,
-				const Color & inactive_background, statlet_type
-				kind);
+		void lay_out(double x_separation, double y_separation,
+				const Color & border_color);
+
+		string statlet_contents(const robot & source, int index,
+				int meter_width) const;
 		void refresh_statlets(const vector<robot> & robots,
-				const Color & active_background, 
-				const Color & dark_meter, 
+				const Color & active_background,
+				const Color & dark_meter,
 				const Color & no_error, int offset);
 
-		Display construct_round_info(const Display & real_display,
-				const Color & background_black);
 		void refresh_round_info(const Color & background, const Color &
-				text, matchid_t match_id, int cur_cycle, 
+				text, matchid_t match_id, int cur_cycle,
 				int max_cycle, int cur_match, int max_match);
 
-		Display construct_arena(const Display & real_display,
-				const coordinate arena_size);
-
 		double get_normalized_opacity(double latency, double
 				current_time, double time_at_effect,
 				double maxval);
 
+		SDL_Rect arena_box(double xmin, double ymin, double xmax,
+				double ymax, double margin) const;
+		bool overlaps(const SDL_Rect & a, const SDL_Rect & b) const;
+		void merge_boxes(vector<SDL_Rect> & boxes) const;
+
+		vector<arena_item> find_arena_items(const vector<robot> &
+				robots, const list<missile> & missiles,
+				const list<mine> & mines,
+				const blasts & explosions,
+				int robot_display_radius, coordinate arena_size,
+				int buffer_thickness, double cycles_per_sec,
+				double scan_lag, double sonar_lag,
+				double radar_lag, bool show_scanarcs);
+		void draw_arena_item(const arena_item & item,
+				const Color & turret,
+				const Color & missile_col,
+				const Color & overburn_missile_col,
+				const Color & mine_col,
+				const vector<robot> & robots,
+				const blasts & explosions,
+				coordinate arena_size, int buffer_thickness);
+
 		void refresh_arena(const Color & turret,
-				const Color & missile_col, 
+				const Color & missile_col,
 				const Color & overburn_missile_col,
 				const Color & mine_col,
-				const vector<robot> & robots, 
+				const vector<robot> & robots,
 				const list<missile> & missiles,
 				const list<mine> & mines,
-				const blasts & explosions, 
+				const blasts & explosions,
 				int robot_display_radius, coordinate arena_size,
 				int buffer_thickness, double cycles_per_sec,
 				double scan_lag, double sonar_lag,
 				double radar_lag, bool show_scanarcs);
 
-		bool blit_refresh(const Display & from, Display & to,
-				double xmin, double ymin, double xmax, 
-				double ymax, int num_robots);
-
 	public:
 		arena_disp(Display & real_display, const coordinate arena_size,
 				Font & typeface_in, int num_robots);
@@ -93,21 +183,21 @@ class arena_disp {
 				mine_col,
 				matchid_t match_id, int cur_cycle,
 				int max_cycle, int cur_match, int max_match,
-				const vector<robot> & robots, 
+				const vector<robot> & robots,
 				const list<missile> & missiles,
-				const list<mine> & mines, 
+				const list<mine> & mines,
 				const blasts & explosions,
 				int robot_display_radius, coordinate arena_size,
 				int buffer_thickness, double cycles_per_sec,
 				double scan_lag, double sonar_lag,
-				double radar_lag, bool show_scanarcs, 
+				double radar_lag, bool show_scanarcs,
 				int offset);
-		
-		// Create the virtual displays anew; used when the window is
-		// resized.
-		void derive_displays(const coordinate arena_size, 
+
+		// Work out the sizes of the components anew; used when the
+		// window is resized.
+		void derive_displays(const coordinate arena_size,
 				int num_robots);
-		void resize_displays(int new_xsize, const coordinate 
+		void resize_displays(int new_xsize, const coordinate
 				arena_size);
 		void resize_displays(int new_xsize, const coordinate arena_size,
 				int num_robots);
@@ -118,7 +208,8 @@ class arena_disp {
 		// the functionality obscure.
 		void reset_num_statlets(int num_robots);
 
-		void display() { display_out->render(); }
+		// Shows what render_all drew.
+		void display();
 
 		statlet_type get_cur_statlet_type() { return(cur_statlet_type);}
 
@@ -126,131 +217,203 @@ class arena_disp {
 		bool can_scroll_statlets(int scroll_number, int num_robots);
 };
 
-// DONE: Mini-statlets for > 4 contestants.
-vector<Display> arena_disp::construct_statlets(const Display & real_display,
-		const Color & inactive_background, statlet_type kind) {
-	// First get the x and y size of where we're going to dump this display,
-	// then use ATR2 measures to find out how large the statlet window is
-	// going to be (so that we retain nominal resolution independence).
-	
-	coordinate our_size;
-	cur_statlet_type = kind;
-	if (kind == ST_SMALL)
-		our_size = coordinate(real_display.get_xsize() * 19 / 80,
-				real_display.get_ysize() * 1 / 15);
-	else
-		our_size = coordinate(real_display.get_xsize() * 19 / 80,
-				real_display.get_ysize() * 2 / 15);
-
-	// There are four windows, and if there's no robot in action, it's grey
-	// (dithered in ATR2), hence the need for default_grey.
-	
-	int num_windows;
-
-	if (kind == ST_SMALL)
-		num_windows = max_small_onscreen;
-	else
-		num_windows = max_large_onscreen;
-
-	vector<Display> statlets_out;
-
-	int counter;
-
-	for (counter = 0; counter < num_windows; ++counter) 
-		statlets_out.push_back(Display(false, our_size.x, our_size.y,
-					32));
-
-	for (counter = 0; counter < num_windows; ++counter) {
-		assert(statlets_out[counter].ready()); // It better be working!
-		statlets_out[counter].clear(inactive_background);
+// Set up the views and draw the borders around them. The positions are
+// as if each component were blitted to the display with its upper left
+// corner at the given normalized coordinates.
+void arena_disp::lay_out(double x_separation, double y_separation,
+		const Color & border_color) {
+
+	coordinate screen = display_out->get_size();
+
+	display_out->clear();
+
+	// Handle the arena and its borders.
+	coordinate rel_size = arena_px / screen;
+
+	// Border around the arena.
+	widget.border(*display_out, 0, 0, rel_size.x + x_separation * 2,
+			1.0, x_separation, y_separation, border_color, true,
+			false);
+
+	// .. and around everything to fix some glitches. (But WTH?)
+	widget.border(*display_out, 0, 0, 1.0, 1.0, x_separation, y_separation,
+			border_color, true, false);
+
+	arena_field = Display(*display_out, round(x_separation * screen.x),
+			round(y_separation * screen.y), arena_px.x,
+			arena_px.y);
+	arena_area = SDL_Rect();
+	arena_area.x = round(x_separation * screen.x);
+	arena_area.y = round(y_separation * screen.y);
+	arena_area.w = arena_field.get_xsize();
+	arena_area.h = arena_field.get_ysize();
+
+	// Now the statlets. We just draw borders and place statlets down
+	// until we're done. Those that don't fit above the round information
+	// aren't shown.
+
+	// Get the round information block size so we know when to stop. We'll
+	// also use this for displaying the block itself;
+
+	// Sans borders
+	coordinate rel_size_roundinfo = round_info_px / screen;
+
+	// With borders
+	coordinate far_end_roundinfo(1 - (x_separation * 2 +
+				rel_size_roundinfo.x), 1 - (y_separation * 2 +
+					rel_size_roundinfo.y));
+
+	statlets.clear();
+	statlet_areas.clear();
+
+	double yloc = 0;
+	for (int counter = 0; counter < num_statlets; ++counter) {
+		coordinate rel_size_statlet = statlet_px / screen;
+		// Count down from the last unused y position to find out the
+		// coordinates (1-normalized) of the other edge of the box.
+		coordinate far_end_statlet(1 - (x_separation * 2 +
+					rel_size_statlet.x), (y_separation * 2
+						+ rel_size_statlet.y));
+
+		if (far_end_statlet.y > far_end_roundinfo.y) break;
+
+		widget.border(*display_out, far_end_statlet.x, yloc, 1,
+				yloc + far_end_statlet.y, x_separation,
+				y_separation, border_color, false, false);
+
+		// Get the start coordinates inside the box.
+		double near_x = 1 - (x_separation + rel_size_statlet.x);
+
+		statlets.push_back(Display(*display_out, round(near_x *
+						screen.x), round((yloc +
+							y_separation) *
+						screen.y),
+					statlet_px.x, statlet_px.y));
+
+		SDL_Rect area;
+		area.x = round(near_x * screen.x);
+		area.y = round((yloc + y_separation) * screen.y);
+		area.w = statlets.back().get_xsize();
+		area.h = statlets.back().get_ysize();
+		statlet_areas.push_back(area);
+
+		statlets.back().clear(inactive_background);
+
+		yloc += rel_size_statlet.y + y_separation;
 	}
 
-	return(statlets_out);
+	// And the round info.
+	widget.border(*display_out, far_end_roundinfo.x, far_end_roundinfo.y,
+			1, 1, x_separation, y_separation, border_color,
+			false, false);
+
+	coordinate inside_end(1 - (x_separation + rel_size_roundinfo.x),
+			1 - (y_separation + rel_size_roundinfo.y));
+
+	round_info = Display(*display_out, round(inside_end.x * screen.x),
+			round(inside_end.y * screen.y), round_info_px.x,
+			round_info_px.y);
+	round_info_area.x = round(inside_end.x * screen.x);
+	round_info_area.y = round(inside_end.y * screen.y);
+	round_info_area.w = round_info.get_xsize();
+	round_info_area.h = round_info.get_ysize();
+
+	// Nothing's been drawn in them yet.
+	statlets_shown.assign(statlets.size(), "");
+	round_info_shown.clear();
+	arena_shown.clear();
+
+	full_update = true;
+	laid_out = true;
+}
+
+// What a statlet would show for this robot. The meters only change on
+// screen when they change by a pixel or more.
+string arena_disp::statlet_contents(const robot & source, int index,
+		int meter_width) const {
+
+	string contents = itos(index) + " " + source.get_name() + "\n" +
+		itos(round(source.get_armor() * meter_width)) + " " +
+		itos(round(source.get_heat() * meter_width)) + " " +
+		itos(source.get_all_victories());
+
+	if (cur_statlet_type == ST_LARGE)
+		contents += " " + itos(source.get_all_kills()) + " " +
+			itos(source.get_all_deaths()) + " " +
+			itos(source.has_error()) + " " +
+			itos(source.get_last_error()) + "\n" +
+			source.get_message();
+
+	return(contents);
 }
 
 void arena_disp::refresh_statlets(const vector<robot> & robots,
 		const Color & active_background, const Color & dark_meter,
 		const Color & no_error, int offset) {
 
-	// Update the information in the statlets. A clever, utopian, method
-	// would only do this if the robot has actually changed since the last
-	// turn (vented heat or whatever), but we're not there yet. We use
-	// a vector to robots so that it never has to bother about whether
-	// the robot is alive or dead.
-	
+	// Update the information in the statlets, but only those that would
+	// look different from what they do now. We use a vector to robots so
+	// that it never has to bother about whether the robot is alive or
+	// dead.
+
 	// Active_background is the background color that statlets with robots
 	// have - in ATR2, this is blue. dark_meter is the dark (base) color
 	// for the meters, and no_error is the white that gets used for the
 	// "robot hasn't committed any errors yet" message.
 
-	for (size_t counter = offset; counter < min(robots.size(), 
-				offset + statlets.size()); ++counter) {
-		statlets[counter - offset].clear(active_background);
-		if (cur_statlet_type == ST_SMALL)
-			widget.small_botinfo(statlets[counter - offset],
-					robots[counter], dark_meter, typeface);
-		else
-			widget.large_botinfo(statlets[counter - offset], 
-					robots[counter], dark_meter, no_error, 
-					typeface);
-	}
-
-}
-
-Display arena_disp::construct_round_info(const Display & real_display, 
-		const Color & background_black) {
+	for (size_t counter = 0; counter < statlets.size(); ++counter) {
+		size_t idx = counter + offset;
 
-	// Pretty much the same strategy as in construct_statlets, except that
-	// we need only one, and the default background is now black.
+		// Scrolled past the last robot.
+		if (idx >= robots.size()) {
+			if (statlets_shown[counter].empty()) continue;
 
-	coordinate our_size(real_display.get_xsize() * 19/80,
-			real_display.get_ysize() * 11 / 120);
+			statlets[counter].clear(inactive_background);
+			statlets_shown[counter].clear();
+			updated.push_back(statlet_areas[counter]);
+			continue;
+		}
 
-	Display round_info(false, our_size.x, our_size.y, 32);
+		string contents = statlet_contents(robots[idx], idx,
+				statlets[counter].get_xsize());
+		if (contents == statlets_shown[counter]) continue;
 
-	assert (round_info.ready());
+		statlets[counter].clear(active_background);
+		if (cur_statlet_type == ST_SMALL)
+			widget.small_botinfo(statlets[counter], robots[idx],
+					dark_meter, typeface);
+		else
+			widget.large_botinfo(statlets[counter], robots[idx],
+					dark_meter, no_error, typeface);
 
-	return(round_info);
+		statlets_shown[counter] = contents;
+		updated.push_back(statlet_areas[counter]);
+	}
 }
 
-void arena_disp::refresh_round_info(const Color & background_black, 
+void arena_disp::refresh_round_info(const Color & background_black,
 		const Color & text, matchid_t match_id, int cur_cycle,
 		int max_cycle, int cur_match, int max_match) {
 
-	// text is the color of the text, match_id is the match ID (random 
+	// text is the color of the text, match_id is the match ID (random
 	// seed), cur_cycle is the current cycle, with max_cycle being the
 	// maximum; the same explanation goes for cur_match and max_match.
 
 	// In this case, the box is always active, and so the background is
 	// always black.
 
+	string contents = lltos(match_id) + " " + itos(cur_cycle) + " " +
+		itos(max_cycle) + " " + itos(cur_match) + " " +
+		itos(max_match);
+	if (contents == round_info_shown) return;
+
 	round_info.clear(background_black);
 
 	widget.round_stats(round_info, text, typeface, match_id, cur_cycle,
 			max_cycle, cur_match, max_match);
-}
-
-Display arena_disp::construct_arena(const Display & real_display, coordinate
-		arena_size) {
 
-	// This is quite simple. Since the background is black, we don't have
-	// to clear or anything, just dump a Display with the right relative
-	// dimensions.
-	
-	// Arena size is in meters (that is, ingame units). All we want is
-	// the proportion so we know what aspect ratio to make, thus avoiding
-	// non-round circle problems.
-	
-	int scaled_arena_xsize = round(0.73 * real_display.get_xsize());
-	int scaled_arena_ysize = scaled_arena_xsize * (arena_size.y / (double)
-			arena_size.x);
-
-	Display to_return(false, scaled_arena_xsize, scaled_arena_ysize, 32);
-
-	assert(to_return.ready());
-	to_return.clear();
-
-	return(to_return);
+	round_info_shown = contents;
+	updated.push_back(round_info_area);
 }
 
 // Determine normalized opacity for fading effects (scanner, sonar, and radar
@@ -260,33 +423,85 @@ Display arena_disp::construct_arena(const Display & real_display, coordinate
 // Then we return 1 at current_time = time_at_effect sloping down to 0 at
 // current_time = time_at_effect + latency. Any excess or unexpected values
 // return -1.
-double arena_disp::get_normalized_opacity(double latency, double current_time, 
+double arena_disp::get_normalized_opacity(double latency, double current_time,
 		double time_at_effect, double maxval) {
 
-	if (current_time > time_at_effect + latency || current_time < 
+	if (current_time > time_at_effect + latency || current_time <
 			time_at_effect) return(-1);
 
-	return(renorm(time_at_effect, time_at_effect + latency, current_time, 
+	return(renorm(time_at_effect, time_at_effect + latency, current_time,
 				maxval, 0.0));
 }
 
+// The box, in pixels of the arena, that covers the given normalized
+// coordinates with margin pixels to spare, clipped to the arena.
+SDL_Rect arena_disp::arena_box(double xmin, double ymin, double xmax,
+		double ymax, double margin) const {
+
+	int xsize = arena_field.get_xsize(), ysize = arena_field.get_ysize();
+
+	int x1 = max(0, (int)floor(min(xmin, xmax) * xsize - margin)),
+	    y1 = max(0, (int)floor(min(ymin, ymax) * ysize - margin)),
+	    x2 = min(xsize, (int)ceil(max(xmin, xmax) * xsize + margin)),
+	    y2 = min(ysize, (int)ceil(max(ymin, ymax) * ysize + margin));
+
+	SDL_Rect box;
+	box.x = x1;
+	box.y = y1;
+	box.w = max(0, x2 - x1);
+	box.h = max(0, y2 - y1);
+
+	return(box);
+}
+
+bool arena_disp::overlaps(const SDL_Rect & a, const SDL_Rect & b) const {
+	return(a.x < b.x + b.w && b.x < a.x + a.w && a.y < b.y + b.h &&
+			b.y < a.y + a.h);
+}
+
+// Join boxes that overlap, so that nothing is cleared and drawn twice.
+void arena_disp::merge_boxes(vector<SDL_Rect> & boxes) const {
+	bool merged = true;
+
+	while (merged) {
+		merged = false;
+		for (size_t i = 0; i < boxes.size(); ++i)
+			for (size_t j = i + 1; j < boxes.size(); ++j) {
+				if (!overlaps(boxes[i], boxes[j])) continue;
+
+				int x1 = min(boxes[i].x, boxes[j].x),
+				    y1 = min(boxes[i].y, boxes[j].y),
+				    x2 = max(boxes[i].x + boxes[i].w,
+						    boxes[j].x + boxes[j].w),
+				    y2 = max(boxes[i].y + boxes[i].h,
+						    boxes[j].y + boxes[j].h);
+
+				boxes[i].x = x1; boxes[i].y = y1;
+				boxes[i].w = x2 - x1; boxes[i].h = y2 - y1;
+				boxes.erase(boxes.begin() + j);
+				merged = true;
+				--j;
+			}
+	}
+}
+
 // Perhaps a "robot_color" generator that makes distinguishably different shield
 // and turret colors? Nah, turret is grey no matter whose turret it is; but
 // shield should be a darker version of the robot's hue. DONE.
-void arena_disp::refresh_arena(const Color & turret,
-		const Color & missile_col, const Color & overburn_missile_col,
-		const Color & mine_col,
-		const vector<robot> & robots, const list<missile> & missiles, 
-		const list<mine> & mines, const blasts & explosions, 
-		int robot_display_radius, coordinate arena_size, 
-		int buffer_thickness, double cycles_per_sec, double scan_lag, 
-		double sonar_lag, double radar_lag, bool show_scanarcs) {
 
-	// Utopian versions would know what has changed and only remove the
-	// necessary parts.
+// Finds everything that's to be drawn in the arena, and how.
+vector<arena_item> arena_disp::find_arena_items(const vector<robot> & robots,
+		const list<missile> & missiles, const list<mine> & mines,
+		const blasts & explosions, int robot_display_radius,
+		coordinate arena_size, int buffer_thickness,
+		double cycles_per_sec, double scan_lag, double sonar_lag,
+		double radar_lag, bool show_scanarcs) {
 
-	// First clear what's already drawn here.
-	arena_field.clear();
+	vector<arena_item> items;
+	arena_item next;
+	next.index = -1;
+	next.radius = 0; next.angle = 0; next.breadth = 0; next.turret = 0;
+	next.opacity = 1; next.shielded = false; next.shell = NULL;
 
 	// Set up buffer_thickness adjustments. These indent the actual arena
 	// a bit so that it's possible to see what's going on at, say, (0,0).
@@ -299,6 +514,9 @@ void arena_disp::refresh_arena(const Color & turret,
 	double rel_robot_disp_radius = robot_display_radius / (double)
 		adjusted_arena.y;
 
+	// Circles are drawn with a radius relative to the x size.
+	double xsize = arena_field.get_xsize();
+
 	// Get sonar cycle persistence in terms of cycles instead of msecs.
 	// This is how long the sonar afterimage is displayed (so we can see
 	// the result).
@@ -307,167 +525,334 @@ void arena_disp::refresh_arena(const Color & turret,
 	double scan_cycle_persistence = cycles_per_sec * (scan_lag / 1000.0);
 	double radar_cycle_persistence = cycles_per_sec * (radar_lag / 1000.0);
 
-	// Draw faint edge border (not in ATR2) so that we can see when a
-	// missile passes through the edge and thus doesn't impact anything.
-	Color wallcolor(0.3, 0, 0);
+	// The walls never change, so they're only there to be drawn again
+	// when something near them is.
+	next.kind = AI_WALLS;
+	next.box = arena_box(0, 0, 1, 1, 0);
+	items.push_back(next);
 
-	arena_field.box(0, 0, 1, base.y/adjusted_arena.y, wallcolor, 1.0);
-	arena_field.box(0, 1, 1, 1 - base.y/adjusted_arena.y, wallcolor, 1.0);
-	arena_field.box(0, 0, base.x/adjusted_arena.x, 1, wallcolor, 1.0);
-	arena_field.box(1, 0, 1 - base.x/adjusted_arena.x, 1, wallcolor, 1.0);
+	for (size_t idx = 0; idx < robots.size(); ++idx) {
+		const robot & bot = robots[idx];
+		if (bot.dead()) continue; // Don't draw the dead.
 
-
-	// Draw robots.
-	for (vector<robot>::const_iterator pos = robots.begin(); pos !=
-			robots.end(); ++pos) {
-		if (pos->dead()) continue; // Don't draw the dead.
+		next.index = idx;
 
 		// Turn 0..arena_size into base..less_arena, then divide by
 		// arena_size to get the "adjusted" 0..1 position.
-		coordinate renorm_pos = renorm(coordinate(0, 0), 
-				arena_size, pos->get_pos(), base, 
+		coordinate renorm_pos = renorm(coordinate(0, 0),
+				arena_size, bot.get_pos(), base,
 				less_arena) / arena_size;
 
-		double n_turr_head_lastscan = hex_to_deg(pos->
-				get_scan_center(false));
-
 		// Determine if the radar has fired recently enough that we
 		// should let the user know.
 		double radar_opacity = get_normalized_opacity(
-				radar_cycle_persistence, pos->get_time(), 
-				pos->get_last_radar_time(), 1.0);
+				radar_cycle_persistence, bot.get_time(),
+				bot.get_last_radar_time(), 1.0);
 
 		if (radar_opacity < 0) radar_opacity = 0;
 
-		// Draw the robot.
-		widget.draw_robot(arena_field, renorm_pos.x, renorm_pos.y,
-				 rel_robot_disp_radius, hex_to_deg(pos->
-					 get_heading()), hex_to_deg(pos->
-					 turret_heading), pos->assigned_color,
-				 turret, pos->shield_color, pos->is_shielded(),
-				 radar_opacity);
-
-		// Draw the sonar afterimage if we did any sonar checks lately.
+		// The robot.
+		next.kind = AI_ROBOT;
+		next.pos = renorm_pos;
+		next.radius = rel_robot_disp_radius;
+		next.angle = hex_to_deg(bot.get_heading());
+		next.turret = hex_to_deg(bot.turret_heading);
+		next.shielded = bot.is_shielded();
+		next.opacity = radar_opacity;
+		next.box = arena_box(renorm_pos.x, renorm_pos.y, renorm_pos.x,
+				renorm_pos.y, next.radius * xsize + 2);
+		items.push_back(next);
+
+		next.turret = 0;
+		next.shielded = false;
+
+		// The sonar afterimage if we did any sonar checks lately.
 		double norm_sonar_opaq = 0.7, sonar_opacity = -1;
-		if (pos->get_last_sonar_time() != -1)
+		if (bot.get_last_sonar_time() != -1)
 			sonar_opacity = get_normalized_opacity(
-					sonar_cycle_persistence, pos->
-					get_time(), pos->get_last_sonar_time(),
+					sonar_cycle_persistence, bot.
+					get_time(), bot.get_last_sonar_time(),
 					norm_sonar_opaq);
-					
+
 		// Too early or no sonar? If so, don't draw.
 		if (sonar_opacity != -1 && sonar_opacity > 0) {
-
-			coordinate renorm_sonar_pos = renorm(coordinate(0, 0),
-					arena_size, pos->get_last_sonar_pos(),
-					base, less_arena) / arena_size;
-
-			widget.draw_sonar(arena_field, renorm_sonar_pos.x,
-					renorm_sonar_pos.y, pos->
-					get_sonar_maxrange()/adjusted_arena.y, 
-					pos->get_last_sonar_angle(),
-					turret, true, sonar_opacity);
+			next.kind = AI_SONAR;
+			next.pos = renorm(coordinate(0, 0), arena_size,
+					bot.get_last_sonar_pos(), base,
+					less_arena) / arena_size;
+			next.radius = bot.get_sonar_maxrange() /
+				adjusted_arena.y;
+			next.angle = bot.get_last_sonar_angle();
+			next.opacity = sonar_opacity;
+			next.box = arena_box(next.pos.x, next.pos.y,
+					next.pos.x, next.pos.y,
+					next.radius * xsize + 2);
+			items.push_back(next);
 		}
 
-		// Draw scanner afterimage if we did any scans lately. [hSA]
+		// Scanner afterimage if we did any scans lately. [hSA]
 
 		double norm_scan_opaq = 0.7, scan_opacity = -1;
-		if (pos->get_scan_time(false) != -1)
+		if (bot.get_scan_time(false) != -1)
 			scan_opacity = get_normalized_opacity(
-					scan_cycle_persistence, pos->get_time(),
-					pos->get_scan_time(false), 
+					scan_cycle_persistence, bot.get_time(),
+					bot.get_scan_time(false),
 					norm_scan_opaq);
 
-		Color scangrey(0.7, 0.7, 0.7);
-
 		// Only draw if we haven't faded out.
 		if (scan_opacity > 0 && show_scanarcs) {
+			next.kind = AI_SCAN;
+			next.pos = renorm(coordinate(0, 0), arena_size,
+					bot.get_scan_pos(false), base,
+					less_arena) / arena_size;
 
-			coordinate scanpos_raw = pos->get_scan_pos(false);
-			double maximal_edge = max(arena_size.y - scanpos_raw.y,
-					arena_size.x - scanpos_raw.x);
-			maximal_edge = max(max(maximal_edge, scanpos_raw.y),
-					scanpos_raw.x);
-
-			coordinate scanpos_norm = renorm(coordinate(0, 0),
-					arena_size, scanpos_raw,
-					base, less_arena) / arena_size;
-
-			// To not make it too slow, we should take the minimum
-			// of the range here and that to the edge of the screen.
-			// We also take the minimum of the scanner's range and
-			// the distance to the target (if any), so it's more 
+			// We take the minimum of the scanner's range and
+			// the distance to the target (if any), so it's more
 			// clear which robot was detected, if there are more
 			// than one.
-			double real_dist = min(pos->get_scan_dist(false),
-					pos->get_scanrange());
-			// This could be misleading, since the end of the arcs
-			// don't go past the edge if we do so, but would if
-			// we don't.. Hm.
-			//real_dist = min(real_dist, maximal_edge);
-			real_dist /= arena_size.y;
+			next.radius = min(bot.get_scan_dist(false),
+					bot.get_scanrange()) / arena_size.y;
 
 			// Since the scanning span is a scalar (shows
 			// magnitude of something, not direction), it must
 			// be converted to degrees manually.
-			double scan_arc = 2 * pos->get_scan_span(false) / 256.0
+			next.angle = hex_to_deg(bot.get_scan_center(false));
+			next.breadth = 2 * bot.get_scan_span(false) / 256.0
 				* 360.0;
-			
-			widget.scanarc(arena_field, scanpos_norm.x, 
-					scanpos_norm.y, real_dist, 
-					n_turr_head_lastscan, scan_arc,
-					scangrey, true, turret, scan_opacity,
-					0.5);
+			next.opacity = scan_opacity;
+			next.box = arena_box(next.pos.x, next.pos.y,
+					next.pos.x, next.pos.y,
+					next.radius * xsize + 2);
+			items.push_back(next);
+
+			next.breadth = 0;
 		}
 	}
 
-	// Draw missiles.
-	
+	next.index = -1;
+	next.radius = 0; next.angle = 0; next.opacity = 1;
+
+	// Missiles are drawn as a line from where they are to where they'll
+	// be next.
+	next.kind = AI_MISSILE;
 	for (list<missile>::const_iterator shell = missiles.begin(); shell !=
-			missiles.end(); ++shell)
-		widget.draw_missile(base, arena_field, *shell, 1.0, false,
-				missile_col, overburn_missile_col, 
-				adjusted_arena.x, adjusted_arena.y);
+			missiles.end(); ++shell) {
+		coordinate start_pos = shell->get_pos(), end_pos = shell->
+			predict_motion(start_pos, 1.0);
+		start_pos = (start_pos + base) / adjusted_arena;
+		end_pos = (end_pos + base) / adjusted_arena;
+
+		next.pos = start_pos;
+		next.shell = &*shell;
+		next.box = arena_box(start_pos.x, start_pos.y, end_pos.x,
+				end_pos.y, 2);
+		items.push_back(next);
+	}
+
+	next.shell = NULL;
 
-	// .. mines,
-	
+	next.kind = AI_MINE;
 	for (list<mine>::const_iterator mshell = mines.begin(); mshell !=
 			mines.end(); ++mshell) {
-		coordinate norm_mine_pos = renorm(coordinate(0, 0), arena_size,
-				mshell->get_pos(), base, less_arena) / 
+		next.pos = renorm(coordinate(0, 0), arena_size,
+				mshell->get_pos(), base, less_arena) /
 			arena_size;
+		next.box = arena_box(next.pos.x, next.pos.y, next.pos.x,
+				next.pos.y, 0.002 * xsize + 2);
+		items.push_back(next);
+	}
 
-		widget.draw_mine(arena_field, norm_mine_pos.x, norm_mine_pos.y,
-				0.002, mine_col);
+	// The blasts are all drawn at once, but each has its own box.
+	vector<pair<coordinate, double> > extents;
+	explosions.get_extents(base, adjusted_arena, extents);
+
+	next.kind = AI_BLAST;
+	for (size_t counter = 0; counter < extents.size(); ++counter) {
+		next.pos = extents[counter].first;
+		next.radius = extents[counter].second;
+		next.box = arena_box(next.pos.x, next.pos.y, next.pos.x,
+				next.pos.y, next.radius * xsize + 2);
+		items.push_back(next);
 	}
 
-	// And finally, the explosions.
-	explosions.draw_blasts(base, arena_field, adjusted_arena);
+	sort(items.begin(), items.end());
+	return(items);
+}
+
+void arena_disp::draw_arena_item(const arena_item & item,
+		const Color & turret, const Color & missile_col,
+		const Color & overburn_missile_col, const Color & mine_col,
+		const vector<robot> & robots, const blasts & explosions,
+		coordinate arena_size, int buffer_thickness) {
+
+	coordinate base(buffer_thickness, buffer_thickness),
+		   adjusted_arena(arena_size.x + buffer_thickness * 2,
+				   arena_size.y + buffer_thickness * 2);
+
+	Color wallcolor(0.3, 0, 0), scangrey(0.7, 0.7, 0.7);
+
+	switch(item.kind) {
+		case AI_WALLS:
+			// Draw faint edge border (not in ATR2) so that we can
+			// see when a missile passes through the edge and thus
+			// doesn't impact anything.
+			arena_field.box(0, 0, 1, base.y/adjusted_arena.y,
+					wallcolor, 1.0);
+			arena_field.box(0, 1, 1, 1 - base.y/adjusted_arena.y,
+					wallcolor, 1.0);
+			arena_field.box(0, 0, base.x/adjusted_arena.x, 1,
+					wallcolor, 1.0);
+			arena_field.box(1, 0, 1 - base.x/adjusted_arena.x, 1,
+					wallcolor, 1.0);
+			break;
+		case AI_ROBOT:
+			widget.draw_robot(arena_field, item.pos.x, item.pos.y,
+					item.radius, item.angle, item.turret,
+					robots[item.index].assigned_color,
+					turret, robots[item.index].
+					shield_color, item.shielded,
+					item.opacity);
+			break;
+		case AI_SONAR:
+			widget.draw_sonar(arena_field, item.pos.x, item.pos.y,
+					item.radius, item.angle, turret, true,
+					item.opacity);
+			break;
+		case AI_SCAN:
+			widget.scanarc(arena_field, item.pos.x, item.pos.y,
+					item.radius, item.angle, item.breadth,
+					scangrey, true, turret, item.opacity,
+					0.5);
+			break;
+		case AI_MISSILE:
+			widget.draw_missile(base, arena_field, *item.shell,
+					1.0, false, missile_col,
+					overburn_missile_col,
+					adjusted_arena.x, adjusted_arena.y);
+			break;
+		case AI_MINE:
+			widget.draw_mine(arena_field, item.pos.x, item.pos.y,
+					0.002, mine_col);
+			break;
+		case AI_BLAST:
+			explosions.draw_blasts(base, arena_field,
+					adjusted_arena);
+			break;
+	}
+}
+
+void arena_disp::refresh_arena(const Color & turret,
+		const Color & missile_col, const Color & overburn_missile_col,
+		const Color & mine_col,
+		const vector<robot> & robots, const list<missile> & missiles,
+		const list<mine> & mines, const blasts & explosions,
+		int robot_display_radius, coordinate arena_size,
+		int buffer_thickness, double cycles_per_sec, double scan_lag,
+		double sonar_lag, double radar_lag, bool show_scanarcs) {
+
+	vector<arena_item> items = find_arena_items(robots, missiles, mines,
+			explosions, robot_display_radius, arena_size,
+			buffer_thickness, cycles_per_sec, scan_lag, sonar_lag,
+			radar_lag, show_scanarcs);
+
+	// What has to be drawn anew is where something was last time that
+	// isn't there now, and vice versa. If nothing's been drawn yet, that's
+	// everything.
+	vector<SDL_Rect> dirty;
+
+	if (arena_shown.empty())
+		dirty.push_back(arena_box(0, 0, 1, 1, 0));
+	else {
+		vector<arena_item> changed;
+		set_symmetric_difference(items.begin(), items.end(),
+				arena_shown.begin(), arena_shown.end(),
+				back_inserter(changed));
+		for (size_t counter = 0; counter < changed.size(); ++counter)
+			if (changed[counter].box.w > 0 &&
+					changed[counter].box.h > 0)
+				dirty.push_back(changed[counter].box);
+	}
+
+	merge_boxes(dirty);
+
+	// Clear each box and draw what's in it again. Since we only draw
+	// inside the box, everything else is left as it was.
+	for (size_t counter = 0; counter < dirty.size(); ++counter) {
+		const SDL_Rect & box = dirty[counter];
+		arena_field.set_clip(box.x, box.y, box.x + box.w,
+				box.y + box.h);
+		arena_field.clear();
+
+		bool blasts_drawn = false;
+		for (size_t idx = 0; idx < items.size(); ++idx) {
+			if (!overlaps(items[idx].box, box)) continue;
+			if (items[idx].kind == AI_BLAST) {
+				if (blasts_drawn) continue;
+				blasts_drawn = true;
+			}
+			draw_arena_item(items[idx], turret, missile_col,
+					overburn_missile_col, mine_col, robots,
+					explosions, arena_size,
+					buffer_thickness);
+		}
+
+		SDL_Rect on_screen = box;
+		on_screen.x += arena_area.x;
+		on_screen.y += arena_area.y;
+		updated.push_back(on_screen);
+	}
+
+	arena_field.reset_clip();
+	arena_shown = items;
 }
 
 // -- PUBLIC //
 
 void arena_disp::derive_displays(const coordinate arena_size, int num_robots) {
-	Color background_black(0, 0, 0), inactive_background(0.16, 0.16, 0.16);
+	// First get the x and y size of the display, then use ATR2 measures
+	// to find out how large the statlet window is going to be (so that we
+	// retain nominal resolution independence).
+
+	// DONE: Mini-statlets for > 4 contestants.
+	coordinate screen = display_out->get_size();
+
+	if (num_robots > max_large_onscreen) {
+		cur_statlet_type = ST_SMALL;
+		num_statlets = max_small_onscreen;
+		statlet_px = coordinate((int)screen.x * 19 / 80,
+				(int)screen.y * 1 / 15);
+	} else {
+		cur_statlet_type = ST_LARGE;
+		num_statlets = max_large_onscreen;
+		statlet_px = coordinate((int)screen.x * 19 / 80,
+				(int)screen.y * 2 / 15);
+	}
+
+	// Pretty much the same strategy as for the statlets, except that
+	// we need only one.
+	round_info_px = coordinate((int)screen.x * 19/80,
+			(int)screen.y * 11 / 120);
 
-	if (num_robots > max_large_onscreen)
-		statlets = construct_statlets(*display_out, inactive_background,
-				ST_SMALL);
-	else	statlets = construct_statlets(*display_out, inactive_background,
-			ST_LARGE);
+	// Arena size is in meters (that is, ingame units). All we want is
+	// the proportion so we know what aspect ratio to make, thus avoiding
+	// non-round circle problems.
+	int scaled_arena_xsize = round(0.73 * screen.x);
+	int scaled_arena_ysize = scaled_arena_xsize * (arena_size.y / (double)
+			arena_size.x);
+	arena_px = coordinate(scaled_arena_xsize, scaled_arena_ysize);
 
-	round_info = construct_round_info(*display_out, background_black);
-	arena_field = construct_arena(*display_out, arena_size);
-	arena_field.clear();
+	laid_out = false;
 }
 
 // The display constructors here (1x1 pixel at 32 bpp) are just temporary
-// fillers until we initialize them properly with construct_*.
-arena_disp::arena_disp(Display & real_display, const coordinate arena_size, 
-		Font & typeface_in, int num_robots) : arena_field(false, 1, 1, 
+// fillers until lay_out makes views of the real display.
+arena_disp::arena_disp(Display & real_display, const coordinate arena_size,
+		Font & typeface_in, int num_robots) : arena_field(false, 1, 1,
 			32), round_info(false, 1, 1, 32) {
 	max_small_onscreen = 11;
 	max_large_onscreen = 6;
+	inactive_background = Color(0.16, 0.16, 0.16);
+	full_update = false;
 
 	display_out = &real_display;
 
@@ -489,30 +874,13 @@ void arena_disp::resize_displays(int new_xsize, const coordinate arena_size,
 }
 
 void arena_disp::resize_displays(int new_xsize, const coordinate arena_size) {
-	resize_displays(new_xsize, arena_size, statlets.size());
+	resize_displays(new_xsize, arena_size, num_statlets);
 }
 
 void arena_disp::reset_num_statlets(int num_robots) {
 	derive_displays(display_out->get_size(), num_robots);
 }
 
-bool arena_disp::blit_refresh(const Display & from, Display & to,
-		double xmin, double ymin, double xmax, double ymax,
-		int num_robots) {
-	// First try to blit. If we managed to blit, return true.
-	// Otherwise, if it's -2, that means everything must be redrawn, so
-	// rederive, and in either case, return false since the blit was
-	// unsuccessful.
-	
-	int blit_attempt = to.blit(from, xmin, ymin, xmax, ymax);
-	if (blit_attempt == 0) return(true);
-
-	if (blit_attempt == -2)
-		derive_displays(display_out->get_size(), num_robots);
-
-	return(false);
-}
-
 // X_separation is the thickness of the borders. The purpose of offset is to
 // let the user "scroll" robot stats while in graphics mode. DONE: Proof
 // this for the case where he scrolls towards the edge (e.g so that the last
@@ -520,14 +888,14 @@ bool arena_disp::blit_refresh(const Display & from, Display & to,
 bool arena_disp::render_all(double x_separation, const Color border_color,
 		const Color round_info_fg, const Color
 		round_info_bg, const Color statlet_active_bg,
-		const Color statlet_dark_meter, const Color statlet_no_error, 
+		const Color statlet_dark_meter, const Color statlet_no_error,
 		const Color turret, const Color missile_col,
 		const Color overburn_missile_col, const Color mine_col,
-		matchid_t match_id, int cur_cycle, int max_cycle, 
+		matchid_t match_id, int cur_cycle, int max_cycle,
 		int cur_match, int max_match, const vector<robot> & robots,
 		const list<missile> & missiles, const list<mine> & mines,
-		const blasts & explosions, int robot_display_radius, 
-		coordinate arena_size, int buffer_thickness, 
+		const blasts & explosions, int robot_display_radius,
+		coordinate arena_size, int buffer_thickness,
 		double cycles_per_sec, double scan_lag, double sonar_lag,
 		double radar_lag, bool show_scanarcs, int offset) {
 
@@ -545,10 +913,16 @@ bool arena_disp::render_all(double x_separation, const Color border_color,
 
 	// Clamp offset so he can't scroll past the edge, unless that
 	// would go below zero.
-	offset = max((size_t)0, min((size_t)offset, 
-				robots.size()-statlets.size()));
+	offset = max((size_t)0, min((size_t)offset,
+				robots.size() - num_statlets));
 
-	// First refresh the virtual displays we're going to show.
+	if (!laid_out) {
+		coordinate rel_size = arena_px / display_out->get_size();
+		lay_out(x_separation, 0.5 - rel_size.y * 0.5, border_color);
+	}
+
+	if (!arena_field.ready() || !round_info.ready())
+		return(false);
 
 	refresh_statlets(robots, statlet_active_bg, statlet_dark_meter,
 			statlet_no_error, offset);
@@ -556,102 +930,29 @@ bool arena_disp::render_all(double x_separation, const Color border_color,
 	refresh_arena(turret, missile_col, overburn_missile_col,
 			mine_col, robots, missiles, mines, explosions,
 			robot_display_radius, arena_size, buffer_thickness,
-			cycles_per_sec, scan_lag, sonar_lag, radar_lag, 
+			cycles_per_sec, scan_lag, sonar_lag, radar_lag,
 			show_scanarcs);
 
 	refresh_round_info(round_info_bg, round_info_fg, match_id, cur_cycle,
 			max_cycle, cur_match, max_match);
 
-	// Clear what we're going to draw to.
-	// That's not necessary, since we're going to be overwriting every
-	// changed area anyhow. Remove comments for debugging to see if any 
-	// areas are undrawn.
-	//display_out->clear(0.1, 0.5, 0.9);
-
-	// Handle the arena and its borders.
-	coordinate rel_size = arena_field.get_size() / display_out->get_size();
-
-	double y_separation = 0.5 - rel_size.y * 0.5;
-
-	// Border around the arena.
-	widget.border(*display_out, 0, 0, rel_size.x + x_separation * 2,
-			1.0, x_separation, y_separation, border_color, true,
-			false);
-
-	// .. and around everything to fix some glitches. (But WTH?)
-	widget.border(*display_out, 0, 0, 1.0, 1.0, x_separation, y_separation,
-			border_color, true, false);
-
-	// Blit the arena
-	if (!blit_refresh(arena_field, *display_out, x_separation, 
-				y_separation, 1, 1, robots.size()))
-		return(false);
-
-	// Now copy the statlets. We just draw borders and copy statlet blocks
-	// down until we're done. In the case of >4, we should use smaller
-	// statlets, but for now we just quit once we reach the bottom.
-	
-	// Get the round information block size so we know when to stop. We'll
-	// also use this for displaying the block itself;
-	
-	// Sans borders
-	coordinate rel_size_roundinfo = round_info.get_size() / 
-		display_out->get_size();
-
-	// With borders
-	coordinate far_end_roundinfo(1 - (x_separation * 2 + 
-				rel_size_roundinfo.x), 1 - (y_separation * 2 +
-					rel_size_roundinfo.y));
-
-	double yloc = 0;
-	for (size_t counter = 0; counter < statlets.size(); ++counter) {
-		coordinate rel_size_statlet = statlets[counter].get_size() /
-			display_out->get_size();
-		// Count down from the last unused y position to find out the
-		// coordinates (1-normalized) of the other edge of the box.
-		coordinate far_end_statlet(1 - (x_separation * 2 +
-					rel_size_statlet.x), (y_separation * 2
-						+ rel_size_statlet.y));
-
-		if (far_end_statlet.y > far_end_roundinfo.y) break;
-
-		widget.border(*display_out, far_end_statlet.x, yloc, 1,
-				yloc + far_end_statlet.y, x_separation,
-				y_separation, border_color, false, false);
-
-		// Get the start and end coordinates inside the box.
-		double near_x = 1 - (x_separation + rel_size_statlet.x);
-		// And blit!
-		if (!blit_refresh(statlets[counter], *display_out, near_x,
-					yloc + y_separation, 1, 1,
-					robots.size()))
-			return(false);
-
-		yloc += rel_size_statlet.y + y_separation;
-	}
-
-	// Draw the round info.
-	widget.border(*display_out, far_end_roundinfo.x, far_end_roundinfo.y,
-			1, 1, x_separation, y_separation, border_color,
-			false, false);
-
-	coordinate inside_end(1 - (x_separation + rel_size_roundinfo.x),
-			1 - (y_separation + rel_size_roundinfo.y));
+	return(true);
+}
 
-	// Blit!
-	// Perhaps change 1,1 to the other end if that makes it any faster.
-	if (!blit_refresh(round_info, *display_out, inside_end.x, inside_end.y,
-				1, 1, robots.size()))
-		return(false);
+void arena_disp::display() {
+	if (full_update)
+		display_out->render();
+	else	display_out->render(updated);
 
-	return(true);
+	updated.clear();
+	full_update = false;
 }
 
 bool arena_disp::can_scroll_statlets(int scroll_number, int num_robots) {
 	// If scrolling to this margin would cause one of the areas to be
 	// unoccupied, then return false, otherwise return true.
-	
-	return (num_robots - scroll_number >= statlets.size() );
+
+	return (num_robots - scroll_number >= num_statlets);
 }
 
 #endif
@@ -0,0 +1,232 @@
+#!/bin/sh
+
+# Benchmark suite for K-Robots. Runs a fixed set of scenarios made from the
+# bundled robots, each with fixed Match IDs and round lengths, and reports
+# cycles per second, instructions per second and wall time for each as JSON.
+# Given the JSON from an earlier run, it also reports which scenarios got
+# slower by more than a given tolerance.
+
+# Every run is a single round (-m 1) with a fixed Match ID (-z), since only
+# the first round of a bout has a predictable Match ID. Each scenario is run
+# over several Match IDs, and each of those several times over, keeping the
+# fastest time so that noise from other processes matters less.
+
+# Since the rounds are the same from run to run, so are the cycle and
+# instruction counts. If those differ from the baseline, the simulator now
+# does something different, and the times can't be compared; that's
+# reported too.
+
+# This is also the training workload for profile-guided optimization; see
+# the krobots-pgo target in the Makefile.
+
+usage() {
+	cat <<EOF
+Usage: $0 [options]
+	-k <file>   Benchmark this krobots binary (default ./krobots).
+	-o <file>   Write the results to <file> instead of standard output.
+	-c <file>   Compare with the results in <file>, and exit with 1 if
+		    anything got slower or ran differently.
+	-t <num>    Tolerate slowdowns of up to <num> percent (default 5).
+	-n <num>    Time each round <num> times, keeping the best (default 3).
+	-s <name>   Only run the named scenario. Can be given more than once.
+	-l          List the scenarios and exit.
+EOF
+}
+
+KROBOTS=./krobots
+OUTPUT=
+BASELINE=
+TOLERANCE=5
+REPEATS=3
+ONLY=
+LIST=
+
+while getopts "k:o:c:t:n:s:lh" opt; do
+	case $opt in
+		k) KROBOTS=$OPTARG ;;
+		o) OUTPUT=$OPTARG ;;
+		c) BASELINE=$OPTARG ;;
+		t) TOLERANCE=$OPTARG ;;
+		n) REPEATS=$OPTARG ;;
+		s) ONLY="$ONLY $OPTARG" ;;
+		l) LIST=1 ;;
+		*) usage; exit 2 ;;
+	esac
+done
+
+# The Match IDs every scenario is run with.
+MATCHIDS="1 2 3 4 5 6 7 8 9 10 11 12 13 14 15 16"
+
+E=example_robots
+O=own_robots
+T=test_robots
+
+# Each list has to be on one line, since the scenarios are one per line.
+MELEE8="$E/circles.at2 $E/rammer.at2 $E/sniper.at2 $E/sweeper.at2"
+MELEE8="$MELEE8 $E/tracker.at2 $E/trapper.at2 $E/weaver.at2 $E/zitgun.at2"
+SPAM="$E/peashoot.at2 $E/zitgun.at2 $E/tracon.at2"
+SPAM="$SPAM $O/rec9.at2 $O/_rec9.at2 $O/strip.at2"
+MINES="$E/trapper.at2 $E/trapper.at2 $O/tmine.at2 $O/tmine.at2"
+MINES="$MINES $E/sduck.at2 $E/circles.at2"
+ALL_EXAMPLES=$(echo $E/*.at2)
+MELEE64="$ALL_EXAMPLES $ALL_EXAMPLES $ALL_EXAMPLES $T/twirler.at2"
+
+# name, krobots options, robots
+SCENARIOS="
+duel|-l 20|$E/tracker.at2 $E/sweeper.at2
+melee8|-l 20|$MELEE8
+melee64|-l 5|$MELEE64
+missile-spam|-l 20|$SPAM
+mine-heavy|-l 20|$MINES
+fastcpu|-l 10 -t 50|$MELEE8
+insane-missiles|-l 20 -% 5|$SPAM
+"
+
+wanted() {
+	[ -z "$ONLY" ] && return 0
+	for name in $ONLY; do
+		[ "$name" = "$1" ] && return 0
+	done
+	return 1
+}
+
+# Floating point arithmetic, since the shell only does integers. Fails if
+# the result is zero, so it works for comparisons too.
+calc() {
+	awk "BEGIN { x = $1; printf(\"%.9g\\n\", x); exit(x == 0) }"
+}
+
+# Pull a number out of krobots' --speed-file output.
+field() {
+	sed -e "s/.*\"$1\": \([0-9.e+-]*\).*/\1/" "$2"
+}
+
+if [ -n "$LIST" ]; then
+	echo "$SCENARIOS" | while IFS='|' read name options robots; do
+		[ -n "$name" ] && echo "$name	$options"
+	done
+	exit 0
+fi
+
+if [ ! -x "$KROBOTS" ]; then
+	echo "Error: $KROBOTS isn't an executable." >&2
+	exit 2
+fi
+
+TMP=$(mktemp -d) || exit 2
+trap 'rm -rf "$TMP"' EXIT INT TERM
+
+# Run one scenario, writing a line of JSON for it to $TMP/results.
+run_scenario() {
+	name=$1; options=$2; robots=$3
+	cycles=0; instructions=0; seconds=0
+
+	for matchid in $MATCHIDS; do
+		best=
+		run=0
+		while [ $run -lt $REPEATS ]; do
+			if ! $KROBOTS -g -b -s -m 1 -z $matchid $options \
+					--speed-file "$TMP/speed" $robots \
+					> "$TMP/log" 2>&1; then
+				echo "Error: $name failed with Match ID" \
+					"$matchid:" >&2
+				cat "$TMP/log" >&2
+				return 1
+			fi
+			time=$(field seconds "$TMP/speed")
+			if [ -z "$best" ] || calc "$time < $best" \
+					> /dev/null; then
+				best=$time
+			fi
+			run=$((run + 1))
+		done
+
+		cycles=$((cycles + $(field cycles "$TMP/speed")))
+		instructions=$((instructions +
+			$(field instructions "$TMP/speed")))
+		seconds=$(calc "$seconds + $best")
+	done
+
+	printf '    {"name": "%s", "cycles": %d, "instructions": %d, ' \
+		"$name" $cycles $instructions >> "$TMP/results"
+	printf '"seconds": %.6f, "cps": %.1f, "ips": %.1f}' $seconds \
+		$(calc "$cycles / $seconds") \
+		$(calc "$instructions / $seconds") >> "$TMP/results"
+}
+
+: > "$TMP/results"
+first=1
+echo "$SCENARIOS" > "$TMP/scenarios"
+while IFS='|' read name options robots; do
+	[ -z "$name" ] && continue
+	wanted "$name" || continue
+
+	[ -z "$first" ] && echo "," >> "$TMP/results"
+	first=
+	echo "Running $name..." >&2
+	run_scenario "$name" "$options" "$robots" || exit 2
+done < "$TMP/scenarios"
+echo >> "$TMP/results"
+
+{
+	echo "{"
+	echo "  \"krobots\": \"$KROBOTS\","
+	echo "  \"date\": \"$(date -u +%Y-%m-%dT%H:%M:%SZ)\","
+	echo "  \"matchids\": \"$MATCHIDS\","
+	echo "  \"repeats\": $REPEATS,"
+	echo "  \"scenarios\": ["
+	cat "$TMP/results"
+	echo "  ]"
+	echo "}"
+} > "$TMP/json"
+
+if [ -n "$OUTPUT" ]; then
+	cp "$TMP/json" "$OUTPUT"
+else
+	cat "$TMP/json"
+fi
+
+[ -z "$BASELINE" ] && exit 0
+
+if [ ! -r "$BASELINE" ]; then
+	echo "Error: Can't read baseline $BASELINE." >&2
+	exit 2
+fi
+
+# Both files have one scenario per line, as written above.
+awk -v tolerance=$TOLERANCE '
+	function get(line, key,    start, rest) {
+		start = index(line, "\"" key "\": ") + length(key) + 4
+		rest = substr(line, start)
+		sub(/[,}].*/, "", rest)
+		gsub(/"/, "", rest)
+		return rest
+	}
+	!/"name":/ { next }
+	FNR == NR {
+		name = get($0, "name")
+		base_cps[name] = get($0, "cps")
+		base_cycles[name] = get($0, "cycles")
+		base_instr[name] = get($0, "instructions")
+		next
+	}
+	{
+		name = get($0, "name")
+		if (!(name in base_cps)) {
+			printf("%-16s not in baseline\n", name)
+			next
+		}
+		change = 100 * (get($0, "cps") / base_cps[name] - 1)
+		status = "ok"
+		if (get($0, "cycles") != base_cycles[name] ||
+				get($0, "instructions") != base_instr[name]) {
+			status = "RAN DIFFERENTLY"
+			bad = 1
+		} else if (change < -tolerance) {
+			status = "REGRESSION"
+			bad = 1
+		}
+		printf("%-16s %+7.1f%% cps  %s\n", name, change, status)
+	}
+	END { exit(bad) }
+' "$BASELINE" "$TMP/json" >&2
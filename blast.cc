@@ -5,6 +5,7 @@
 
 #include "color.cc"
 #include "coordinate.cc"
+#include "snapshot.cc"
 #ifndef NOSDL
 #include "display.cc"
 #endif
@@ -60,6 +61,16 @@ class blasts {
 		void draw_blasts(const coordinate base, Display & target, 
 				coordinate arena_size) const;
 #endif
+		// The circles that draw_blasts would draw, as center and
+		// radius in the same normalized coordinates.
+		void get_extents(const coordinate base, coordinate arena_size,
+				vector<pair<coordinate, double> > & extents)
+			const;
+
+		// Colors aren't saved; they're set up at the start and
+		// don't change.
+		void save_state(snapshot_writer & out) const;
+		void load_state(snapshot_reader & in);
 };
 
 // Draws an explosion/impact effect. The effect starts with a circle at radius
@@ -161,4 +172,59 @@ void blasts::draw_blasts(const coordinate base, Display & target,
 		draw_blast(base, target, pos, arena_size);
 }
 #endif
+
+void blasts::get_extents(const coordinate base, coordinate arena_size,
+		vector<pair<coordinate, double> > & extents) const {
+
+	extents.clear();
+
+	for (list<blast>::const_iterator pos = ongoing_explosions.begin();
+			pos != ongoing_explosions.end(); ++pos) {
+		double animprogress = (present_time - pos->start_time) /
+			(pos->maxtime - pos->start_time);
+		if (animprogress > 1) continue;
+
+		extents.push_back(pair<coordinate, double>((base +
+					pos->impact_point) / arena_size,
+				pos->maxradius / (double)arena_size.y *
+				animprogress));
+	}
+}
+
+void blasts::save_state(snapshot_writer & out) const {
+	out.put_time(present_time, -1);
+	out.put_double(duration);
+	out.put_uint(ongoing_explosions.size());
+
+	for (list<blast>::const_iterator pos = ongoing_explosions.begin();
+			pos != ongoing_explosions.end(); ++pos) {
+		out.put_coordinate(pos->impact_point);
+		out.put_int(pos->kind);
+		out.put_double(pos->maxradius);
+		out.put_time(pos->start_time, -1);
+		out.put_double(pos->maxtime);
+	}
+}
+
+void blasts::load_state(snapshot_reader & in) {
+	present_time = in.get_time(-1);
+	duration = in.get_double();
+
+	ongoing_explosions.clear();
+	uint32_t num_blasts = in.get_uint();
+
+	for (uint32_t counter = 0; counter < num_blasts && in.ok(); ++counter) {
+		blast next;
+		next.impact_point = in.get_coordinate();
+		next.kind = (blast_type)in.get_int();
+		next.maxradius = in.get_double();
+		next.start_time = in.get_time(-1);
+		next.maxtime = in.get_double();
+
+		if (next.kind < 0 || next.kind >= B_ALL)
+			in.fail();
+		else	ongoing_explosions.push_back(next);
+	}
+}
+
 #endif
@@ -10,6 +10,7 @@
 #include "missile.cc"
 #include "robot.cc"
 #include "blast.cc"
+#include "splash.cc"
 #include <assert.h>
 #include <vector>
 #include <list>
@@ -85,7 +86,7 @@ class collider {
 		// The function updates the arrays "crashes" (true if there was
 		// a crash) and time_units. It does not actually move any of
 		// the units (so we can do missile checks on the track?).
-		void set_track_limits(list<robot *> & robots, 
+		void set_track_limits(vector<robot *> & robots, 
 				int robot_radius, int crash_range, 
 				const coordinate arena_size) const;
 
@@ -98,18 +99,29 @@ class collider {
 		// The reason we can't just have get_missile_crashes is that
 		// we have to reconcile crashes since missiles detonate
 		// immediately upon hitting.
+		// Splash damage is dealt to those splash finds in range,
+		// which should have been set up by index_robots.
 		void handle_missile_crashes(vector<robot> & all_robots,
-				list<robot *> & live_robots, 
+				vector<robot *> & live_robots, 
 				double full_timespan, list<missile> & missiles,
 				int max_hit_radius, const coordinate arena_size,
 				double absolute_time_at_start, blasts &
-				explosions) const;
+				explosions, const splash_grid & splash) const;
 
 		// This does the same, but with mines.
 		void handle_mine_crashes(vector<robot> & all_robots,
-				list<robot *> & live_robots, 
+				vector<robot *> & live_robots, 
 				double full_timespan, list<mine> & mines, 
-				blasts & explosions) const;
+				blasts & explosions,
+				const splash_grid & splash) const;
+
+		// Puts the live robots in the splash grid where they are now,
+		// with enough slack to cover wherever they may go in the next
+		// timespan.
+		void index_robots(const vector<robot> & all_robots,
+				const vector<robot *> & live_robots,
+				double timespan, const coordinate arena_size,
+				splash_grid & splash) const;
 };
 
 double collider::get_closest_approach(const Unit * a, const Unit * b, 
@@ -613,7 +625,7 @@ double collider::determine_edge_crash_point(const double accuracy, Unit * a,
 //  q < t, then r0 will stop still), but I haven't found any quick algorithm
 // (below n^3 log n) to handle this robustly. It shouldn't make a difference
 // for the kind of time slices we're dealing with, but beware.
-void collider::set_track_limits(list<robot *> & robots, int robot_radius, 
+void collider::set_track_limits(vector<robot *> & robots, int robot_radius, 
 		int crash_range, const coordinate arena_size) const {
 
 	// Accuracy of the root-finder.
@@ -633,7 +645,7 @@ void collider::set_track_limits(list<robot *> & robots, int robot_radius,
 	int counter;
 
 	//cout << "--- Beginning " << endl;
-	list<robot *>::iterator p_outer, p_inner;
+	vector<robot *>::iterator p_outer;
 
 	counter = 0;
 
@@ -724,11 +736,28 @@ void collider::set_track_limits(list<robot *> & robots, int robot_radius,
 	// Then narrow down based on unit-unit collisions. 0.5n^2.
 	// Since crashes are symmetric (if a crashes into b, b crashes into a),
 	// we don't need to check b vs a if we've already tested a vs b.
-	robot * outerptr;
 
-	for (p_outer = robots.begin(); p_outer != robots.end(); ++p_outer) {
+	// Nearly all pairs are thrown out by the early check below, so the
+	// check is done on plain arrays of where each robot is and how far
+	// it can go, instead of going through every robot each time. Reach
+	// depends on time units, so it's updated whenever those are.
+	size_t num_robots = robots.size(), outer_idx, inner_idx;
+	vector<double> xs(num_robots), ys(num_robots), speeds(num_robots),
+		reaches(num_robots);
+
+	for (outer_idx = 0; outer_idx < num_robots; ++outer_idx) {
+		coordinate pos = robots[outer_idx]->get_pos();
+		xs[outer_idx] = pos.x;
+		ys[outer_idx] = pos.y;
+		speeds[outer_idx] = robots[outer_idx]->
+			get_worst_case_abs_speed();
+		reaches[outer_idx] = speeds[outer_idx] * 
+			robots[outer_idx]->time_units();
+	}
+
+	for (outer_idx = 0; outer_idx < num_robots; ++outer_idx) {
 
-		outer = *p_outer;
+		outer = robots[outer_idx];
 
 		//if (outer->dead()) 
 		//	continue;
@@ -738,6 +767,7 @@ void collider::set_track_limits(list<robot *> & robots, int robot_radius,
 
 		double potential_crash_time = 1e100; // Suitably large number
 		robot * crashed_with = NULL;
+		size_t crashed_idx = 0;
 
 		// Early check to remove those that definitely can't crash.
 		// Bluesky here would be to adjust the cache based on expected
@@ -746,25 +776,17 @@ void collider::set_track_limits(list<robot *> & robots, int robot_radius,
 		// Perhaps even better would be a grid-based structure for
 		// automatic pruning, but there will have to be a lot of 
 		// missiles flying before it's worth it.
-		double outer_reach = outer->get_worst_case_abs_speed() *
-			outer->time_units();
-
-		// Ugly stub.
-		p_inner = p_outer;
-		++p_inner;
-
-		for (; p_inner != robots.end(); ++p_inner) {
-			robot * inner = *p_inner; // ditto
-
-			//if (inner->dead()) 
-			//	continue;
-			
-			double inner_reach = inner->get_worst_case_abs_speed() 
-				* inner->time_units();
+		double outer_reach = reaches[outer_idx],
+		       outer_x = xs[outer_idx], outer_y = ys[outer_idx];
+
+		for (inner_idx = outer_idx + 1; inner_idx < num_robots; 
+				++inner_idx) {
+			if (euc_distance(xs[inner_idx], ys[inner_idx], outer_x,
+						outer_y) - (reaches[inner_idx] +
+						outer_reach) > squared_range)
+				continue;
 
-			if (inner->get_pos().distance(outer->get_pos()) -
-					(inner_reach + outer_reach) > 
-					squared_range) continue;
+			robot * inner = robots[inner_idx];
 
 			//cout << "Now to check in detail." << endl;
 			// Determine time unit of crash, if any.
@@ -781,6 +803,7 @@ void collider::set_track_limits(list<robot *> & robots, int robot_radius,
 			if (crash_at >= 0 && crash_at < potential_crash_time) {
 				// Yes, update the time unit limitations
 				crashed_with = inner;
+				crashed_idx = inner_idx;
 				potential_crash_time = crash_at - safety_deg;
 			}
 
@@ -848,6 +871,11 @@ void collider::set_track_limits(list<robot *> & robots, int robot_radius,
 				outer->set_crash_target_vel(crashed_with->
 						get_throttle());
 			}
+
+			reaches[outer_idx] = speeds[outer_idx] * 
+				outer->time_units();
+			reaches[crashed_idx] = speeds[crashed_idx] *
+				crashed_with->time_units();
 		}
 	}
 	
@@ -862,10 +890,10 @@ void collider::set_track_limits(list<robot *> & robots, int robot_radius,
 // a list of all robots (for the missile to check which pass within the range),
 // which would be messy.
 void collider::handle_missile_crashes(vector<robot> & all_robots,
-		list<robot *> & live_robots, double full_timespan, 
+		vector<robot *> & live_robots, double full_timespan, 
 		list<missile> & missiles, int max_hit_radius, 
 		const coordinate arena_size, double absolute_time_at_start, 
-		blasts & explosions) const {
+		blasts & explosions, const splash_grid & splash) const {
 
 	const double accuracy = 1e-3; // Root-finder accuracy
 
@@ -908,10 +936,9 @@ void collider::handle_missile_crashes(vector<robot> & all_robots,
 	//cout << "MIS: --- missiles ---" << endl;
 	//cout << "MIS: --- missiles ---" << endl;
 
-	list<coordinate> explosion_points;
 	list<missile>::iterator cur;
-	list<robot *>::iterator xrobocur;
-	vector<robot>::iterator all_robot_cur;
+	vector<robot *>::iterator xrobocur;
+	vector<int> in_range;
 
 	for (cur = missiles.begin(); cur != missiles.end(); ++cur) {
 		//cout << "MIS/A: Dealing with missile at " << cur->get_pos().x << ", " << cur->get_pos().y << endl;
@@ -1026,37 +1053,33 @@ void collider::handle_missile_crashes(vector<robot> & all_robots,
 
 		// DONE: Master vector here - credit damage even if the
 		// inflicting robot is dead.
-		for (vector<robot>::iterator mrobocur = all_robots.begin(); 
-				mrobocur != all_robots.end(); ++mrobocur)
-			if (mrobocur->get_UID() == cur->get_shooter())
-				originator = &*mrobocur;
+		int originator_idx = splash.find_UID(cur->get_shooter());
+		if (originator_idx != -1)
+			originator = &all_robots[originator_idx];
 
 		// The splash damage can affect all robots (except the dead 
-		// ones), so iterate through them.
-		for (xrobocur = live_robots.begin(); xrobocur != 
-				live_robots.end(); ++xrobocur) {
+		// ones) in range, so iterate through them.
+		splash.find_in_range(exp_point, max_hit_radius, in_range);
 
-			// No need to check for alive, since dead robots
-			// would have tripped the assert above.
-			//if ((*xrobocur)->dead()) continue;
+		for (size_t counter = 0; counter < in_range.size(); ++counter) {
+			robot & victim = all_robots[in_range[counter]];
 
 			// Because this happens so rarely, we'll use
 			// real distances.
-			coordinate robot_at_time = (*xrobocur)->get_pos_at(
-					t_deton);
+			coordinate robot_at_time = victim.get_pos_at(t_deton);
 
 			// Register a blast done by the shooter at the
 			// position of the missile impact.
 			int origin = cur->get_shooter();
 
-			double damage = (*xrobocur)->register_blast(
+			double damage = victim.register_blast(
 					exp_point.distance(robot_at_time), 
 					multiplier, max_hit_radius, origin);
 
 			// Credit the damage if we know who did it.
 			if (originator != NULL)
-				originator->record_damage_to_others(
-						**xrobocur, damage);
+				originator->record_damage_to_others(victim,
+						damage);
 		}
 
 		cur = missiles.erase(cur); // And the missile's gone.
@@ -1090,8 +1113,9 @@ void collider::handle_missile_crashes(vector<robot> & all_robots,
 // can't register damage and doesn't have an UID. Maybe refactor this somehow,
 // in the future.
 void collider::handle_mine_crashes(vector<robot> & all_robots, 
-		list<robot *> & live_robots, double full_timespan,
-		list<mine> & mines, blasts & explosions) const {
+		vector<robot *> & live_robots, double full_timespan,
+		list<mine> & mines, blasts & explosions,
+		const splash_grid & splash) const {
 
 	// Root-finder accuracy
 	const double accuracy = 1e-3;
@@ -1107,7 +1131,8 @@ void collider::handle_mine_crashes(vector<robot> & all_robots,
 	// Next
 	
 	list<mine>::iterator cur;
-	list<robot *>::iterator robot_xcur;
+	vector<robot *>::iterator robot_xcur;
+	vector<int> in_range;
 
 	// Assumes all robots are equally large.
 	int robot_squared_dist = square((*live_robots.begin())->get_radius());
@@ -1181,13 +1206,8 @@ void collider::handle_mine_crashes(vector<robot> & all_robots,
 		// No point in doing this check if we didn't explode.
 		if (target != NULL) {
 			if (originator == NULL)
-				for (vector<robot>::iterator mrobot_cur = 
-						all_robots.begin(); 
-						mrobot_cur != all_robots.end();
-						++mrobot_cur)
-					if (cur->layer_UID() == mrobot_cur->
-							get_UID())
-						originator = &*mrobot_cur;
+				originator = &all_robots[splash.find_UID(
+						cur->layer_UID())];
 
 			originator->record_bot_mine_hurt(target);
 			// This hasn't happened yet, but will happen in the
@@ -1224,19 +1244,18 @@ void collider::handle_mine_crashes(vector<robot> & all_robots,
 		// Should this be const radius?
 		explosions.add_blast(ground_zero, B_MINE, mine_blast_radius);
 
-		for (robot_xcur = live_robots.begin(); robot_xcur != 
-				live_robots.end(); ++robot_xcur) {
-			// Dead bots tell of no damage.
-			//if ((*robot_xcur)->dead()) continue;
+		splash.find_in_range(ground_zero, mine_blast_radius, in_range);
 
-			coordinate robot_at_time = (*robot_xcur)->get_pos_at(
-					t_deton);
+		for (size_t counter = 0; counter < in_range.size(); ++counter) {
+			robot & victim = all_robots[in_range[counter]];
+
+			coordinate robot_at_time = victim.get_pos_at(t_deton);
 
 			// ATR2 constant ahead! The 35 means 35 points of damage
 			// at ground zero, 1 point of damage 35 m out.
 			// Yet again, the ordnance's ID is negative of that
 			// of the one who dispensed it.
-			(*robot_xcur)->register_blast(ground_zero.distance(
+			victim.register_blast(ground_zero.distance(
 						robot_at_time), 1,
 					mine_blast_radius, cur->layer_UID());
 		}
@@ -1245,3 +1264,27 @@ void collider::handle_mine_crashes(vector<robot> & all_robots,
 		cur = mines.erase(cur);
 	}
 }
+
+void collider::index_robots(const vector<robot> & all_robots,
+		const vector<robot *> & live_robots, double timespan,
+		const coordinate arena_size, splash_grid & splash) const {
+
+	// The robots can't go any faster than their throttle or desired
+	// throttle (whichever is greater in magnitude) allows in that time.
+	// The extra meter is to be safe from rounding.
+	double slack = 0;
+	vector<robot *>::const_iterator pos;
+
+	for (pos = live_robots.begin(); pos != live_robots.end(); ++pos) {
+		double max_throttle = max(fabs((*pos)->get_throttle()),
+				fabs((*pos)->get_desired_throttle()));
+		slack = max(slack, max_throttle * (*pos)->
+				get_speed_multiplier() * (*pos)->
+				get_speed_bonus() * timespan);
+	}
+
+	splash.reset(arena_size, slack + 1);
+
+	for (pos = live_robots.begin(); pos != live_robots.end(); ++pos)
+		splash.add(*pos - &all_robots[0], (*pos)->get_pos());
+}
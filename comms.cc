@@ -1,6 +1,7 @@
 #ifndef _KROB_COMMS
 #define _KROB_COMMS
 
+#include "snapshot.cc"
 #include <vector>
 #include <assert.h>
 #include <math.h>
@@ -37,6 +38,11 @@ class comms {
 		void add(short to_add);
 		void null(); // Empty queue by setting # read to # recvd.
 
+		// The queue size isn't changed by loading; the stored queue
+		// must be of the same size.
+		void save_state(snapshot_writer & out) const;
+		void load_state(snapshot_reader & in);
+
 };
 
 comms::comms(unsigned int n_in) {
@@ -97,4 +103,23 @@ void comms::null() {
 	messages_read = messages_received;
 }
 
+void comms::save_state(snapshot_writer & out) const {
+	out.put_shorts(data);
+	// The counters keep going up, but all that matters is how far
+	// apart they are and where they are in the queue.
+	if (out.comparing()) {
+		out.put_uint(messages_received - messages_read);
+		out.put_uint(messages_read & (n-1));
+	} else {
+		out.put_uint(messages_received);
+		out.put_uint(messages_read);
+	}
+}
+
+void comms::load_state(snapshot_reader & in) {
+	in.get_shorts(data);
+	messages_received = in.get_uint();
+	messages_read = in.get_uint();
+}
+
 #endif
@@ -0,0 +1,137 @@
+// Which robots listen to which communications channel, so that a
+// transmission can be delivered without looking at every robot.
+
+// There are 65536 channels, but at most one in use per robot, so the channels
+// in use are kept in a small open-addressed hash table instead of one slot
+// per channel. Each channel has a list of its robots, sorted by address so
+// that they receive transmissions in the order they're in the robot vector,
+// as they always have. A channel that's emptied keeps its slot (robots tend
+// to come back to the same channels); the slots are only reclaimed when the
+// table is grown or cleared.
+
+#ifndef _KROB_COMMS_REGISTRY
+#define _KROB_COMMS_REGISTRY
+
+#include <algorithm>
+#include <vector>
+
+using namespace std;
+
+class robot;
+
+class comms_registry {
+	private:
+		vector<int> channels;			// -1 if free
+		vector<vector<robot *> > listeners;	// By slot
+		vector<int> used_slots;
+		vector<robot *> nobody;
+
+		int find_slot(int channel) const;
+		void grow();
+
+	public:
+		comms_registry();
+
+		void subscribe(int channel, robot * listener);
+		void unsubscribe(int channel, robot * listener);
+		const vector<robot *> & get_listeners(int channel) const;
+
+		// Empties the table; takes time proportional to the number
+		// of channels in use.
+		void clear();
+};
+
+comms_registry::comms_registry() {
+	channels.resize(16, -1);
+	listeners.resize(16);
+}
+
+// Returns the slot with this channel, or the free slot where it would go.
+int comms_registry::find_slot(int channel) const {
+	int mask = channels.size() - 1;
+	int slot = (channel * 40503) & mask;
+
+	while (channels[slot] != -1 && channels[slot] != channel)
+		slot = (slot + 1) & mask;
+
+	return(slot);
+}
+
+void comms_registry::grow() {
+	vector<int> old_channels;
+	vector<vector<robot *> > old_listeners;
+	old_channels.swap(channels);
+	old_listeners.swap(listeners);
+
+	// Leave the empty channels behind while we're at it.
+	int in_use = 0;
+	for (size_t counter = 0; counter < used_slots.size(); ++counter)
+		if (!old_listeners[used_slots[counter]].empty()) ++in_use;
+
+	size_t new_size = old_channels.size();
+	while (new_size < (size_t)in_use * 4) new_size *= 2;
+
+	channels.resize(new_size, -1);
+	listeners.resize(new_size);
+
+	vector<int> old_used;
+	old_used.swap(used_slots);
+
+	for (size_t counter = 0; counter < old_used.size(); ++counter) {
+		int old_slot = old_used[counter];
+		if (old_listeners[old_slot].empty()) continue;
+
+		int slot = find_slot(old_channels[old_slot]);
+		channels[slot] = old_channels[old_slot];
+		listeners[slot].swap(old_listeners[old_slot]);
+		used_slots.push_back(slot);
+	}
+}
+
+void comms_registry::subscribe(int channel, robot * listener) {
+	int slot = find_slot(channel);
+
+	if (channels[slot] == -1) {
+		// Keep at least half of the table free so searches end
+		// quickly.
+		if ((used_slots.size() + 1) * 2 > channels.size()) {
+			grow();
+			slot = find_slot(channel);
+		}
+		channels[slot] = channel;
+		used_slots.push_back(slot);
+	}
+
+	vector<robot *> & here = listeners[slot];
+	vector<robot *>::iterator pos = lower_bound(here.begin(), here.end(),
+			listener);
+	if (pos == here.end() || *pos != listener)
+		here.insert(pos, listener);
+}
+
+void comms_registry::unsubscribe(int channel, robot * listener) {
+	int slot = find_slot(channel);
+	if (channels[slot] == -1) return;
+
+	vector<robot *> & here = listeners[slot];
+	vector<robot *>::iterator pos = lower_bound(here.begin(), here.end(),
+			listener);
+	if (pos != here.end() && *pos == listener)
+		here.erase(pos);
+}
+
+const vector<robot *> & comms_registry::get_listeners(int channel) const {
+	int slot = find_slot(channel);
+	if (channels[slot] == -1) return(nobody);
+	return(listeners[slot]);
+}
+
+void comms_registry::clear() {
+	for (size_t counter = 0; counter < used_slots.size(); ++counter) {
+		channels[used_slots[counter]] = -1;
+		listeners[used_slots[counter]].clear();
+	}
+	used_slots.clear();
+}
+
+#endif
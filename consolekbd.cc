@@ -1,7 +1,16 @@
+#ifndef _KROB_CONSOLEKBD
+#define _KROB_CONSOLEKBD
+
 #include <stdio.h>
 #include <termios.h>
 #include <unistd.h>
 
+// Input that isn't a keypress, from the graphics window (see handler.cc).
+// Keypresses are given as their character.
+const int KEY_NONE = -1;	// Nothing more has happened.
+const int KEY_RESIZED = -2;	// The window was resized.
+const int KEY_CLOSED = -3;	// The window was closed.
+
 class ConsoleKeyboard {
 
 	public:
@@ -45,3 +54,5 @@ int ConsoleKeyboard::getchar() {
 		return(line[0]);
 	else	return(-1);
 }
+
+#endif
@@ -7,9 +7,21 @@
 #include <vector>
 #include <list>
 #include <assert.h>
+#include <stdint.h>
 
 using namespace std;
 
+// One instruction in the trace. Registers are as they were after it ran, and
+// penalty is how many cycles it cost.
+typedef struct trace_entry {
+	uint64_t instruction;	// instructions_run when it ran
+	int IP;
+	short a_direct, b_direct;
+	bool decoded;		// False if it failed before resolving these
+	short registers[REG_SP - REG_FLAGS + 1];
+	int penalty;
+};
+
 class corelogic {
 
 	private:
@@ -18,7 +30,23 @@ class corelogic {
 		vector<short> pseudo_stack, memory;
 		vector<int> numeric_jump_table, alnum_jump_table;
 
+		// Instructions executed so far, over all rounds. Only for
+		// measuring speed, so it isn't part of the saved state.
+		uint64_t instructions_run;
+
+		// Whether to time execute_multiple for the robot's stats.
+		bool timing;
+
+		// The last few instructions run, for finding out what a
+		// robot was doing when it went wrong. Like the above, it
+		// isn't part of the saved state. It's a ring: trace_count is
+		// how many have been written this round, and the slot is
+		// that modulo the length. Empty if not tracing.
+		vector<trace_entry> trace;
+		uint64_t trace_count;
+
 		void postinit_CPU(CPU & target, const vector<code_line> & prog);
+		void record_trace();
 
 	public:
 		corelogic(int stack_size, int memory_size, int permitted_jumps);
@@ -32,16 +60,16 @@ class corelogic {
 				vector<int> & numeric_jumps, vector<int> &
 				alnum_jumps);
 		bool execute_one(robot & shell,
-				const list<Unit *> & active_robots,
+				const vector<Unit *> & active_robots,
 				list<missile> & missiles, list<mine> & mines,
-				vector<set<robot *> > & comms_lookup,
+				comms_registry & comms_lookup,
 				const int matchnum, const int total_matches, 
 				const coordinate arena_size, 
 				run_error & error_out);
 		bool execute_multiple(const int how_many, robot & shell, 
-				const list<Unit *> & active_robots,
+				const vector<Unit *> & active_robots,
 				list<missile> & missiles, list<mine> & mines,
-				vector<set<robot *> > & comms_lookup,
+				comms_registry & comms_lookup,
 				const int matchnum, const int total_matches,
 				const coordinate arena_size, bool ignore_errors,
 				run_error & last_error, int & cycles_left);
@@ -53,10 +81,32 @@ class corelogic {
 		code_line get_instr_at_IP() const;
 		code_line get_instr_at_oldIP() const;
 
+		uint64_t get_instructions_run() const { return(
+				instructions_run); }
+
+		// Timing costs a bit, so it's off unless asked for.
+		void set_timing(bool time_CPU) { timing = time_CPU; }
+
+		// So does tracing. 0 turns it off.
+		void set_trace_length(int length);
+		// The instructions traced this round, oldest first, up to
+		// and including the given instruction (by instructions_run).
+		vector<trace_entry> get_trace(uint64_t up_to) const;
+
+		// True if the program can't do anything during its CPU slice
+		// that another robot could notice during its own slice.
+		bool parallel_safe() const;
+
 		// So we don't have to reinit the jump tables every time we
 		// have a new round, as that kind of memory copy takes time.
 		void reset_CPU();
 		void reset_core(bool reset_memory);
+
+		// Save and restore the running state: registers, memory and
+		// stack. The program itself isn't saved, so the core must
+		// have been loaded from the same source beforehand.
+		void save_state(snapshot_writer & out) const;
+		void load_state(snapshot_reader & in);
 };
 
 // Caching and other just-before-launch setup events go here.
@@ -75,6 +125,9 @@ corelogic::corelogic(int stack_size, int memory_size, vector<code_line> &
 	program = prog_to_load;
 	numeric_jump_table = numeric_jumps;
 	alnum_jump_table = alnum_jumps;
+	instructions_run = 0;
+	timing = false;
+	trace_count = 0;
 	postinit_CPU(execution_unit, program);
 }
 
@@ -87,6 +140,10 @@ corelogic::corelogic(const corelogic & input) {
 	execution_unit.cache_consistency(program);
 	numeric_jump_table = input.numeric_jump_table;
 	alnum_jump_table = input.alnum_jump_table;
+	instructions_run = input.instructions_run;
+	timing = input.timing;
+	trace = input.trace;
+	trace_count = input.trace_count;
 }
 
 const corelogic & corelogic::operator=(const corelogic & input) {
@@ -98,6 +155,10 @@ const corelogic & corelogic::operator=(const corelogic & input) {
 	execution_unit.cache_consistency(program);
 	numeric_jump_table = input.numeric_jump_table;
 	alnum_jump_table = input.alnum_jump_table;
+	instructions_run = input.instructions_run;
+	timing = input.timing;
+	trace = input.trace;
+	trace_count = input.trace_count;
 }
 
 // Shell is the robot this CPU manipulates. Active_robots is the list of active
@@ -106,8 +167,8 @@ const corelogic & corelogic::operator=(const corelogic & input) {
 // Comms_lookup is used for transmitting messages and changing comms channels,
 // and the ints are for the "poor man's p-space".
 bool corelogic::execute_one(robot & shell,
-		const list<Unit *> & active_robots, list<missile> & missiles,
-		list<mine> & mines, vector<set<robot *> > & comms_lookup,
+		const vector<Unit *> & active_robots, list<missile> & missiles,
+		list<mine> & mines, comms_registry & comms_lookup,
 		const int matchnum, const int total_matches, 
 		const coordinate arena_size, run_error & error_out) {
 
@@ -116,14 +177,67 @@ bool corelogic::execute_one(robot & shell,
 		return(false);
 	}
 
+	++instructions_run;
+
+	// If there's a penalty left, the CPU just counts it down.
+	bool traced = !trace.empty() && execution_unit.get_penalty() == 0;
+
 	// Calling this takes a lot of time, for some reason.
-	return(execution_unit.execute(program, memory, pseudo_stack, 
+	bool success = execution_unit.execute(program, memory, pseudo_stack,
 			numeric_jump_table, alnum_jump_table, shell,
 			active_robots, missiles, mines, comms_lookup,
-			matchnum, total_matches, arena_size, error_out));
+			matchnum, total_matches, arena_size, error_out);
+
+	if (traced) record_trace();
+
+	return(success);
+}
+
+void corelogic::record_trace() {
+	int IP = execution_unit.get_oldip();
+
+	// Labels aren't really run.
+	const field_entry & opcode = program[IP].get_opcode();
+	if (opcode.modifier.is_n_jump || opcode.modifier.is_a_jump)
+		return;
+
+	trace_entry & entry = trace[trace_count++ % trace.size()];
+
+	entry.instruction = instructions_run;
+	entry.IP = IP;
+	entry.decoded = execution_unit.get_last_operands(entry.a_direct,
+			entry.b_direct);
+	for (int reg = REG_FLAGS; reg <= REG_SP; ++reg)
+		entry.registers[reg - REG_FLAGS] = memory[reg];
+	entry.penalty = execution_unit.get_penalty();
 }
 
-// Here we run multiple instructions on the CPU. If ignore_errors is true,
+void corelogic::set_trace_length(int length) {
+	assert(length >= 0);
+	// The registers are in memory.
+	assert(length == 0 || memory.size() > REG_SP);
+
+	trace.resize(length);
+	trace_count = 0;
+}
+
+vector<trace_entry> corelogic::get_trace(uint64_t up_to) const {
+	vector<trace_entry> out;
+
+	uint64_t first = 0;
+	if (trace_count > trace.size()) first = trace_count - trace.size();
+
+	for (uint64_t pos = first; pos < trace_count; ++pos) {
+		const trace_entry & entry = trace[pos % trace.size()];
+		if (entry.instruction <= up_to)
+			out.push_back(entry);
+	}
+
+	return(out);
+}
+
+// Here we run multiple instructions on the CPU. What this costs us is added
+// to the robot's stats. If ignore_errors is true,
 // we don't break on an error; if it's false, we do break on error (as ATR2
 // presumably does -- or rather, ATR2 pauses all execution when giving the
 // error). The return value is how many cycles we actually used, which only
@@ -133,14 +247,18 @@ bool corelogic::execute_one(robot & shell,
 // draw, and wait a while, then execute again.
 
 bool corelogic::execute_multiple(const int how_many, robot & shell,
-		const list<Unit *> & active_robots, list<missile> & missiles,
-		list<mine> & mines, vector<set<robot *> > & comms_lookup,
+		const vector<Unit *> & active_robots, list<missile> & missiles,
+		list<mine> & mines, comms_registry & comms_lookup,
 		const int matchnum, const int total_matches, 
 		const coordinate arena_size, bool ignore_errors, 
 		run_error & last_error, int & cycles_left) {
 
+	uint64_t instructions_before = instructions_run, start_ns = 0;
+	if (timing) start_ns = get_monotonic_ns();
+	bool success = true;
+
 	cycles_left = how_many;
-	while (cycles_left > 0) {
+	while (cycles_left > 0 && success) {
 
 		// Mop up penalties
 		cycles_left -= execution_unit.withdraw_penalty(cycles_left);
@@ -150,18 +268,21 @@ bool corelogic::execute_multiple(const int how_many, robot & shell,
 						comms_lookup, matchnum, 
 						total_matches, arena_size,
 						last_error) && !ignore_errors)
-				return(false);
+				success = false;
 
 		// Check that we haven't gone to overheating, which shuts
 		// down the CPU completely. (BLUESKY: Retain the instructions
 		// so that they can be used when it comes out of "stasis". But
 		// it's not clear whether this is the right thing to do.)
-		if (!shell.is_CPU_working() || shell.dead())
+		if (success && (!shell.is_CPU_working() || shell.dead()))
 			cycles_left = 0;
 
 	}
 
-	return(true);
+	shell.record_CPU_cost(instructions_run - instructions_before,
+			timing ? get_monotonic_ns() - start_ns : 0);
+
+	return(success);
 }
 
 code_line corelogic::get_instruction(const int pos) const {
@@ -178,8 +299,46 @@ code_line corelogic::get_instr_at_oldIP() const {
 	return(get_instruction(get_old_IP()));
 }
 
+// Within a cycle, a robot affects others through missiles, mines,
+// transmissions, its transponder ID (which others' scans report), and its
+// comms channel (after joining someone else's channel, it'll hear what they
+// say, and vice versa). The first three can be held back until the cycle is
+// over, but the last two can't, so a program that may write to either port
+// can't run in parallel with the others. We don't know where computed ports
+// or opcodes end up, so those count as unsafe too.
+bool corelogic::parallel_safe() const {
+
+	for (vector<code_line>::const_iterator pos = program.begin(); pos != 
+			program.end(); ++pos) {
+		field_entry opcode = pos->get_opcode(), port = 
+			pos->get_a_field();
+
+		// Labels are never executed.
+		if (opcode.modifier.is_n_jump || opcode.modifier.is_a_jump)
+			continue;
+
+		if (opcode.modifier.is_indirect_one || 
+				opcode.modifier.is_indirect_two)
+			return(false);
+
+		if (opcode.value != CMD_OPO) continue;
+
+		if (port.modifier.is_indirect_one || 
+				port.modifier.is_indirect_two ||
+				port.modifier.is_n_jump || 
+				port.modifier.is_a_jump)
+			return(false);
+
+		if (port.value == P_TRANSPONDER || port.value == P_CHANNEL)
+			return(false);
+	}
+
+	return(true);
+}
+
 void corelogic::reset_CPU() {
 	execution_unit = (CPU());
+	trace_count = 0;
 	// Redo caching
 	postinit_CPU(execution_unit, program);
 }
@@ -199,4 +358,22 @@ void corelogic::reset_core(bool reset_memory) {
 	}
 }
 
+void corelogic::save_state(snapshot_writer & out) const {
+	execution_unit.save_state(out);
+	out.put_shorts(memory);
+	out.put_shorts(pseudo_stack);
+}
+
+void corelogic::load_state(snapshot_reader & in) {
+	execution_unit.load_state(in);
+	in.get_shorts(memory);
+	in.get_shorts(pseudo_stack);
+
+	// The IP must point inside the program, or execute would read
+	// outside it.
+	if (execution_unit.get_ip() < 0 || execution_unit.get_ip() >=
+			(int)program.size())
+		in.fail();
+}
+
 #endif
@@ -14,6 +14,7 @@
 #include "../tools.cc"
 #include "../robot.cc"
 #include "../random.cc"
+#include "../snapshot.cc"
 
 #include <vector>
 #include <assert.h>
@@ -39,6 +40,12 @@ class CPU {
 		int oldip; // For returns that fail. Otherwise -1.
 		int penalty;	// cycle penalty
 		int micropenalty;	// to avoid infinite loops
+
+		// The a- and b-field values the last instruction ran with,
+		// for the instruction trace. Not known if it failed before
+		// getting that far.
+		short last_a_direct, last_b_direct;
+		bool last_decoded;
 	
 		void set_ip(int new_ip, int prog_size);
 		void set_literal_penalty(int new_penalty);
@@ -78,19 +85,19 @@ class CPU {
 				const robot & sensor_info) const;
 
 		int read_hardware(int port_number, robot & hardware_package,
-				const list<Unit *> & other_robots, run_error
+				const vector<Unit *> & other_robots, run_error
 				& error_out) const;
 
 		run_error write_to_hardware(const int port_number, 
 				const int parameter, robot & hardware_package,
-				const list<Unit *> & other_robots,
+				const vector<Unit *> & other_robots,
 				list<missile> & missiles, list<mine> & mines,
-				vector<set<robot *> > & comms_lookup);
+				comms_registry & comms_lookup);
 
 		run_error interrupt(int interrupt_number, robot & actor,
 				vector<short> & memory, 
-				const list<Unit *> & active_robots,
-				vector<set<robot *> > & comms_lookup,
+				const vector<Unit *> & active_robots,
+				comms_registry & comms_lookup,
 				const int game_clock, const int matchnum, 
 				const int total_matches, const int prog_size,
 				const coordinate arena_size);
@@ -110,10 +117,10 @@ class CPU {
 				vector<int> & numeric_jump_table,
 				vector<int> & alnum_jump_table, 
 				robot & shell,
-				const list<Unit *> & active_robots, 
+				const vector<Unit *> & active_robots, 
 				list<missile> & missiles,
 				list<mine> & mines, 
-				vector<set<robot *> > & comms_lookup,
+				comms_registry & comms_lookup,
 				const int matchnum, const int total_matches,
 				const coordinate arena_size,
 				run_error & error_out);
@@ -140,14 +147,47 @@ class CPU {
 		int get_ip() const { return(ip); }
 		int get_oldip() const { return(oldip); }
 
+		bool get_last_operands(short & a_direct, short & b_direct)
+			const;
+
+		// Only the registers are saved; the consistency cache
+		// depends on the program alone.
+		void save_state(snapshot_writer & out) const;
+		void load_state(snapshot_reader & in);
 };
 
+void CPU::save_state(snapshot_writer & out) const {
+	out.put_int(ip);
+	out.put_int(oldip);
+	out.put_int(penalty);
+	out.put_int(micropenalty);
+}
+
+void CPU::load_state(snapshot_reader & in) {
+	ip = in.get_int();
+	oldip = in.get_int();
+	penalty = in.get_int();
+	micropenalty = in.get_int();
+}
+
 CPU::CPU() {
 	ip = 0;
+	oldip = -1;
 	penalty = 0;
 	micropenalty = 0;
 	cached = false;
 	all_consistent = false;
+	last_a_direct = 0;
+	last_b_direct = 0;
+	last_decoded = false;
+}
+
+// Returns false if the last instruction didn't get as far as resolving its
+// fields.
+bool CPU::get_last_operands(short & a_direct, short & b_direct) const {
+	a_direct = last_a_direct;
+	b_direct = last_b_direct;
+	return(last_decoded);
 }
 
 void CPU::set_ip(int new_ip, int prog_size) {
@@ -474,7 +514,8 @@ int CPU::access_memory(int location, const vector<short> & memory,
 		case 8: return(sensor_info.get_num_crashes());
 
 		// @9: Meters travelled. 15 bits used.
-		case 9: return((int)round(sensor_info.get_length_traveled())
+		case 9: sensor_info.note_counter_read();
+			return((int)round(sensor_info.get_length_traveled())
 						& 32767);
 
 		// Are these constants? Check later.
@@ -507,7 +548,7 @@ int CPU::access_memory(int location, const vector<short> & memory,
 // assume the latter here. (That is correct.)
 
 int CPU::read_hardware(int port_number, robot & hardware_package,
-		const list<Unit *> & other_robots, run_error & error) const {
+		const vector<Unit *> & other_robots, run_error & error) const {
 
 	error = ERR_NOERR;
 
@@ -571,9 +612,9 @@ int CPU::read_hardware(int port_number, robot & hardware_package,
 // Output port
 run_error CPU::write_to_hardware(const int port_number, const int parameter, 
 		robot & hardware_package,
-		const list<Unit *> & other_robots,
+		const vector<Unit *> & other_robots,
 		list<missile> & missiles, list<mine> & mines,
-		vector<set<robot *> > & comms_lookup) {
+		comms_registry & comms_lookup) {
 
 	// Do range checks on set throttle, set shutdown limit,
 	// etc.? ATR2 doesn't. Nah, because they aren't truly errors,
@@ -642,12 +683,8 @@ run_error CPU::write_to_hardware(const int port_number, const int parameter,
 			 else	 return(ERR_NOMINES);
 		// 23: Blow up all laid mines
 		// For each mine, if it's ours, blow it up.
-		case 23: { for(list<mine>::iterator p = mines.begin(); 
-					 p != mines.end(); ++p) 
-				 if (p->layer_UID() == hardware_package.
-						 get_UID())
-					 p->explode();
-			 return(ERR_NOERR); }
+		case 23: hardware_package.detonate_mines(mines);
+			 return(ERR_NOERR);
 		// 24: Turn shield on/off
 		case 24: if (hardware_package.get_shield_type() == 0)
 				 return(ERR_NOSHIELD);
@@ -661,8 +698,8 @@ run_error CPU::write_to_hardware(const int port_number, const int parameter,
 // Perhaps return error value here.
 
 run_error CPU::interrupt(int interrupt_number, robot & actor, 
-		vector<short> & memory, const list<Unit *> & active_robots,
-		vector<set<robot *> > & comms_lookup,
+		vector<short> & memory, const vector<Unit *> & active_robots,
+		comms_registry & comms_lookup,
 		const int game_clock, const int matchnum, 
 		const int total_matches, const int prog_size, 
 		const coordinate arena_size) {
@@ -698,7 +735,8 @@ run_error CPU::interrupt(int interrupt_number, robot & actor,
 		case 5: memory[REG_FX] = actor.get_ID();
 			return(ERR_NOERR);
 		// 6: Return game clock in EX:FX
-		case 6:	memory[REG_EX] = (short)(game_clock >> 16);
+		case 6:	actor.note_counter_read();
+			memory[REG_EX] = (short)(game_clock >> 16);
 			memory[REG_FX] = (short)game_clock;
 			return(ERR_NOERR);
 		// 7: Given EX,FX (x,y), angle (from ourselves) into AX
@@ -709,8 +747,8 @@ run_error CPU::interrupt(int interrupt_number, robot & actor,
 			destpos.x = min(arena_size.x - 1, max(0.0, destpos.x));
 			destpos.y = min(arena_size.y - 1, max(0.0, destpos.y));
 			
-			memory[REG_AX] = round(radian_to_hex(atan2(destpos.y,
-							destpos.x)));
+			memory[REG_AX] = round(radian_to_hex(phys_atan2(
+							destpos.y, destpos.x)));
 			return(ERR_NOERR);
 		// 8: Return transponder of last robot scanned (in FX)
 		// Perhaps return error if there's been no scanning?
@@ -744,7 +782,7 @@ run_error CPU::interrupt(int interrupt_number, robot & actor,
 		// DX: Absolute robot speed in cm/s (thus the factor of 100), 
 		// EX: cycles since last hurt,
 		// FX: cycles since last shot hit someone.
-		case 11: 
+		case 11: actor.note_counter_read();
 			 memory[REG_DX] = round(actor.get_absolute_speed() 
 					 * 100);
 			 memory[REG_EX] = round(actor.get_time() - 
@@ -835,8 +873,8 @@ void CPU::cache_consistency(const vector<code_line> & prog) {
 bool CPU::execute(const vector<code_line> & prog, vector<short> & memory,
 		vector<short> & robot_pstack, vector<int> & numeric_jump_table,
 		vector<int> & alnum_jump_table, robot & shell, 
-		const list<Unit *> & active_robots, list<missile> & missiles, 
-		list<mine> & mines, vector<set<robot *> > & comms_lookup,
+		const vector<Unit *> & active_robots, list<missile> & missiles, 
+		list<mine> & mines, comms_registry & comms_lookup,
 		const int matchnum, const int total_matches, const coordinate
 		arena_size, run_error & error_out) {
 
@@ -864,6 +902,7 @@ bool CPU::execute(const vector<code_line> & prog, vector<short> & memory,
 	
 	oldip = ip;
 	set_ip(oldip+1, prog_size);
+	last_decoded = false;
 
 	// HOTSPOT: Allocation takes too long time!
 	code_line our_line = prog[oldip];
@@ -1021,6 +1060,10 @@ bool CPU::execute(const vector<code_line> & prog, vector<short> & memory,
 	if (b_jump != -1)
 		b_field_direct = b_jump;
 
+	last_a_direct = a_field_direct;
+	last_b_direct = b_field_direct;
+	last_decoded = true;
+
 	// Update what we set as penalty to reflect the direct values we've now
 	// divined.
 	set_penalty((command)our_line.get_opcode().value, a_field_direct);
@@ -1324,6 +1367,7 @@ bool CPU::execute(const vector<code_line> & prog, vector<short> & memory,
 			memory[b_field_direct] = a_field_direct;
 			break;
 		case CMD_INT:
+			shell.record_interrupt();
 			error_out = interrupt(a_field_direct, shell, memory, 
 					active_robots, comms_lookup, 
 					shell.get_time(), matchnum, 
@@ -1332,11 +1376,13 @@ bool CPU::execute(const vector<code_line> & prog, vector<short> & memory,
 			if (error_out != ERR_NOERR) return(false);
 			break;
 		case CMD_IPO:
+			shell.record_port_call();
 			memory[b_field_indirect] = read_hardware(a_field_direct,
 					shell, active_robots, error_out);
 			if (error_out != ERR_NOERR) return(false);
 			break;
 		case CMD_OPO:
+			shell.record_port_call();
 			error_out = write_to_hardware(a_field_direct, 
 					b_field_direct, shell, active_robots, 
 					missiles, mines, comms_lookup);
@@ -0,0 +1,30 @@
+// Side effects a robot's CPU produces during a cycle, held back so that they
+// can be applied later. This is used when running robot CPUs in parallel: each
+// robot gets its own queue, and the queues are then emptied into the arena in
+// robot order, so that the outcome is the same as if the robots had been run
+// one after another.
+
+// The queue itself is just storage; robot::flush_deferred_effects does the
+// actual work of applying the effects.
+
+#ifndef _KROB_DEFERRED
+#define _KROB_DEFERRED
+
+#include "missile.cc"
+#include "mine.cc"
+#include <list>
+#include <vector>
+
+using namespace std;
+
+class deferred_effects {
+	public:
+		list<missile> missiles;		// Fired this cycle
+		list<mine> mines;		// Laid this cycle
+		vector<unsigned short> transmissions;
+		bool detonate;			// Set off mines laid earlier
+
+		deferred_effects() { detonate = false; }
+};
+
+#endif
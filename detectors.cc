@@ -13,6 +13,7 @@
 
 #include "object.cc"
 #include "random.cc"
+#include "snapshot.cc"
 #include <vector>
 #include <list>
 
@@ -25,14 +26,14 @@ class detector {
 	private:
 		int sonar_quant, sonar_maxrange;
 		int last_detected_transponder;
-		list<Unit *>::const_iterator closest_robot;
+		vector<Unit *>::const_iterator closest_robot;
 
 		int cycle_last_sonar, cycle_last_radar;
 		coordinate pos_last_sonar, pos_last_radar;
 
 		// If record_as_radar is false, *_last_radar isn't set; this
 		// is used when we call radar from sonar.
-		int internal_check_radar(const list<Unit *> & robots,
+		int internal_check_radar(const vector<Unit *> & robots,
 				const coordinate radar_pos,
 				int current_cycle, bool record_as_radar);
 
@@ -42,10 +43,10 @@ class detector {
 		detector(int sonar_q_in, int sonar_maxrange_in, int type,
 				int rng_matchid);
 
-		int check_radar(const list<Unit *> & robots, 
+		int check_radar(const vector<Unit *> & robots, 
 				const coordinate radar_pos,
 				int current_cycle);
-		int check_sonar(const list<Unit *> & robots,
+		int check_sonar(const vector<Unit *> & robots,
 				const coordinate sonar_pos,
 				int current_cycle);
 
@@ -59,6 +60,17 @@ class detector {
 
 		coordinate get_last_sonar_pos() const { return(pos_last_sonar);}
 		coordinate get_last_radar_pos() const { return(pos_last_radar);}
+
+		// closest_robot is only used right after a check, so it
+		// isn't saved.
+		void save_state(snapshot_writer & out) const;
+		void load_state(snapshot_reader & in);
+		void save_rng_state(snapshot_writer & out) const {
+			randomizer.save_state(out); }
+		// Start the random number generator over, as the constructor
+		// does.
+		void reseed(int matchid, int type) {
+			randomizer = single_rand(matchid, type, RND_SONAR); }
 };
 
 detector::detector(int sonar_q_in, int sonar_maxrange_in, 
@@ -67,9 +79,10 @@ detector::detector(int sonar_q_in, int sonar_maxrange_in,
 	sonar_quant = sonar_q_in;
 	cycle_last_sonar = -1;
 	cycle_last_radar = -1;
+	last_detected_transponder = 0;
 }
 
-int detector::internal_check_radar(const list<Unit *> & robots, 
+int detector::internal_check_radar(const vector<Unit *> & robots, 
 		const coordinate radar_pos, int current_cycle, bool
 		record_as_radar) {
 	// For all robots that's not our own, update record.
@@ -77,40 +90,43 @@ int detector::internal_check_radar(const list<Unit *> & robots,
 	// completist).
 	
 	double record_distance = INFINITY;
-	list<Unit *>::const_iterator record = robots.end();
+	vector<Unit *>::const_iterator record = robots.end();
 
 	if (record_as_radar) {
 		cycle_last_radar = current_cycle;
 		pos_last_radar = radar_pos;
 	}
 
-	for (list<Unit *>::const_iterator cur = robots.begin(); cur !=
+	for (vector<Unit *>::const_iterator cur = robots.begin(); cur !=
 			robots.end(); ++cur) {
-		if ((*cur)->get_pos() == radar_pos) continue;
+		const coordinate cur_pos = (*cur)->get_pos();
+		if (cur_pos == radar_pos) continue;
 
-		double this_distance = (*cur)->get_pos().sq_distance(radar_pos);
+		double this_distance = cur_pos.sq_distance(radar_pos);
 
 		if (this_distance < record_distance) {
 			record_distance = this_distance;
 			record = cur;
-			last_detected_transponder = (*cur)->get_ID();
 		}
 	}
 
 	closest_robot = record;
 
+	if (record != robots.end())
+		last_detected_transponder = (*record)->get_ID();
+
 	if (record == robots.end()) return(-1);
 	else return(sqrt(record_distance));
 }
 
-int detector::check_radar(const list<Unit *> & robots,
+int detector::check_radar(const vector<Unit *> & robots,
 		const coordinate radar_pos, int current_cycle) {
 
 	return(internal_check_radar(robots, radar_pos, current_cycle,
 				true));
 }
 
-int detector::check_sonar(const list<Unit *> & robots, coordinate sonar_pos,
+int detector::check_sonar(const vector<Unit *> & robots, coordinate sonar_pos,
 		int current_cycle) {
 	// DONE: Make this set memory location 5, as ATR2 does (albeit
 	// undocumented except for the "(for all scans)").
@@ -136,7 +152,7 @@ int detector::check_sonar(const list<Unit *> & robots, coordinate sonar_pos,
 	coordinate normalized = (*closest_robot)->get_pos() - sonar_pos;
 
 	// Get unfiltered angle.
-	double angle = radian_to_hex(atan2(normalized.y, normalized.x));
+	double angle = radian_to_hex(phys_atan2(normalized.y, normalized.x));
 
 	// Then distort it randomly (as ATR2 does) and return.
 	// FIXED bug where random was signed and so blew up sonar_quant by 2.
@@ -152,4 +168,26 @@ int detector::get_last_detected_transponder() const {
 	return(last_detected_transponder); 
 }
 
+void detector::save_state(snapshot_writer & out) const {
+	out.put_int(sonar_quant);
+	out.put_int(sonar_maxrange);
+	out.put_int(last_detected_transponder);
+	out.put_time(cycle_last_sonar, -1);
+	out.put_time(cycle_last_radar, -1);
+	out.put_coordinate(pos_last_sonar);
+	out.put_coordinate(pos_last_radar);
+	randomizer.save_state(out);
+}
+
+void detector::load_state(snapshot_reader & in) {
+	sonar_quant = in.get_int();
+	sonar_maxrange = in.get_int();
+	last_detected_transponder = in.get_int();
+	cycle_last_sonar = in.get_time(-1);
+	cycle_last_radar = in.get_time(-1);
+	pos_last_sonar = in.get_coordinate();
+	pos_last_radar = in.get_coordinate();
+	randomizer.load_state(in);
+}
+
 #endif
@@ -5,6 +5,10 @@
 // virtual surfaces and blit the entire thing to the real surface at the end
 // of each cycle.
 
+// A Display can also be a view of part of another: drawing to the view draws
+// straight into the other's pixels, so nothing has to be blitted. Views are
+// only good until the Display they view is resized.
+
 // All references are floating point since we're not doing any bitmap blitting,
 // and thus the display is resolution independent.
 
@@ -18,6 +22,10 @@
 #include <SDL/SDL.h>
 #include <SDL/SDL_gfxPrimitives.h>
 #include <SDL/SDL_ttf.h>
+#include <algorithm>
+#include <vector>
+
+using namespace std;
 
 // SDL_LockSurface? circles may be faster on software surfaces
 
@@ -33,6 +41,9 @@ class Display {
 		bool is_real;
 		bool inited_properly;
 
+		SDL_Surface * view_of;	// If a view, what it's a view of.
+		SDL_Rect view_area;
+
 		void construct_masks(Uint32 & rmask, Uint32 & gmask, 
 				Uint32 & bmask, Uint32 & amask);
 
@@ -60,6 +71,10 @@ class Display {
 	public:
 		void allocate(bool real, int depth);
 		Display(bool real, int xsize_in, int ysize_in, int depth);
+		// A view of the given area of parent, in pixels. Any part of
+		// the area outside the parent is left out.
+		Display(Display & parent, int xmin, int ymin, int xsize_in,
+				int ysize_in);
 		Display(const Display & source);
 		~Display();
 
@@ -114,8 +129,14 @@ class Display {
 				double xmax, double ymax);
 		int blit_all(const Display & from); 
 
-		// Does nothing if the display isn't real.
+		// Only draw inside this area (in pixels), until reset.
+		void set_clip(int xmin, int ymin, int xmax, int ymax);
+		void reset_clip();
+
+		// Does nothing if the display isn't real. The second only
+		// shows the given areas (in pixels) of what has been drawn.
 		void render(); 
+		void render(vector<SDL_Rect> areas);
 		bool lock();
 		bool unlock();
 		bool is_display_real() const { return(is_real); }
@@ -177,9 +198,23 @@ void Display::allocate(bool real, int depth) {
 
 	alloc_depth = depth;
 
+	// A view shares the pixels of the surface it views, with its pitch.
+	if (view_of != NULL) {
+		SDL_PixelFormat * format = view_of->format;
+		surface = SDL_CreateRGBSurfaceFrom((Uint8 *)view_of->pixels +
+				view_area.y * view_of->pitch + view_area.x *
+				format->BytesPerPixel, view_area.w,
+				view_area.h, format->BitsPerPixel,
+				view_of->pitch, format->Rmask, format->Gmask,
+				format->Bmask, format->Amask);
+		return;
+	}
+
+	// A software surface, so that views can draw into it directly and
+	// only the parts that changed have to be shown.
 	if (real)
 		surface = SDL_SetVideoMode(get_xsize(), get_ysize(), depth,
-				SDL_HWSURFACE | SDL_RESIZABLE | SDL_DOUBLEBUF);
+				SDL_SWSURFACE | SDL_RESIZABLE);
 	else {
 		Uint32 rmask, gmask, bmask, amask;
 		construct_masks(rmask, gmask, bmask, amask);
@@ -192,6 +227,7 @@ void Display::allocate(bool real, int depth) {
 
 bool Display::resize(int new_xsize, int new_ysize) {
 	if (new_xsize <= 0 || new_ysize <= 0) return(false);
+	if (view_of != NULL) return(false);
 
 	xsize = new_xsize;
 	ysize = new_ysize;
@@ -225,6 +261,7 @@ Display::Display(bool real, int xsize_in, int ysize_in, int depth) {
 	ysize = ysize_in;
 	aspect = xsize/(double)ysize;
 	is_real = real;
+	view_of = NULL;
 
 	allocate(is_real, depth);
 
@@ -232,6 +269,24 @@ Display::Display(bool real, int xsize_in, int ysize_in, int depth) {
 	assert(inited_properly);
 }
 
+Display::Display(Display & parent, int xmin, int ymin, int xsize_in,
+		int ysize_in) {
+
+	xmin = max(0, min(xmin, parent.get_xsize()));
+	ymin = max(0, min(ymin, parent.get_ysize()));
+	xsize = max(0, min(xsize_in, parent.get_xsize() - xmin));
+	ysize = max(0, min(ysize_in, parent.get_ysize() - ymin));
+	aspect = xsize/(double)ysize;
+	is_real = false;
+
+	view_of = parent.surface;
+	view_area = const_area(xmin, ymin, xmin + xsize, ymin + ysize);
+
+	allocate(is_real, parent.get_depth());
+
+	inited_properly = (surface != NULL);
+}
+
 Display::~Display() {
 	// If we have inited a surface, remove it.
 	if (inited_properly)
@@ -245,12 +300,17 @@ Display::Display(const Display & source) {
 	// surface.
 	xsize = source.get_xsize();
 	ysize = source.get_ysize();
+	aspect = source.aspect;
 	is_real = source.is_display_real();
+	view_of = source.view_of;
+	view_area = source.view_area;
 
 	allocate(is_real, source.get_depth());
 
+	// A copy of a view is a view of the same pixels, so there's nothing
+	// to copy.
 	inited_properly = (surface != NULL);
-	if (inited_properly) {
+	if (inited_properly && view_of == NULL) {
 		clear();			// Set alpha to 1
 		blit_all(source);
 	}
@@ -267,12 +327,15 @@ const Display & Display::operator=(const Display & source) {
 
 	xsize = source.get_xsize();
 	ysize = source.get_ysize();
+	aspect = source.aspect;
 	is_real = source.is_display_real();
+	view_of = source.view_of;
+	view_area = source.view_area;
 
 	allocate(is_real, source.get_depth());
 
 	inited_properly = (surface != NULL);
-	if (inited_properly) {
+	if (inited_properly && view_of == NULL) {
 		clear();		// Set alpha to 1
 		blit_all(source);
 	}
@@ -576,13 +639,12 @@ bool Display::print(double xpos, double ypos, double rel_size,
 
 	int abs_sz = round(rel_size*ysize);
 
-	SDL_Surface * text_temp = TTF_RenderText_Blended(
-			typeface.get_font(abs_sz), text.c_str(), clrFg);
+	// The font keeps the rendered text, so we don't free it.
+	SDL_Surface * text_surface = typeface.render(text, abs_sz, clrFg);
 
-	if (text_temp == NULL) return(false);
+	if (text_surface == NULL) return(false);
 
-	SDL_BlitSurface(text_temp, NULL, surface, &rect);
-	SDL_FreeSurface(text_temp);
+	SDL_BlitSurface(text_surface, NULL, surface, &rect);
 
 	return(true);
 }
@@ -644,11 +706,38 @@ int Display::blit_all(const Display & from) {
 	return(blit(from, 0, 0, 1, 1));
 }
 
+void Display::set_clip(int xmin, int ymin, int xmax, int ymax) {
+	if (!ready()) return;
+
+	SDL_Rect area = const_area(xmin, ymin, xmax, ymax);
+	SDL_SetClipRect(surface, &area);
+}
+
+void Display::reset_clip() {
+	if (ready())
+		SDL_SetClipRect(surface, NULL);
+}
+
 void Display::render() {
 	if (is_real && ready())
 		SDL_Flip(surface);
 }
 
+void Display::render(vector<SDL_Rect> areas) {
+	if (!is_real || !ready() || areas.empty()) return;
+
+	// SDL doesn't check that the areas are on the screen.
+	for (size_t counter = 0; counter < areas.size(); ++counter) {
+		SDL_Rect & area = areas[counter];
+		int xmin = max(0, (int)area.x), ymin = max(0, (int)area.y),
+		    xmax = min(xsize, area.x + area.w),
+		    ymax = min(ysize, area.y + area.h);
+		area = const_area(xmin, ymin, max(xmin, xmax), max(ymin, ymax));
+	}
+
+	SDL_UpdateRects(surface, areas.size(), &areas[0]);
+}
+
 bool Display::lock() {
 	if (ready()) {
 		SDL_LockSurface(surface);
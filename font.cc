@@ -2,6 +2,14 @@
 // This class simulates a font where we can write different sized characters on
 // the fly. It may be slow and use disk space, but it's a useful abstraction.
 
+// To keep it from being too slow, each size is opened once and kept open
+// (up to a limit, which is only reached after many resizes), and rendered
+// text is kept around so that drawing the same text in the same size and
+// color again is just a blit. The statlets and round information mostly
+// consist of text that doesn't change from frame to frame (names, labels,
+// win counts), so nearly everything comes from the cache. Least recently
+// used text is thrown out when the cache is full.
+
 #ifndef __SDL_FONT
 #define __SDL_FONT
 
@@ -9,16 +17,46 @@
 #include <iostream>
 #include <assert.h>
 #include <string>
+#include <list>
+#include <map>
 
 using namespace std;
 
+// What a piece of rendered text looks like.
+typedef struct text_key {
+	int size;
+	Uint8 r, g, b, a;
+	string text;
+
+	bool operator<(const text_key & other) const;
+};
+
+bool text_key::operator<(const text_key & other) const {
+	if (size != other.size) return(size < other.size);
+	if (r != other.r) return(r < other.r);
+	if (g != other.g) return(g < other.g);
+	if (b != other.b) return(b < other.b);
+	if (a != other.a) return(a < other.a);
+	return(text < other.text);
+}
+
 class Font {
 
 	private:
 		string filename;
-		TTF_Font * cached_font;
+		map<int, TTF_Font *> open_fonts;	// By size
 		int last_size;
+		size_t max_open_fonts;
+
+		// Rendered text, most recently used first, and where each is
+		// in that list.
+		list<pair<text_key, SDL_Surface *> > rendered;
+		map<text_key, list<pair<text_key, SDL_Surface *> >::iterator>
+			rendered_by_key;
+		size_t max_rendered;
+
 		void free_current_font();
+		void free_rendered();
 		bool load_current_font(int size);
 
 	public:
@@ -29,38 +67,66 @@ class Font {
 		string get_filename() { return(filename); }
 		TTF_Font * get_font();
 		TTF_Font * get_font(int point_size);
+
+		// Returns the text rendered (blended) at this size and color.
+		// The surface belongs to the font and must not be freed; it's
+		// only good until the next call.
+		SDL_Surface * render(string text, int point_size,
+				SDL_Color color);
 };
 
 void Font::free_current_font() {
-	if (cached_font != NULL)
-		TTF_CloseFont(cached_font);
+	for (map<int, TTF_Font *>::iterator pos = open_fonts.begin();
+			pos != open_fonts.end(); ++pos)
+		TTF_CloseFont(pos->second);
+	open_fonts.clear();
 	last_size = -1;
 }
 
+void Font::free_rendered() {
+	for (list<pair<text_key, SDL_Surface *> >::iterator pos =
+			rendered.begin(); pos != rendered.end(); ++pos)
+		SDL_FreeSurface(pos->second);
+	rendered.clear();
+	rendered_by_key.clear();
+}
+
 bool Font::load_current_font(int size) {
-	// Don't do anything if it's loaded and the size fits
-	if (cached_font != NULL && size == last_size) return(true);
 	if (size < 0) size = 16;
-	free_current_font();
-	//cout << "Size man " << size << endl;
-	cached_font = TTF_OpenFont(filename.c_str(), size);
-	if (cached_font != NULL)
+	// Don't do anything if it's loaded already.
+	if (open_fonts.find(size) != open_fonts.end()) {
 		last_size = size;
-	else	last_size = -1;
+		return(true);
+	}
+
+	// Too many sizes lying around (the window must have been resized
+	// a lot), so start over.
+	if (open_fonts.size() >= max_open_fonts)
+		free_current_font();
 
-	return(cached_font != NULL);
+	//cout << "Size man " << size << endl;
+	TTF_Font * font = TTF_OpenFont(filename.c_str(), size);
+	if (font == NULL) return(false);
+
+	open_fonts[size] = font;
+	last_size = size;
+	return(true);
 }
 
 Font::Font() {
-	last_size = -1; // denotes that nothing has been loaded into
-			// cached_font.
+	last_size = -1; // denotes that nothing has been loaded.
 	filename = "";
-	cached_font = NULL;
+	max_open_fonts = 8;
+	max_rendered = 512;
 }
 
-Font::~Font() { free_current_font(); }
+Font::~Font() {
+	free_rendered();
+	free_current_font();
+}
 
 bool Font::load_new_font(string ttf_in) {
+	free_rendered();
 	free_current_font();
 	filename = ttf_in;
 	return(load_current_font(-1));
@@ -68,27 +134,59 @@ bool Font::load_new_font(string ttf_in) {
 
 Font::Font(string ttf_in) {
 	last_size = -1;
-	cached_font = NULL;
+	max_open_fonts = 8;
+	max_rendered = 512;
 	// If we specify the font in the constructor, it better well be there.
 	assert(load_new_font(ttf_in));
 }
 
 TTF_Font * Font::get_font(int point_size) {
-	// If there's nothing there or we have a size mismatch, check if we can
-	// physically load.
 	// Default size is 16.
 	if (point_size == -1) point_size = 16;
-	if (last_size == -1 || cached_font == NULL || point_size != last_size) 
-		load_current_font(point_size);
-	// If there's still nothing, then bail out.
-	if (last_size == -1 || cached_font == NULL) return(NULL);
+	// If we can't load it, then bail out.
+	if (!load_current_font(point_size)) return(NULL);
 
 	// Otherwise return our value
-	return(cached_font);
+	return(open_fonts[point_size]);
 }
 
 TTF_Font * Font::get_font() {
 	return(get_font(last_size));
 }
 
+SDL_Surface * Font::render(string text, int point_size, SDL_Color color) {
+	text_key key;
+	key.size = point_size;
+	key.r = color.r; key.g = color.g; key.b = color.b;
+	key.a = color.unused;
+	key.text = text;
+
+	map<text_key, list<pair<text_key, SDL_Surface *> >::iterator>::
+		iterator found = rendered_by_key.find(key);
+
+	// Seen it before? Then move it to the front and we're done.
+	if (found != rendered_by_key.end()) {
+		rendered.splice(rendered.begin(), rendered, found->second);
+		return(found->second->second);
+	}
+
+	TTF_Font * font = get_font(point_size);
+	if (font == NULL) return(NULL);
+
+	SDL_Surface * text_surface = TTF_RenderText_Blended(font,
+			text.c_str(), color);
+	if (text_surface == NULL) return(NULL);
+
+	if (rendered.size() >= max_rendered) {
+		SDL_FreeSurface(rendered.back().second);
+		rendered_by_key.erase(rendered.back().first);
+		rendered.pop_back();
+	}
+
+	rendered.push_front(pair<text_key, SDL_Surface *>(key, text_surface));
+	rendered_by_key[key] = rendered.begin();
+
+	return(text_surface);
+}
+
 #endif
@@ -1,23 +1,29 @@
 // "Scorekeeper" that keeps statistical information between rounds.
 // First, there's a local stats class corresponding to the information
-// in /R4, and then there's a global stats class that contains local stats
-// information for each round (along with round number and matchid), as well
-// as a sum which is used for initing the robot parameters at the beginning
-// of another round.
+// in /R4, and then there's a global stats class that contains the sum of
+// the local stats over all rounds so far, which is used for initing the
+// robot parameters at the beginning of another round, along with a summary
+// of how each statistic is distributed over the rounds.
+
+// The global stats used to keep every round's local stats too, which
+// doesn't do for bouts of a million rounds. The summaries take the same
+// memory however many rounds there are: mean and variance, min and max,
+// and estimates of a few quantiles (see p2_quantile).
 
 // This is per-robot.
 
 // (Other interesting ideas: have a map of where we moved, where we got hit,
-//  etc.; probability distributions.)
+//  etc.)
 
 #ifndef _KROB_STATS
 #define _KROB_STATS
 
+#include "snapshot.cc"
 #include <sstream>
 #include <vector>
 #include <string>
 #include <math.h>
-#include <list>
+#include <algorithm>
 
 using namespace std;
 
@@ -26,12 +32,47 @@ using namespace std;
 
 // Now uses arrays so we don't have to reference the variables one by one.
 
+// Everything from RI_INSTRUCTIONS on is about what it cost us to simulate
+// the robot rather than what the robot did: instructions executed, port
+// and interrupt calls, scans, and wall time (in ns) spent running its CPU.
+
 typedef enum info_ref { RI_VICTORY = 0, RI_RUNS = 1, RI_KILLS = 2, 
 	RI_DEATHS = 3, RI_ENDARMOR = 4, RI_ENDHEAT = 5, RI_SHOTSFIRED = 6,
 	RI_HITS = 7, RI_MINESLAID = 8, RI_MINEHITS = 9, RI_DAMAGE = 10, 
-	RI_LIFESPAN = 11, RI_ERRORS = 12, META_RI_ALL = 13
+	RI_LIFESPAN = 11, RI_ERRORS = 12, RI_INSTRUCTIONS = 13, 
+	RI_PORTCALLS = 14, RI_INTERRUPTS = 15, RI_SCANS = 16, 
+	RI_CPUTIME = 17, META_RI_ALL = 18
 }; 
 
+// Names for machine-readable output (see results.cc).
+const string info_names[META_RI_ALL] = { "victory", "runs", "kills",
+	"deaths", "end_armor", "end_heat", "shots_fired", "hits", "mines_laid",
+	"mine_hits", "damage", "lifespan", "errors", "instructions",
+	"port_calls", "interrupts", "scans", "cpu_ns" };
+
+// Robot names, kept once for all the stats that refer to them. Each name
+// is only ever added once, so the table stays small.
+
+class name_table {
+	private:
+		vector<string> names;
+
+	public:
+		int lookup(const string & name);
+		const string & get(int index) const { return(names[index]); }
+};
+
+int name_table::lookup(const string & name) {
+	for (size_t counter = 0; counter < names.size(); ++counter)
+		if (names[counter] == name)
+			return(counter);
+
+	names.push_back(name);
+	return(names.size() - 1);
+}
+
+name_table robot_name_table;
+
 // Unreferenced calls: record_kill, record_victory, record_error,
 // 			increment_round_count
 // Half-unreferenced: RI_LIFESPAN (for last man standing)
@@ -39,14 +80,15 @@ typedef enum info_ref { RI_VICTORY = 0, RI_RUNS = 1, RI_KILLS = 2,
 
 class round_info {
 	private:
+		int name_index;
+
 		bool set_all(int vict_in, int runs_in, int kills_in, 
 				int deaths_in, int endarmor_in, int endheat_in,
 				int shots_in, int hits_in, int dmg_in,
 				int span_in, int error_in, string name_in);
 
 	public:
-		vector<long double> data; // store a lot of data
-		string robot_name;
+		long double data[META_RI_ALL]; // store a lot of data
 		round_info(int vict_in, int runs_in, int kills_in, int
 				deaths_in, int endarmor_in, int endheat_in,
 				int shots_in, int hits_in, int dmg_in,
@@ -56,76 +98,326 @@ class round_info {
 		//string get_r4_info(const double sum_of_how_many) const;
 		//string get_r4_info() const;
 
+		const string & robot_name() const { return(robot_name_table.get(
+					name_index)); }
+
 		long double get_one(int index) const;
 
-		void operator+= (const round_info in);
+		void operator+= (const round_info & in);
+
+		void save_state(snapshot_writer & out) const;
+		void load_state(snapshot_reader & in);
 };
 
 bool round_info::set_all(int vict_in, int runs_in, int kills_in, int deaths_in, 
 		int endarmor_in, int endheat_in, int shots_in, int hits_in, 
 		int dmg_in, int span_in, int error_in, string name_in) {
 
+	for (int counter = 0; counter < META_RI_ALL; ++counter)
+		data[counter] = 0;
+
 	data[RI_VICTORY] = vict_in; data[RI_RUNS] = runs_in; 
 	data[RI_KILLS] = kills_in; data[RI_DEATHS] = deaths_in; 
 	data[RI_ENDARMOR] = endarmor_in; data[RI_ENDHEAT] = endheat_in;
 	data[RI_SHOTSFIRED] = shots_in; data[RI_HITS] = hits_in;
 	data[RI_DAMAGE] = dmg_in; data[RI_LIFESPAN] = span_in; 
 	data[RI_ERRORS] = error_in;
-	robot_name = name_in;
+	name_index = robot_name_table.lookup(name_in);
 	return(true);
 }
 
 round_info::round_info(int vict_in, int runs_in, int kills_in, int deaths_in,
 		int endarmor_in, int endheat_in, int shots_in, int hits_in,
 		int dmg_in, int span_in, int error_in, string name_in) {
-	data.resize(META_RI_ALL);
 	set_all(vict_in, runs_in, kills_in, deaths_in, endarmor_in, endheat_in,
 			shots_in, hits_in, dmg_in, span_in, error_in, name_in);
 }
 
 
 round_info::round_info(string name_in) {
-	data.resize(META_RI_ALL);
 	set_all(0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, name_in);
 }
 
 long double round_info::get_one(int index) const {
-	if (index < 0 || index >= data.size()) return(-1);
+	if (index < 0 || index >= META_RI_ALL) return(-1);
 	return(data[index]);
 }
 
-void round_info::operator+= (const round_info in) {
+void round_info::operator+= (const round_info & in) {
 
 	// Manage the entire array
-	for (size_t counter = 0; counter < data.size(); ++counter)
+	for (int counter = 0; counter < META_RI_ALL; ++counter)
 		data[counter] += in.data[counter];
 }
 
+// The name is saved as text rather than as its index in the name table, since
+// the table is filled in whatever order the names turn up, which needn't be
+// the same in the run that loads the snapshot.
+void round_info::save_state(snapshot_writer & out) const {
+	out.put_string(robot_name());
+	out.put_uint(META_RI_ALL);
+	for (int counter = 0; counter < META_RI_ALL; ++counter)
+		if (counter == RI_CPUTIME && out.reproducible())
+			out.put_long_double(0);
+		else	out.put_long_double(data[counter]);
+}
+
+void round_info::load_state(snapshot_reader & in) {
+	name_index = robot_name_table.lookup(in.get_string());
+	if (in.get_uint() != META_RI_ALL) {
+		in.fail();
+		return;
+	}
+	for (int counter = 0; counter < META_RI_ALL; ++counter)
+		data[counter] = in.get_long_double();
+}
+
+// Estimates a quantile of a stream of numbers without keeping them, using
+// the P-square algorithm (Jain and Chlamtac, 1985). Five markers track the
+// minimum, the maximum, the quantile itself, and the quantiles halfway to
+// either side; as numbers come in, the markers are moved towards where
+// they should be, and their heights adjusted by interpolating a parabola
+// through them and their neighbours. Until there are five numbers, they're
+// just kept as they are.
+
+class p2_quantile {
+	private:
+		double quantile;
+		int count;
+		double heights[5], positions[5], desired[5], increments[5];
+
+		double parabolic(int idx, int dir) const;
+		double linear(int idx, int dir) const;
+
+	public:
+		p2_quantile() { init(0.5); }
+		// Forgets everything and starts estimating the given quantile.
+		void init(double quantile_in);
+
+		void add(double value);
+		double get() const;
+
+		void save_state(snapshot_writer & out) const;
+		void load_state(snapshot_reader & in);
+};
+
+void p2_quantile::init(double quantile_in) {
+	quantile = quantile_in;
+	count = 0;
+
+	for (int counter = 0; counter < 5; ++counter) {
+		heights[counter] = 0;
+		positions[counter] = counter + 1;
+	}
+
+	desired[0] = 1; desired[1] = 1 + 2 * quantile;
+	desired[2] = 1 + 4 * quantile; desired[3] = 3 + 2 * quantile;
+	desired[4] = 5;
+
+	increments[0] = 0; increments[1] = quantile / 2;
+	increments[2] = quantile; increments[3] = (1 + quantile) / 2;
+	increments[4] = 1;
+}
+
+double p2_quantile::parabolic(int idx, int dir) const {
+	return(heights[idx] + dir / (positions[idx+1] - positions[idx-1]) *
+			((positions[idx] - positions[idx-1] + dir) * 
+			 (heights[idx+1] - heights[idx]) / 
+			 (positions[idx+1] - positions[idx]) +
+			 (positions[idx+1] - positions[idx] - dir) *
+			 (heights[idx] - heights[idx-1]) / 
+			 (positions[idx] - positions[idx-1])));
+}
+
+double p2_quantile::linear(int idx, int dir) const {
+	return(heights[idx] + dir * (heights[idx+dir] - heights[idx]) /
+			(positions[idx+dir] - positions[idx]));
+}
+
+void p2_quantile::add(double value) {
+	int counter;
+
+	if (count < 5) {
+		heights[count++] = value;
+		if (count == 5)
+			sort(heights, heights + 5);
+		return;
+	}
+
+	// Find the cell the value falls into, extending the ends if needed.
+	int cell;
+	if (value < heights[0]) {
+		heights[0] = value;
+		cell = 0;
+	} else if (value >= heights[4]) {
+		heights[4] = value;
+		cell = 3;
+	} else
+		for (cell = 0; value >= heights[cell+1]; ++cell) ;
+
+	++count;
+	for (counter = cell + 1; counter < 5; ++counter)
+		++positions[counter];
+	for (counter = 0; counter < 5; ++counter)
+		desired[counter] += increments[counter];
+
+	// Move the middle markers if they're off by one or more.
+	for (counter = 1; counter < 4; ++counter) {
+		double off = desired[counter] - positions[counter];
+
+		if ((off >= 1 && positions[counter+1] - positions[counter] > 1)
+				|| (off <= -1 && positions[counter-1] - 
+					positions[counter] < -1)) {
+			int dir = (off > 0) ? 1 : -1;
+			double height = parabolic(counter, dir);
+
+			if (heights[counter-1] < height && height < 
+					heights[counter+1])
+				heights[counter] = height;
+			else	heights[counter] = linear(counter, dir);
+
+			positions[counter] += dir;
+		}
+	}
+}
+
+double p2_quantile::get() const {
+	if (count >= 5) return(heights[2]);
+	if (count == 0) return(0);
+
+	// Too few to estimate, so just pick the nearest.
+	double sorted[5];
+	copy(heights, heights + count, sorted);
+	sort(sorted, sorted + count);
+	return(sorted[(int)round(quantile * (count - 1))]);
+}
+
+void p2_quantile::save_state(snapshot_writer & out) const {
+	out.put_int(count);
+	for (int counter = 0; counter < 5; ++counter) {
+		out.put_double(heights[counter]);
+		out.put_double(positions[counter]);
+		out.put_double(desired[counter]);
+	}
+}
+
+void p2_quantile::load_state(snapshot_reader & in) {
+	count = in.get_int();
+	for (int counter = 0; counter < 5; ++counter) {
+		heights[counter] = in.get_double();
+		positions[counter] = in.get_double();
+		desired[counter] = in.get_double();
+	}
+}
+
+// Summary of how a statistic is distributed over the rounds. The mean and
+// variance are kept with Welford's method, which doesn't lose precision
+// the way summing squares does.
+
+const int SUMMARY_QUANTILES = 3;
+const double summary_quantiles[SUMMARY_QUANTILES] = { 0.1, 0.5, 0.9 };
+
+class stat_summary {
+	private:
+		int count;
+		double mean, squares, minimum, maximum;
+		p2_quantile quantiles[SUMMARY_QUANTILES];
+
+	public:
+		stat_summary();
+
+		void add(double value);
+
+		int get_count() const { return(count); }
+		double get_mean() const { return(mean); }
+		double get_stddev() const;
+		double get_min() const { return(minimum); }
+		double get_max() const { return(maximum); }
+		// Index into summary_quantiles.
+		double get_quantile(int which) const { return(quantiles[
+				which].get()); }
+
+		void save_state(snapshot_writer & out) const;
+		void load_state(snapshot_reader & in);
+};
+
+stat_summary::stat_summary() {
+	for (int counter = 0; counter < SUMMARY_QUANTILES; ++counter)
+		quantiles[counter].init(summary_quantiles[counter]);
+
+	count = 0;
+	mean = 0;
+	squares = 0;
+	minimum = 0;
+	maximum = 0;
+}
+
+void stat_summary::add(double value) {
+	if (count == 0 || value < minimum) minimum = value;
+	if (count == 0 || value > maximum) maximum = value;
+
+	++count;
+	double delta = value - mean;
+	mean += delta / count;
+	squares += delta * (value - mean);
+
+	for (int counter = 0; counter < SUMMARY_QUANTILES; ++counter)
+		quantiles[counter].add(value);
+}
+
+// Sample standard deviation.
+double stat_summary::get_stddev() const {
+	if (count < 2) return(0);
+	return(sqrt(squares / (count - 1)));
+}
+
+void stat_summary::save_state(snapshot_writer & out) const {
+	out.put_int(count);
+	out.put_double(mean);
+	out.put_double(squares);
+	out.put_double(minimum);
+	out.put_double(maximum);
+
+	for (int counter = 0; counter < SUMMARY_QUANTILES; ++counter)
+		quantiles[counter].save_state(out);
+}
+
+void stat_summary::load_state(snapshot_reader & in) {
+	count = in.get_int();
+	mean = in.get_double();
+	squares = in.get_double();
+	minimum = in.get_double();
+	maximum = in.get_double();
+
+	for (int counter = 0; counter < SUMMARY_QUANTILES; ++counter)
+		quantiles[counter].load_state(in);
+}
+
 class global_round_info {
 	private:
-		// Useful for determining CW, bothersome rounds, etc
-		// Obviously this will gobble up memory. Perhaps have a
-		// switch regarding whether we should keep past record or not.
-		list<round_info> past_records;
 		round_info sum;
-		string get_name() { return(sum.robot_name); }
+		string get_name() { return(sum.robot_name()); }
+
+		// One per statistic.
+		stat_summary per_round[META_RI_ALL];
 
 		int number_added;
 
 	public:
 		global_round_info(string robot_name);
-		// If log_round is false, only the sum is updated. Otherwise,
-		// the per-round info is updated as well.
-		void add_information(const round_info & to_add, bool log_round);
+		void add_information(const round_info & to_add);
 		const round_info * get_sum() const { return(&sum); }
-
-		// Some way of fetching stuff from past records goes here.
+		const stat_summary & get_distribution(int index) const {
+			return(per_round[index]); }
 
 		// These are accessed by robots inside the round, and thus have
 		// shortcuts. Writing up all the setters and getters isn't
 		// needed yet.
 		int get_total_kills() const { return(sum.data[RI_KILLS]); }
 		int get_total_deaths() const { return(sum.data[RI_DEATHS]); }
+
+		void save_state(snapshot_writer & out) const;
+		void load_state(snapshot_reader & in);
 };
 
 
@@ -133,12 +425,27 @@ global_round_info::global_round_info(string robot_name) : sum(robot_name) {
 	number_added = 0;
 }
 
-void global_round_info::add_information(const round_info & to_add, bool
-		log_round) {
-	if (log_round)
-		past_records.push_back(to_add);
+void global_round_info::add_information(const round_info & to_add) {
 	sum += to_add;
+	for (int counter = 0; counter < META_RI_ALL; ++counter)
+		per_round[counter].add(to_add.data[counter]);
 	number_added++;
 }
 
+void global_round_info::save_state(snapshot_writer & out) const {
+	sum.save_state(out);
+	out.put_int(number_added);
+
+	for (int counter = 0; counter < META_RI_ALL; ++counter)
+		per_round[counter].save_state(out);
+}
+
+void global_round_info::load_state(snapshot_reader & in) {
+	sum.load_state(in);
+	number_added = in.get_int();
+
+	for (int counter = 0; counter < META_RI_ALL; ++counter)
+		per_round[counter].load_state(in);
+}
+
 #endif
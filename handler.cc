@@ -1,6 +1,9 @@
 // This class handles SDL (and SDL_ttf), initing upon construction and shutting down
 // afterwards. Don't have more than one SDLHandler.
 
+// Without graphics, SDL isn't needed at all, so it isn't inited; the handler
+// then does nothing. (For a build without SDL, see headless.cc.)
+
 #ifndef __SDL_PROD
 #define __SDL_PROD
 
@@ -8,6 +11,8 @@
 #include <SDL/SDL_ttf.h>
 #include <SDL/SDL_framerate.h>
 
+#include "consolekbd.cc"
+
 #include <assert.h>
 
 #include <iostream>
@@ -38,6 +43,12 @@ class SDLHandler {
 					// get its parameters
 		SDL_ResizeEvent get_event_resize();
 
+		// Goes through the events waiting, and returns the first
+		// keypress the game uses (as its character), KEY_RESIZED
+		// with the new width, or KEY_CLOSED. If there's no such
+		// event, returns KEY_NONE.
+		int get_next_key(int & new_width);
+
 
 		void set_title(std::string title, std::string minimized_title);
 		void set_framerate(int fps);
@@ -49,15 +60,29 @@ class SDLHandler {
 
 		int last_event;
 		bool inited;
+		bool active;	// False if we're not using SDL at all.
+
+		int translate_SDL_keypress(int SDL_keypress) const;
 		bool has_produced_real;
 };
 
 SDLHandler::~SDLHandler() {
+	if (!active) return;
+
 	SDL_Quit();
 	TTF_Quit();
 }
 
 SDLHandler::SDLHandler(bool graphics, bool timing) {
+	last_event = -1;
+
+	// Starting SDL takes a while, so don't if there's nothing to show.
+	active = graphics;
+	if (!active) {
+		inited = true;
+		return;
+	}
+
 	// Something here about assertions.
 	int mask = 0;
 	if (graphics) mask |= SDL_INIT_VIDEO;
@@ -69,14 +94,12 @@ SDLHandler::SDLHandler(bool graphics, bool timing) {
 
 	inited = ((TTF_Init() != -1) && inited);
 	SDL_initFramerate(&FPS_man);
-
-	last_event = -1;
 }
 
 bool SDLHandler::ready() { return(inited); }
 
 int SDLHandler::get_next_event() {
-	if (!inited) return(-1);
+	if (!inited || !active) return(-1);
 
 	//int ret = SDL_PollEvent(&events);
 
@@ -91,7 +114,7 @@ int SDLHandler::get_next_event() {
 }
 
 int SDLHandler::wait_next_event() {
-	if (!inited) return(-1);
+	if (!inited || !active) return(-1);
 
 	int ret = SDL_WaitEvent(&events);
 
@@ -115,19 +138,73 @@ SDL_ResizeEvent SDLHandler::get_event_resize() {
 }
 
 void SDLHandler::set_title(std::string title, std::string minimized_title) {
+	if (!active) return;
 	SDL_WM_SetCaption(title.c_str(), minimized_title.c_str());
 }
 
 void SDLHandler::set_framerate(int fps) {
 	assert (fps > 0);
+	if (!active) return;
 	SDL_setFramerate(&FPS_man, fps);
 }
 
 bool SDLHandler::wait_for_frame_refresh() {
-	if (!inited) return(false);
+	if (!inited || !active) return(false);
 	SDL_framerateDelay(&FPS_man);
 	return(true);
 }
 
 
+// Returns -1 if it's not being used by the game, otherwise char code.
+int SDLHandler::translate_SDL_keypress(int SDL_keypress) const {
+	switch(SDL_keypress) {
+		case SDLK_ESCAPE:
+		case SDLK_q:	return('Q');
+
+		case SDLK_SPACE:
+		case SDLK_BACKSPACE: return(' ');
+
+		case SDLK_a: return('A');
+
+		case SDLK_PLUS:
+		case SDLK_KP_PLUS: return('+');
+
+		case SDLK_MINUS:
+		case SDLK_KP_MINUS: return('-');
+
+		case SDLK_w: return('W');
+
+		case SDLK_d: 
+		case SDLK_DOWN: return('D');
+
+		case SDLK_u:
+		case SDLK_UP: return('U');
+
+		case SDLK_LEFT: return('<');
+		case SDLK_RIGHT: return('>');
+
+		default: return(-1);
+	}
+}
+
+int SDLHandler::get_next_key(int & new_width) {
+	while (get_next_event() != -1) {
+		int key;
+		switch(last_event) {
+			case SDL_VIDEORESIZE:
+				new_width = events.resize.w;
+				return(KEY_RESIZED);
+			case SDL_QUIT:
+				return(KEY_CLOSED);
+			case SDL_KEYDOWN:
+				key = translate_SDL_keypress(events.key.keysym.
+						sym);
+				if (key != -1) return(key);
+				break;
+		}
+	}
+
+	return(KEY_NONE);
+}
+
 #endif
@@ -0,0 +1,95 @@
+// Stand-ins for the graphics classes, for building without SDL (make
+// krobots-headless). This lets K-Robots run in console mode on machines that
+// don't have SDL, SDL_ttf or SDL_gfx, e.g. servers that run tournaments.
+
+// Only the parts that main.cc uses are here, render_thread.cc included, and
+// they do nothing. Display never becomes ready, so setup_graphics fails, and
+// main turns graphics off anyway when built this way. Replays are played back as with -g, printing
+// the outcomes without showing the rounds.
+
+#ifndef _KROB_HEADLESS
+#define _KROB_HEADLESS
+
+#ifdef NOSDL
+
+#include "consolekbd.cc"
+#include "coordinate.cc"
+#include "color.cc"
+#include "colorman.cc"
+#include "robot.cc"
+#include "missile.cc"
+#include "mine.cc"
+#include "blast.cc"
+#include "global_stats.cc"
+#include <list>
+#include <map>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+class SDLHandler {
+	public:
+		static SDLHandler & instantiate(bool graphics, bool timing) {
+			static SDLHandler theHandler;
+			return(theHandler);
+		}
+
+		bool ready() { return(true); }
+		int get_next_key(int & new_width) { return(KEY_NONE); }
+
+		void set_title(string title, string minimized_title) {}
+		void set_framerate(int fps) {}
+		bool wait_for_frame_refresh() { return(false); }
+};
+
+class Font {
+	public:
+		bool load_new_font(string ttf_in) { return(false); }
+};
+
+class Display {
+	public:
+		Display(bool real, int xsize_in, int ysize_in, int depth) {}
+		bool ready() { return(false); }
+};
+
+class arena_disp {
+	public:
+		arena_disp(Display & real_display, const coordinate arena_size,
+				Font & typeface_in, int num_robots) {}
+};
+
+class render_thread {
+	public:
+		render_thread(arena_disp & renderer_in, SDLHandler & SDLc_in,
+				const map<string, Color> & palette,
+				const blasts & explosions_in,
+				int robot_disp_radius_in,
+				int buffer_thickness_in,
+				const coordinate arena_size_in,
+				double scan_lag_in) {}
+
+		void begin_round(const vector<string> & names,
+				const vector<global_round_info> &
+				global_robot_stats, matchid_t matchid_in,
+				int curmatch_in, int maxmatch_in,
+				int maxcycles_in) {}
+		void publish(int cycle, const vector<robot> & robots_in,
+				const list<missile> & missiles_in,
+				const list<mine> & mines_in,
+				const blasts & explosions_in,
+				double cycles_per_sec, bool show_scanarcs,
+				int statlet_offset) {}
+
+		void set_title(string title, string minimized_title) {}
+		int get_next_key(int & new_width) { return(KEY_NONE); }
+		void resize_displays(int new_xsize, const coordinate
+				arena_size_in) {}
+		bool can_scroll_statlets(int scroll_number, int num_robots) {
+			return(false); }
+};
+
+#endif
+
+#endif
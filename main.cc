@@ -94,19 +94,28 @@
 // multiple-display strategy didn't really work; ultimately, we may need to
 // rework widgets.
 
+#ifdef NOSDL
+#include "headless.cc"
+#else
 #include "handler.cc"
+#endif
 #include "consolekbd.cc"
 #include "color.cc"
 #include "colorman.cc"
+#ifndef NOSDL
 #include "display.cc"
 #include "font.cc"
 #include "widgets.cc"
+#endif
 #include "coordinate.cc"
 #include "coord_tools.cc"
 #include "stored_cores.cc"
 #include "global_stats.cc"
 #include "presenter.cc"
+#ifndef NOSDL
 #include "arena_disp.cc"
+#include "render_thread.cc"
+#endif
 #include "mover.cc"
 #include "object.cc"
 #include "robot.cc"
@@ -120,6 +129,16 @@
 #include "game_balance.cc"
 #include "cpu/corelogic.cc"
 #include "cpu/compiler.cc"
+#include "parallel_cores.cc"
+#include "snapshot.cc"
+#include "replay.cc"
+#include "statehash.cc"
+#include "periodic.cc"
+#include "phasetime.cc"
+#include "results.cc"
+#include "resultcache.cc"
+#include "server.cc"
+#include "messages.cc"
 
 #include <iostream>
 #include <fstream>
@@ -146,12 +165,16 @@ using namespace std;
 
 // Advance the movement of robots, missiles, and mines, handling explosions and
 // crashes. This basically invokes the correct collision detection routines.
-void advance_movement(vector<robot> & robots, list<robot *> & live_robots,
+// Afterwards, splash has the robots where they ended up, for the blasts of
+// any robots that die.
+void advance_movement(vector<robot> & robots, vector<robot *> & live_robots,
 		list<missile> & missiles,
 		list<mine> & mines, blasts & explosions, double cycles_elapsed,
 		double absolute_time_at_start, int robot_radius, 
 		int crash_range, int missile_hit_range, const coordinate &
-		arena_size) {
+		arena_size, splash_grid & splash) {
+
+	PHASE_SCOPE(PH_MOVEMENT);
 
 	/*vector<robot>::iterator rp;
 
@@ -160,7 +183,7 @@ void advance_movement(vector<robot> & robots, list<robot *> & live_robots,
 		rp->set_crash(false);
 	}*/
 
-	list<robot *>::iterator rp;
+	vector<robot *>::iterator rp;
 	for (rp = live_robots.begin(); rp != live_robots.end(); ++rp) {
 		(*rp)->set_time_units(cycles_elapsed);
 		(*rp)->set_crash(false);
@@ -168,17 +191,31 @@ void advance_movement(vector<robot> & robots, list<robot *> & live_robots,
 
 	collider test_collision;
 	// First find out if any robots will crash into each other.
-	test_collision.set_track_limits(live_robots, robot_radius, 
-			crash_range, arena_size);
+	{
+		PHASE_SCOPE(PH_TRACK_LIMITS);
+		test_collision.set_track_limits(live_robots, robot_radius, 
+				crash_range, arena_size);
+	}
 
 	// Then deal damage from missiles that hit.
-	test_collision.handle_missile_crashes(robots, live_robots, 
-			cycles_elapsed, missiles, missile_hit_range, 
-			arena_size, absolute_time_at_start, explosions);
+	{
+		PHASE_SCOPE(PH_MISSILE_CRASHES);
+		test_collision.index_robots(robots, live_robots, 
+				cycles_elapsed, arena_size, splash);
+		test_collision.handle_missile_crashes(robots, live_robots, 
+				cycles_elapsed, missiles, missile_hit_range, 
+				arena_size, absolute_time_at_start, 
+				explosions, splash);
+	}
 
 	// Also deal damage from mines.
-	test_collision.handle_mine_crashes(robots, live_robots, cycles_elapsed,
-			mines, explosions);
+	{
+		PHASE_SCOPE(PH_MINE_CRASHES);
+		test_collision.handle_mine_crashes(robots, live_robots, 
+				cycles_elapsed, mines, explosions, splash);
+	}
+
+	PHASE_SCOPE(PH_MOVES);
 
 	for (rp = live_robots.begin(); rp != live_robots.end(); ++rp) {
 		robot * cur_live = *rp; // Dereference so it isn't so ugly.
@@ -192,18 +229,136 @@ void advance_movement(vector<robot> & robots, list<robot *> & live_robots,
 			cur_live->register_crash(cur_live->time_units());
 	}
 
+	// The robots have stopped moving for this cycle, so no slack is needed.
+	test_collision.index_robots(robots, live_robots, 0, arena_size,
+			splash);
+
 	// Finally, advance missiles. (There's no need to "advance" mines).
 	for (list<missile>::iterator pos = missiles.begin();
 			pos != missiles.end(); ++pos)
 		pos->move(cycles_elapsed);
 }
 
+// Write the last instructions a robot ran, up to and including the given one
+// (by its core's instruction count). Why says what happened.
+void report_CPU_trace(core_storage & robot_cores, int idx,
+		const robot & subject, string why, uint64_t up_to,
+		const cmd_parse & aux_disassembler, matchid_t match_id,
+		message_log & messages) {
+
+	const char * reg_names[] = { "flags", "ax", "bx", "cx", "dx", "ex",
+		"fx", "sp" };
+
+	vector<trace_entry> trace = robot_cores.cores[idx].get_trace(up_to);
+
+	ostringstream report;
+
+	report << "Trace of robot " << idx << "(" << subject.
+		get_local_stats().robot_name() << ") (matchID " << match_id <<
+		") " << why << ", last " << trace.size() << 
+		" instructions:" << endl;
+
+	for (vector<trace_entry>::const_iterator pos = trace.begin();
+			pos != trace.end(); ++pos) {
+		int source_line = robot_cores.lookup_line_number(idx, pos->IP);
+
+		report << "\t";
+		if (source_line != -1)
+			report << "line " << source_line << " ";
+		report << "(IP " << pos->IP << "): " << aux_disassembler.
+			disassemble(robot_cores.cores[idx].get_instruction(
+						pos->IP));
+
+		if (pos->decoded)
+			report << "\t[" << pos->a_direct << ", " << 
+				pos->b_direct << "]";
+		else	report << "\t[failed]";
+
+		for (int reg = 0; reg <= REG_SP - REG_FLAGS; ++reg)
+			report << " " << reg_names[reg] << "=" << 
+				pos->registers[reg];
+
+		report << " penalty " << pos->penalty << endl;
+	}
+
+	messages.write(report.str());
+}
+
+// Report an error that occurred in a robot's CPU. eff_line is the IP of the
+// instruction that caused it, and instruction when it happened by its core's
+// instruction count. If the same error keeps happening, it's only counted,
+// and isn't even formatted.
+void report_CPU_error(core_storage & robot_cores, int idx, 
+		const robot & culprit, run_error cpu_error, int eff_line,
+		uint64_t instruction, const cmd_parse & aux_disassembler,
+		matchid_t match_id, message_log & messages) {
+
+	if (!messages.count_error(idx, eff_line, cpu_error))
+		return;
+
+	ostringstream report;
+
+	report << "Error " << (int)cpu_error << " in robot " << idx << "(" << 
+		culprit.get_local_stats().robot_name() << ") (matchID " << 
+		match_id << "), at ";
+
+	int source_line = robot_cores.lookup_line_number(idx, eff_line);
+
+	// If we can look up the real line, print it. Otherwise print the
+	// "effective" line (IP).
+
+	if (source_line != -1)
+		report << "line " << source_line;
+	else	report << "effective line " << eff_line;
+
+	report << ", disasm: " << aux_disassembler.disassemble(robot_cores.
+			cores[idx].get_instruction(eff_line));
+
+	messages.show_error(idx, eff_line, cpu_error, report.str());
+
+	if (messages.wants_trace(TRACE_ON_ERROR))
+		report_CPU_trace(robot_cores, idx, culprit, "at error " +
+				itos(cpu_error), instruction, aux_disassembler,
+				match_id, messages);
+}
+
+// If cpu_pool is not NULL and all the live robots are safe to run in
+// parallel, the CPUs are run on multiple threads. See parallel_cores.cc.
 void advance_CPUs(core_storage & robot_cores, vector<robot> & robots,
-		list<Unit *> & live_robots, list<missile> & missiles,
-		list<mine> & mines, vector<set<robot *> > & comms_lookup,
+		vector<Unit *> & live_robots, list<missile> & missiles, 
+		list<mine> & mines, comms_registry & comms_lookup,
 		const cmd_parse & aux_disassembler, matchid_t match_id,
-		const coordinate arena_size, const bool verbose, 
-		const bool report_errors) {
+		const coordinate arena_size, message_log & messages,
+		parallel_cores * cpu_pool) {
+
+	PHASE_SCOPE(PH_CPUS);
+
+	bool report_errors = messages.wants(LOG_ERRORS);
+
+	if (cpu_pool != NULL && cpu_pool->can_run(robots)) {
+		cpu_pool->execute(robot_cores, robots, live_robots, 
+				comms_lookup, arena_size, report_errors);
+
+		// Now apply what they did, in the same order as they would
+		// have been done had we run the robots one by one.
+		for (size_t idx = 0; idx < robots.size(); ++idx) {
+			robots[idx].flush_deferred_effects(missiles, mines,
+					comms_lookup);
+
+			const list<core_error> & errors = cpu_pool->
+				get_errors(idx);
+
+			for (list<core_error>::const_iterator pos = 
+					errors.begin(); pos != errors.end();
+					++pos)
+				report_CPU_error(robot_cores, idx, robots[idx],
+						pos->error, pos->IP,
+						pos->instruction,
+						aux_disassembler, match_id,
+						messages);
+		}
+		return;
+	}
 
 	vector<corelogic>::iterator core_iter, core_begin = robot_cores.
 		cores.begin();
@@ -232,32 +387,16 @@ void advance_CPUs(core_storage & robot_cores, vector<robot> & robots,
 				// (wraparound).
 				rp->update_error(cpu_error);
 
-				if (verbose || report_errors) {
-					int idx = rp - robots.begin();
-					cout << "Error " << (int)cpu_error 
-						<< " in robot " << idx 
-						<< "(" << rp->get_local_stats().
-						robot_name << ") (matchID " << match_id << "), at ";
-
-					int eff_line = core_iter->get_old_IP();
-					int source_line = robot_cores.
-						lookup_line_number(idx, 
-								eff_line);
-
-					// If we can look up the real line,
-					// print it. Otherwise print the
-					// "effective" line (IP).
-
-					if (source_line != -1)
-						cout << "line " << source_line;
-					else	cout << "effective line " <<
-						eff_line;
-
-					cout << ", disasm: " 
-						<< aux_disassembler.disassemble
-						(core_iter->
-						 get_instr_at_oldIP()) << endl;
-				}
+				if (report_errors)
+					report_CPU_error(robot_cores, 
+							rp - robots.begin(),
+							*rp, cpu_error, 
+							core_iter->
+							get_old_IP(),
+							core_iter->
+							get_instructions_run(),
+							aux_disassembler,
+							match_id, messages);
 			}
 		}
 
@@ -279,7 +418,10 @@ string snip_extraneous(string filename) {
 	return(remove_path(remove_extension(filename)));
 }
 
-// Instantiate a robot.
+// Instantiate a robot prototype: a robot as it is before its round starts,
+// except for what differs from round to round (see generate_robot). Building
+// a robot takes a while, so this is done once per bout and the prototypes are
+// copied for each round.
 // Insanity is -2 for no "insane missiles" setting, otherwise the insanity
 // amount. (Insanity level -2 makes missiles stand almost still. Lower 
 // levels would make them go backwards, except that mover doesn't support it.
@@ -287,15 +429,12 @@ string snip_extraneous(string filename) {
 
 #define INSANITY_SANE -10
 
-robot generate_robot(matchid_t matchid, const coordinate arena_size,
-		single_rand & initstate_randomizer, string fn, 
-		int robot_radius, int & count, string message, 
-		vector<int> device_weighting, int maxweight,
+robot make_robot_prototype(string fn, int robot_radius, int & count,
+		string message, vector<int> device_weighting, int maxweight,
 		bool old_shields, int CPU_cycles_per_cycle,
 		global_round_info & this_robot_global_stats,
 		int insanity) {
 
-	double start_heading = initstate_randomizer.irand() % 256;
 	double start_throttle = 0;
 
 	game_balance limits;
@@ -311,11 +450,12 @@ robot generate_robot(matchid_t matchid, const coordinate arena_size,
 		missile_speed = 100.1 + 50 * insanity;
 	else	missile_speed = limits.get_missile_speed();
 
-	robot to_ret(matchid, count++, snip_extraneous(fn), 
+	// The match ID and heading are set by generate_robot.
+	robot to_ret(0, count++, snip_extraneous(fn), 
 			limits.get_min_throttle(), limits.get_max_throttle(), 
 			limits.get_speed_multiplier(), limits.get_turn_rate(),
 			limits.get_accel_value(),
-			start_heading, start_throttle, robot_radius, scanrange,
+			0, start_throttle, robot_radius, scanrange,
 			16, default_mines, CPU_cycles_per_cycle, 
 			limits.get_heat_shutdown(), 
 			limits.get_heat_hysteresis(), limits.get_sonar_range(),
@@ -328,7 +468,6 @@ robot generate_robot(matchid_t matchid, const coordinate arena_size,
 
 	to_ret.set_message(message);
 	to_ret.set_desired_throttle(0);
-	to_ret.turret_heading = initstate_randomizer.irand() % 256;
 
 	// Add message and reweight strengths according to #config.
 	limits.complete_config_values(device_weighting);
@@ -345,15 +484,12 @@ robot generate_robot(matchid_t matchid, const coordinate arena_size,
 	return(to_ret);
 }
 
-robot generate_robot(matchid_t matchid, const coordinate arena_size,
-		single_rand & initstate_randomizer, string fn,
-		int robot_radius, int & count, const core_storage & cores,
-		int core_idx, int maxweight, bool old_shields, 
-		int max_CPU_cycles_per_cycle, 
+robot make_robot_prototype(string fn, int robot_radius, int & count,
+		const core_storage & cores, int core_idx, int maxweight,
+		bool old_shields, int max_CPU_cycles_per_cycle, 
 		global_round_info & this_robot_global_stats, int insanity) {
 
-	return(generate_robot(matchid, arena_size, initstate_randomizer,
-				fn, robot_radius, count, 
+	return(make_robot_prototype(fn, robot_radius, count, 
 				cores.get_message(core_idx),
 				cores.get_weighting(core_idx), maxweight, 
 				old_shields, cores.get_CPU_speed(core_idx, 
@@ -362,15 +498,36 @@ robot generate_robot(matchid_t matchid, const coordinate arena_size,
 				this_robot_global_stats, insanity));
 }
 
+// Instantiate a robot for this round from its prototype, with a random
+// heading and turret heading.
+robot generate_robot(matchid_t matchid, single_rand & initstate_randomizer,
+		const robot & prototype,
+		global_round_info & this_robot_global_stats) {
+
+	robot to_ret = prototype;
+
+	double start_heading = initstate_randomizer.irand() % 256;
+	unsigned char start_turret = initstate_randomizer.irand() % 256;
+
+	to_ret.start_round(matchid, start_heading, start_turret,
+			&this_robot_global_stats);
+
+	return(to_ret);
+}
+
+// Place the robot at a random spot where it doesn't collide with the edges or
+// with the robots placed so far, which are in the grid "placed". Then add it
+// to the grid.
 void place_robot_randomly(single_rand & initstate_randomizer, 
 		const coordinate arena_size, vector<robot> & robots_so_far,
-		int index, int crash_range) {
+		int index, int crash_range, splash_grid & placed) {
 
 	if (index < 0 || index >= robots_so_far.size()) return;
 
 	coordinate rndpos;
 	bool colliding;
 	collider edge_tester;
+	vector<int> nearby;
 
 	do {
 		// Note, this actually returns a value on [0..arena_size],
@@ -385,19 +542,24 @@ void place_robot_randomly(single_rand & initstate_randomizer,
 
 		// If it collided with the edge, this never gets executed.
 		// Nifty!
-		for (size_t counter = 0; counter < robots_so_far.size() 
+		if (!colliding)
+			placed.find_in_range(rndpos, crash_range * 1.2, nearby);
+		else	nearby.clear();
+
+		for (size_t counter = 0; counter < nearby.size() 
 				&& !colliding; ++counter) {
 
-			if (counter == index) continue;
+			if (nearby[counter] == index) continue;
 
 			// Margin of safety.
-			if (rndpos.distance(robots_so_far[counter].get_pos()) 
-					< crash_range * 1.2)
+			if (rndpos.distance(robots_so_far[nearby[counter]].
+						get_pos()) < crash_range * 1.2)
 				colliding = true;
 		}
 	} while (colliding);
 
 	robots_so_far[index].set_pos(rndpos);
+	placed.add(index, rndpos);
 }
 
 
@@ -408,6 +570,7 @@ template<typename T> void alias(vector<robot> & input,
 		T & output) {
 
 	T toRet;
+	toRet.reserve(input.size());
 
 	for (vector<robot>::iterator rp = input.begin(); rp != input.end();
 			++rp)
@@ -416,14 +579,18 @@ template<typename T> void alias(vector<robot> & input,
 	output = toRet;
 }
 
+// Remove the dead. The live sets are vectors, so this is done in one pass
+// that moves the rest down; they're kept in the same order, since the order
+// robots are handled in affects the outcome.
 template<typename T> void realias(T & to_check) { 
 
-	typename T::iterator curpos = to_check.begin();
+	size_t kept = 0;
+
+	for (size_t counter = 0; counter < to_check.size(); ++counter)
+		if (!to_check[counter]->dead())
+			to_check[kept++] = to_check[counter];
 
-	while (curpos != to_check.end())
-		if ((*curpos)->dead())
-			curpos = to_check.erase(curpos);
-		else	++curpos;
+	to_check.resize(kept);
 }
 
 // Guess filenames to find out if they're incompletely specified, so as to
@@ -458,7 +625,7 @@ vector<string> guess_filename(string base_filename) {
 
 bool compile_robots(const vector<string> filenames, int maxdevices, 
 		int maxlines, bool verbose, bool strict_compile,
-		core_storage & out) {
+		core_storage & out, vector<uint64_t> & source_hashes) {
 
 	error_container retval(CER_NOERR);
 
@@ -466,6 +633,7 @@ bool compile_robots(const vector<string> filenames, int maxdevices,
 
 	for (size_t counter = 0; counter < filenames.size(); ++counter) {
 		ifstream inf(filenames[counter].c_str());
+		string source_file = filenames[counter];
 
 		retval = out.insert_core(inf, filenames[counter], maxdevices,
 				maxlines, verbose, strict_compile);
@@ -493,6 +661,7 @@ bool compile_robots(const vector<string> filenames, int maxdevices,
 				retval = out.insert_core(infx, prospective[0],
 						maxdevices, maxlines, verbose,
 						strict_compile);
+				source_file = prospective[0];
 			}
 		}
 
@@ -504,45 +673,215 @@ bool compile_robots(const vector<string> filenames, int maxdevices,
 				construct_error_message() << endl;
 			return(false);
 		}
+
+		source_hashes.push_back(hash_source(source_file));
 	}
 
 	return(true);
 }
 
-// Returns -1 if it's not being used by the game, otherwise char code.
-int translate_SDL_keypress(int SDL_keypress) {
-	switch(SDL_keypress) {
-		case SDLK_ESCAPE:
-		case SDLK_q:	return('Q');
+// Print the outcome of a round. The robots' global stats must already include
+// this round.
+void print_round_outcome(int curmatch, int maxmatch, matchid_t matchid,
+		const vector<robot> & robots, 
+		const vector<global_round_info> & global_robot_stats,
+		int per_round_tinfo) {
 
-		case SDLK_SPACE:
-		case SDLK_BACKSPACE: return(' ');
+	size_t counter;
 
-		case SDLK_a: return('A');
+	presenter present;
+	cout << "Match " << curmatch << "/" << maxmatch << " (Match ID "
+		<< matchid << ") results:";
+	cout << endl << endl;
+	string header = present.local_header();
+	cout << header << endl;
+	cout << string(header.size(), '~') << endl; 
+	for (counter = 0; counter < robots.size(); ++counter) 
+		cout << present.single_summary(robots[counter].
+				get_local_stats(),
+				*global_robot_stats[counter].get_sum(),
+				counter+1) << endl;
+
+	// If user requested it, also print a machine-readable
+	// tournament info type output.
+	if (per_round_tinfo > 0) {
+		for (counter = 0; counter < robots.size(); ++counter) {
+			cout << "(" << matchid << "/ext)\t";
+			cout << present.get_tournament_line(
+					robots[counter].
+					get_local_stats(),
+					per_round_tinfo, 1) << endl;
+		}
+	}
 
-		case SDLK_PLUS:
-		case SDLK_KP_PLUS: return('+');
+	cout << endl;
+	// Status ("No clear victor", etc) goes here.
+}
 
-		case SDLK_MINUS:
-		case SDLK_KP_MINUS: return('-');
+// ------- Snapshots ------
+
+// A snapshot holds everything needed to continue a bout from the middle of a
+// round: first a header identifying the robots, then the bout state (which
+// round we're in, the Match ID RNG, and the stats so far), then the state of
+// the round itself. The programs aren't saved, so resuming requires the same
+// robot files; we check the names to catch the most obvious mistakes.
+// Settings like -t or -l aren't saved either, and must be given again.
+
+const string snapshot_magic = "KROBSNAP";
+const int snapshot_version = 3;
+
+typedef struct snapshot_settings {
+	string filename;	// Where to write snapshots
+	int at_cycle;		// Save when reaching this cycle, or -1
+	int every;		// Save every this many cycles, or 0
+	snapshot_reader * resume; // If not NULL, restore the round from this
+	const single_rand * bout_rng; // Match ID generator, for saving
+};
+
+void write_snapshot_header(snapshot_writer & out, 
+		const vector<string> & filenames, int curmatch, int maxmatch,
+		matchid_t matchid, const single_rand & bout_rng,
+		const vector<global_round_info> & global_robot_stats) {
+
+	out.put_string(snapshot_magic);
+	out.put_int(snapshot_version);
+	out.put_uint(filenames.size());
+	for (size_t counter = 0; counter < filenames.size(); ++counter)
+		out.put_string(snip_extraneous(filenames[counter]));
+
+	out.put_int(curmatch);
+	out.put_int(maxmatch);
+	out.put_uint(matchid);
+	bout_rng.save_state(out);
+
+	for (size_t counter = 0; counter < global_robot_stats.size(); 
+			++counter)
+		global_robot_stats[counter].save_state(out);
+}
 
-		case SDLK_w: return('W');
+// Returns false if the snapshot is bad or for some other robots.
+bool read_snapshot_header(snapshot_reader & in, 
+		const vector<string> & filenames, int & curmatch,
+		int & maxmatch, matchid_t & matchid, single_rand & bout_rng,
+		vector<global_round_info> & global_robot_stats) {
 
-		case SDLK_d: 
-		case SDLK_DOWN: return('D');
+	if (in.get_string() != snapshot_magic) {
+		cerr << "Error: Not a snapshot file." << endl;
+		return(false);
+	}
 
-		case SDLK_u:
-		case SDLK_UP: return('U');
+	if (in.get_int() != snapshot_version) {
+		cerr << "Error: Unsupported snapshot version." << endl;
+		return(false);
+	}
 
-		default: return(-1);
+	if (in.get_uint() != filenames.size()) {
+		cerr << "Error: Snapshot is for a different number of robots."
+			<< endl;
+		return(false);
 	}
+
+	for (size_t counter = 0; counter < filenames.size(); ++counter)
+		if (in.get_string() != snip_extraneous(filenames[counter])) {
+			cerr << "Error: Snapshot robot " << counter+1 << 
+				" doesn't match " << filenames[counter] << 
+				endl;
+			return(false);
+		}
+
+	curmatch = in.get_int();
+	maxmatch = in.get_int();
+	matchid = in.get_uint();
+	bout_rng.load_state(in);
+
+	for (size_t counter = 0; counter < global_robot_stats.size(); 
+			++counter)
+		global_robot_stats[counter].load_state(in);
+
+	if (!in.ok() || curmatch < 1 || curmatch > maxmatch) {
+		cerr << "Error: Snapshot is truncated or corrupt." << endl;
+		return(false);
+	}
+
+	return(true);
+}
+
+void write_round_state(snapshot_writer & out, double current_cycle, 
+		int time_last_death, bool only_one_at_start,
+		const vector<robot> & robots, const core_storage & core_store,
+		const list<missile> & missiles, const list<mine> & mines,
+		const blasts & explosions) {
+
+	out.put_time(current_cycle, -1);
+	out.put_time(time_last_death, -1);
+	out.put_bool(only_one_at_start);
+
+	for (size_t counter = 0; counter < core_store.cores.size(); ++counter)
+		core_store.cores[counter].save_state(out);
+
+	write_arena_state(out, robots, missiles, mines, explosions);
+}
+
+// The robots must already have been created, and taken off the comms
+// channels they were on; the caller should put them back on afterwards, as
+// well as update the lists of live robots.
+bool read_round_state(snapshot_reader & in, double & current_cycle,
+		int & time_last_death, bool & only_one_at_start,
+		vector<robot> & robots, core_storage & core_store,
+		list<missile> & missiles, list<mine> & mines,
+		blasts & explosions) {
+
+	current_cycle = in.get_time(-1);
+	time_last_death = in.get_time(-1);
+	only_one_at_start = in.get_bool();
+
+	for (size_t counter = 0; counter < core_store.cores.size(); ++counter)
+		core_store.cores[counter].load_state(in);
+
+	read_arena_state(in, robots, missiles, mines, explosions);
+
+	if (!in.ok() || !in.at_end()) {
+		cerr << "Error: Snapshot is truncated or corrupt." << endl;
+		return(false);
+	}
+
+	return(true);
+}
+
+// Overwrite the round in progress with the state in the reader. Comms
+// registration and the live lists depend on the robots' state, so this
+// redoes them.
+bool restore_round_state(snapshot_reader & in, double & current_cycle,
+		int & time_last_death, bool & only_one_at_start,
+		vector<robot> & robots, core_storage & core_store,
+		list<missile> & missiles, list<mine> & mines,
+		blasts & explosions, comms_registry & comms_lookup,
+		vector<robot *> & live_robots, vector<Unit *> & live_units) {
+
+	vector<robot>::iterator robot_pos;
+
+	for (robot_pos = robots.begin(); robot_pos != robots.end();
+			++robot_pos)
+		robot_pos->remove_communications_link(comms_lookup);
+
+	bool restored = read_round_state(in, current_cycle, time_last_death,
+			only_one_at_start, robots, core_store, missiles, 
+			mines, explosions);
+
+	for (robot_pos = robots.begin(); robot_pos != robots.end();
+			++robot_pos)
+		robot_pos->set_communications_channel(robot_pos->
+				get_communications_channel(), comms_lookup);
+
+	realias(live_robots);
+	realias(live_units);
+
+	return(restored);
 }
 
 // DONE: Rewrite this comment block.
 // Runs a single round. The parameters are:
 // 	print_outcomes: If true, prints the round outcome.
-// 	report_errors: If true, reports errors when they happen.
-// 	verbose: If true, show per-cycle debugging info.
 //	graphics: If true, access graphics structure and try to render each
 //		frame.
 //	show_true: If true and graphics is true, show scanning arcs when
@@ -558,9 +897,12 @@ int translate_SDL_keypress(int SDL_keypress) {
 //	explosions: Structure to keep count of explosions and explosion
 //		locations, for rendering.
 //	filenames: Filenames of the robots.
+//	robot_prototypes: The robots as they are at the start of a round,
+//		made from the files in the first round of the bout and
+//		copied in the later ones. Empty before the first round.
 //	comms_lookup: Communications structure, for making comms transmission
 //		and reception take constant time instead of logarithmic or
-//		linear time. (Maybe YAGNI?)
+//		linear time. See comms_registry.cc.
 //	old_shields: If true, enable old shields (where robots are invulnerable
 //		with shields on)
 //	max_CPU_speed: Maximum CPU speed, in CPU cycles per game cycle.
@@ -579,19 +921,8 @@ int translate_SDL_keypress(int SDL_keypress) {
 //	maxmatch: Maximum match number
 //	matchid: Match ID (random seed for replaying matches/examining odd
 //		results more closely).
-//	renderer: Pointer to the class that draws (renders) the graphics mode
-//		content.
-//	palette: Palette map between color names and actual colors.
-//	robot_disp_radius: Display robots (in graphics mode) as if they had a
-//		radius of this size. The variable is usually greater than the
-//		true robot radius so that it'll be easier to see the robots in
-//		graphics mode.
-//	buffer_thickness: How much space to give to the buffer -- area that
-//		can't be driven to, but is displayed so that large objects
-//		don't get smushed up against the edge of the screen or clipped.
-//	scan_lag: Duration, in msecs, to show the scanning arc after the actual
-//		scan was performed by the robot. Use this so users can see when
-//		scans happen without getting a horrible flickering effect.
+//	renderer: Pointer to the thread that draws (renders) the graphics mode
+//		content, which is also how we get at the window.
 //	disassembler: Class used for disassembling, for instance when referring
 //		to errors.
 //	balancer: Balance class containing information about how much
@@ -607,27 +938,45 @@ int translate_SDL_keypress(int SDL_keypress) {
 //	kbd_trigger: Timer to make keyboard checking trigger at regular
 //		intervals and thus not slow down graphics-less execution too
 //		much.
-
-bool run_round(bool print_outcomes, bool report_errors, bool verbose, 
-		bool graphics, bool show_scanarcs, double cycles_per_step, 
+//	cpu_pool: Threads for running the robot CPUs in parallel, or NULL to
+//		run them one at a time.
+//	snapshots: When to save snapshots and where, and whether this round
+//		should be restored from one.
+//	recorder: Replay log to record the round to, or NULL if none.
+//	hasher: State hasher for checking determinism, or NULL if none.
+//	periods: Detector for skipping ahead through rounds that have
+//		settled into a loop, or NULL if none.
+//	results: Where to write the results of the round as data, or NULL.
+//	cache: Cache of round outcomes to look this round up in and add it
+//		to, or NULL if none.
+//	messages: Where to report robot errors (LOG_ERRORS), per-cycle
+//		debugging info (LOG_CYCLES) and what else happens during the
+//		round (LOG_EVENTS), if these are wanted.
+
+bool run_round(bool print_outcomes, bool graphics, bool show_scanarcs,
+		double cycles_per_step, 
 		int framerate, int per_round_tinfo, 
 		core_storage & core_store, blasts explosions,
-		const vector<string> filenames, vector<set<robot *> > & 
+		const vector<string> filenames, vector<robot> &
+		robot_prototypes, comms_registry & 
 		comms_lookup, bool old_shields, int max_CPU_speed, 
 		int robot_radius, int crash_range, int missile_hit_radius, 
 		int missile_insanity, const coordinate arena_size,
 		int maxweight, int maxcycles, int min_victory_margin,
-		int curmatch, int maxmatch, matchid_t matchid, arena_disp *
-		renderer, const map<string, Color> & palette, 
-		int robot_disp_radius, int buffer_thickness, double scan_lag,
-		const cmd_parse & disassembler, const game_balance & balancer,
+		int curmatch, int maxmatch, matchid_t matchid, render_thread *
+		renderer, const cmd_parse & disassembler, const game_balance & balancer,
 		Font & stdfont, SDLHandler & SDLc, ConsoleKeyboard * ckbd,
 		vector<global_round_info> &
 		global_robot_stats, int & time_passed, 
-		ticktimer & kbd_trigger) {
+		ticktimer & kbd_trigger, parallel_cores * cpu_pool,
+		snapshot_settings & snapshots, replay_recorder * recorder,
+		state_hasher * hasher, periodic_detector * periods,
+		results_sink * results, results_cache * cache,
+		message_log & messages) {
 
 	size_t counter;
 	single_rand robot_state_rng(matchid, 0, RND_INIT);
+	double round_start = get_abs_time();
 
 	// Reset the robot CPUs as we don't want anything to carry over.
 	for (vector<corelogic>::iterator pos = core_store.cores.begin(); pos !=
@@ -641,10 +990,8 @@ bool run_round(bool print_outcomes, bool report_errors, bool verbose,
 
 	vector<robot> robots;
 
-	//vector<set<robot *> > comms_lookup(32767); // used for quick comms;
-	// the set is of robots at the channel given by the vector's index.
-	
 	int UID_count = 1;	// Not 0, since ATR2 counts from 1
+				// (for the prototypes)
 
 	// DONE: Is the weighting/maxweight part really needed? After all,
 	// compile checks it now.. But it might be useful in the case that
@@ -653,28 +1000,41 @@ bool run_round(bool print_outcomes, bool report_errors, bool verbose,
 	// Refactor in any case, so that it refers to core_store instead of
 	// through get_message/get_weighting.
 	
+	// The prototypes are made on the first round of the bout.
+	if (robot_prototypes.empty())
+		for (counter = 0; counter < filenames.size(); ++counter)
+			// Side effect: increments UID_count.
+			robot_prototypes.push_back(make_robot_prototype(
+					filenames[counter], robot_radius, 
+					UID_count, core_store, counter, 
+					maxweight, old_shields, max_CPU_speed, 
+					global_robot_stats[counter],
+					missile_insanity));
+
+	splash_grid placed;
+	placed.reset(arena_size, 0);
+
+	robots.reserve(filenames.size());
 	for (counter = 0; counter < filenames.size(); ++counter) {
-		// Side effect: increments UID_count.
-		robots.push_back(generate_robot(matchid, arena_size,
-					robot_state_rng, filenames[counter], 
-					robot_radius, UID_count, core_store, 
-					counter, maxweight, old_shields,
-					max_CPU_speed, global_robot_stats
-						[counter],missile_insanity));
+		robots.push_back(generate_robot(matchid, robot_state_rng,
+					robot_prototypes[counter],
+					global_robot_stats[counter]));
 		// Now set a random position for this bot.
 		place_robot_randomly(robot_state_rng, arena_size, robots,
-				counter, crash_range);
+				counter, crash_range, placed);
 	}
 
 	int statlet_offset = 0;
 
 	vector<robot>::iterator robot_pos;
-	list<robot *>::iterator lrobot_pos;
+	vector<robot *>::iterator lrobot_pos;
 
 	// Note that this must happen *AFTER* filling up the robots array,
 	// since push_back can alter pointers, and communications_channel
 	// uses pointers as reference. We should probably encapsulate this
-	// properly.
+	// properly. Anything left over from an earlier round that was cut
+	// short goes first.
+	comms_lookup.clear();
 	for (robot_pos = robots.begin(); robot_pos != robots.end(); 
 			++robot_pos)
 		// Register for comms
@@ -684,9 +1044,14 @@ bool run_round(bool print_outcomes, bool report_errors, bool verbose,
 
 	// Done initing robots.
 	
+	// For finding who's hit by blasts, and by whom.
+	splash_grid splash;
+	for (counter = 0; counter < robots.size(); ++counter)
+		splash.add_UID(robots[counter].get_UID(), counter);
+
 	// Set all as alive.
-	list<robot *> live_robots;
-	list<Unit *> live_units;
+	vector<robot *> live_robots;
+	vector<Unit *> live_units;
 
 	alias(robots, live_robots);
 	alias(robots, live_units);
@@ -696,25 +1061,10 @@ bool run_round(bool print_outcomes, bool report_errors, bool verbose,
 	double timeslice = cycles_per_step;
 	double cycles_per_sec = timeslice * framerate;
 
-	// Set some cosmetic defaults.
-	double sonar_lag = scan_lag * 3;   // Because sonar takes so long time
-	double radar_lag = scan_lag * 2.5; // Because the effect would be missed
-					   // otherwise.
-	double x_separation = 0.01;
-
 	int time_last_death = -1;
 
 	bool finished = false, abort = false;
 
-	Color black = palette.find("black")->second, 
-	      midgrey = palette.find("midgrey")->second,
-	      border_grey = palette.find("border_grey")->second,
-	      lightgrey = palette.find("lightgrey")->second,
-	      dkblue = palette.find("dkblue")->second,
-	      cyan = palette.find("cyan")->second,
-	      white(1, 1, 1),
-	      yellow(0, 1, 1);
-
 	// BLUESKY: Replace this with some nifty double precision "virtual
 	// framerate", where if real fps < virtual framerate, the rest is
 	// handled through frameskip.
@@ -733,21 +1083,155 @@ bool run_round(bool print_outcomes, bool report_errors, bool verbose,
 
 	bool only_one_at_start = (++live_robots.begin() == live_robots.end());
 
+	double last_error_summary = 0;	// Of repeated robot errors.
+
+	// If we're resuming, overwrite what we've just set up with the
+	// snapshot.
+	double last_snapshot_cycle = -1;
+
+	// A round that's resumed from a snapshot doesn't start out from the
+	// beginning, so leave it out of the cache.
+	bool cacheable = (cache != NULL && snapshots.resume == NULL);
+	uint64_t cache_key = 0;
+	if (cacheable)
+		cache_key = cache->make_key(matchid, global_robot_stats);
+
+	if (snapshots.resume != NULL) {
+		bool restored = restore_round_state(*snapshots.resume, 
+				current_cycle, time_last_death, 
+				only_one_at_start, robots, core_store, 
+				missiles, mines, explosions, comms_lookup,
+				live_robots, live_units);
+
+		// On failure, resume is left as is so main can tell.
+		if (!restored) return(false);
+		snapshots.resume = NULL;
+		last_snapshot_cycle = current_cycle;
+	}
+
+	if (periods != NULL)
+		periods->reset();
+
+	if (recorder != NULL)
+		recorder->begin_round(curmatch, maxmatch, matchid, maxcycles,
+				global_robot_stats);
+
 	string roundstats = "Match " + itos(curmatch) + "/" + itos(maxmatch) +
 		" (Match ID " + lltos(matchid) + ")";
 
-	if (&SDLc)
-		SDLc.set_title("K-Robots - " + roundstats, "K-Robots");
+	if (graphics) {
+		vector<string> names;
+		for (size_t counter = 0; counter < robots.size(); ++counter)
+			names.push_back(robots[counter].get_name());
+		renderer->begin_round(names, global_robot_stats, matchid,
+				curmatch, maxmatch, maxcycles);
+		renderer->set_title("K-Robots - " + roundstats, "K-Robots");
+	}
 
 	bool blocking = false;
 
 	// DEBUG
 	cout << roundstats << endl;
 
+	// If we already know how the round ends, skip right to it. Nothing
+	// was simulated, so no cycles have passed as far as the speed count
+	// is concerned.
+	int cached_cycles;
+	if (cacheable && cache->lookup(cache_key, robots, cached_cycles)) {
+		for (counter = 0; counter < robots.size(); ++counter) {
+			global_robot_stats[counter].add_information(robots[
+					counter].get_local_stats());
+			robots[counter].remove_communications_link(
+					comms_lookup);
+		}
+
+		if (print_outcomes)
+			print_round_outcome(curmatch, maxmatch, matchid, 
+					robots, global_robot_stats, 
+					per_round_tinfo);
+
+		if (results != NULL)
+			results->write_round(curmatch, matchid, cached_cycles,
+					get_abs_time() - round_start, robots);
+
+		time_passed = 0;
+		return(true);
+	}
+
 	double cps = 0;
 
 	while (!finished) {
 
+		// Save a snapshot if it's time to. This is done before
+		// anything else so that resuming takes us right back here.
+		if (current_cycle != last_snapshot_cycle && 
+				((int)current_cycle == snapshots.at_cycle ||
+				 (snapshots.every > 0 && current_cycle > 0 &&
+				  (int)current_cycle % snapshots.every == 0))) {
+			snapshot_writer out;
+			write_snapshot_header(out, filenames, curmatch, 
+					maxmatch, matchid, *snapshots.bout_rng,
+					global_robot_stats);
+			write_round_state(out, current_cycle, time_last_death,
+					only_one_at_start, robots, core_store,
+					missiles, mines, explosions);
+
+			if (!out.write_to(snapshots.filename))
+				cerr << "Error: Could not write snapshot to "
+					<< snapshots.filename << endl;
+			else if (messages.wants(LOG_EVENTS))
+				messages.write("[Main] Saved snapshot at "
+						"cycle " + itos(current_cycle)
+						+ "\n");
+
+			last_snapshot_cycle = current_cycle;
+		}
+
+		if (recorder != NULL && recorder->wants_frame(current_cycle))
+			recorder->record_frame(current_cycle, robots, missiles,
+					mines, explosions);
+
+		if (hasher != NULL && hasher->wants_hash(current_cycle))
+			hasher->hash_state(curmatch, current_cycle, robots,
+					core_store, missiles, mines);
+
+		// If the round has settled into a loop and nobody's about
+		// to win, skip ahead as far as we can by moving the state
+		// forward in time. What's left of the round is run as usual.
+		if (periods != NULL && time_last_death == -1 && 
+				periods->wants_check(current_cycle)) {
+			int skip = periods->check(current_cycle, maxcycles,
+					robots, core_store, missiles, mines);
+
+			if (skip > 0) {
+				snapshot_writer now;
+				now.set_time_base(current_cycle);
+				write_round_state(now, current_cycle, 
+						time_last_death, 
+						only_one_at_start, robots,
+						core_store, missiles, mines,
+						explosions);
+
+				snapshot_reader later;
+				later.set_data(now.get_data());
+				later.set_time_base(current_cycle + skip);
+				restore_round_state(later, current_cycle,
+						time_last_death, 
+						only_one_at_start, robots,
+						core_store, missiles, mines,
+						explosions, comms_lookup,
+						live_robots, live_units);
+
+				periods->extrapolate_stats(robots, skip);
+
+				if (messages.wants(LOG_EVENTS))
+					messages.write("[Main] Round is "
+							"periodic; skipped " +
+							itos(skip) + 
+							" cycles.\n");
+			}
+		}
+
 		// Check whether this round is over. Should perhaps be
 		// done after we've run the turn, to avoid off-by-ones.
 		if (current_cycle >= maxcycles) finished = true;
@@ -774,57 +1258,94 @@ bool run_round(bool print_outcomes, bool report_errors, bool verbose,
 		// Report debugging info if desired. Note that this is O(n)
 		// for mines and missiles.
 
-		if (verbose) {
-			cout << "[Main] Live robots left: " << live_robots.
-				size() << endl;
-			cout << "[Main] Missiles left: " << missiles.size() <<
-				endl;
-			cout << "[Main] Mines left: " << mines.size() << endl;
-			cout << "[Main] Cycle: " << current_cycle << endl;
+		if (messages.wants(LOG_CYCLES)) {
+			ostringstream info;
+			info << "[Main] Live robots left: " << live_robots.
+				size() << "\n";
+			info << "[Main] Missiles left: " << missiles.size() <<
+				"\n";
+			info << "[Main] Mines left: " << mines.size() << "\n";
+			info << "[Main] Cycle: " << current_cycle << "\n";
+			messages.write(info.str());
+		}
+
+		// Say how often the errors that are no longer shown in full
+		// happened, once in a while.
+		if (messages.wants(LOG_ERRORS) && current_cycle >= 
+				last_error_summary + 1000) {
+			messages.summarize_errors(false);
+			last_error_summary = current_cycle;
 		}
 
 		// Advance explosions (display effect) and robots before we
-		// render anything.
+		// render anything. Replays show explosions too, so keep
+		// them current when recording.
 
-		if (graphics)
+		if (graphics || recorder != NULL) {
+			PHASE_SCOPE(PH_EXPLOSIONS);
 			explosions.update_all(current_cycle);
+		}
 
 		// Advance ordnance state
 		advance_movement(robots, live_robots, missiles, mines, 
 				explosions, timeslice, current_cycle, 
 				robot_radius, crash_range, missile_hit_radius, 
-				arena_size);
+				arena_size, splash);
 
 		// Advance robot state and also see if someone died. If someone
 		// died, then we'll have to prune the live robot list later on,
 		// but there's no point in pruning it if not.
 		bool someone_died = false;
-		for (lrobot_pos = live_robots.begin(); lrobot_pos != 
-				live_robots.end(); ++lrobot_pos)
-			if (!(*lrobot_pos)->advance_internally(timeslice, 
-						balancer, explosions, robots))
-				someone_died = true;
+		{
+			PHASE_SCOPE(PH_INTERNAL);
+			for (lrobot_pos = live_robots.begin(); lrobot_pos != 
+					live_robots.end(); ++lrobot_pos)
+				if (!(*lrobot_pos)->advance_internally(
+							timeslice, balancer,
+							explosions, robots,
+							splash))
+					someone_died = true;
+		}
 
 		// Advance CPU
 		advance_CPUs(core_store, robots, live_units, missiles, 
 				mines, comms_lookup, disassembler, matchid,
-				arena_size, verbose, report_errors);
+				arena_size, messages, cpu_pool);
 
 		// Now that everything has been advanced by a step, set the
 		// clocks to match.
-		for (lrobot_pos = live_robots.begin(); lrobot_pos != 
-				live_robots.end(); ++lrobot_pos) {
-			// DEBUG: Check that time is correct.
-			assert((*lrobot_pos)->get_time() == current_cycle);
-			// Then advance the clock.
-			(*lrobot_pos)->tick(timeslice);
+		{
+			PHASE_SCOPE(PH_TICK);
+			for (lrobot_pos = live_robots.begin(); lrobot_pos != 
+					live_robots.end(); ++lrobot_pos) {
+				// DEBUG: Check that time is correct.
+				assert((*lrobot_pos)->get_time() == 
+						current_cycle);
+				// Then advance the clock.
+				(*lrobot_pos)->tick(timeslice);
+			}
 		}
 
 		// Remove dead robots, and advance the global clock.
 		// DONE: some sort of bool that tells us someone died. Maybe
 		// advance_internally returning false upon encountering
 		// someone who's dead.
+		if (someone_died && messages.wants_trace(TRACE_ON_DEATH))
+			for (lrobot_pos = live_robots.begin(); lrobot_pos !=
+					live_robots.end(); ++lrobot_pos)
+				if ((*lrobot_pos)->dead()) {
+					int idx = *lrobot_pos - &robots[0];
+					report_CPU_trace(core_store, idx,
+							**lrobot_pos,
+							"at death",
+							core_store.cores[idx].
+							get_instructions_run(),
+							disassembler, matchid,
+							messages);
+				}
+
 		if (someone_died) {
+			PHASE_SCOPE(PH_REALIAS);
 			realias(live_robots);
 			realias(live_units);
 		}
@@ -837,42 +1358,32 @@ bool run_round(bool print_outcomes, bool report_errors, bool verbose,
 
 		// Finally, render.
 		if (graphics && frameskip_counter > frameskip) {
+			PHASE_SCOPE(PH_RENDER);
+
 			if (frameskip_counter > framerate)
 				frameskip_counter = 0;
 
-			if (!renderer->render_all(x_separation, border_grey, 
-						white, black, dkblue, midgrey, 
-						lightgrey, lightgrey, white, 
-						yellow, cyan, matchid, 
-						current_cycle, maxcycles, 
-						curmatch, maxmatch, robots, 
-						missiles, mines, explosions,
-						robot_disp_radius, arena_size,
-						buffer_thickness, 
-						cycles_per_sec, scan_lag, 
-						sonar_lag, radar_lag, 
-						show_scanarcs, statlet_offset)){
-				cerr << "Error: Can't draw display!" << endl;
-
-				// Return empty result?
-			} else 
-				renderer->display();
+			// The render thread draws it while we go on.
+			renderer->publish(current_cycle, robots, missiles,
+					mines, explosions, cycles_per_sec,
+					show_scanarcs, statlet_offset);
 
 			SDLc.wait_for_frame_refresh(); // delay to fill fps
 		} 
 
 		// Check the timer as to whether we should check for a keypress.
-		// Utopia would be to use a separate thread, but I don't know 
-		// multithreading and I don't know if SDL is thread-safe anyway.
+		// SDL isn't thread-safe, so the events are read through the
+		// render thread, between frames.
 
 		kbd_trigger.increment_count();
 		if (kbd_trigger.ready()) {
+			PHASE_SCOPE(PH_KEYBOARD);
 			kbd_trigger.reset();
 
-			if (graphics && &SDLc) {
+			if (graphics) {
 				cps = cps * 0.8 + kbd_trigger.get_cps() * 0.2;
 
-				SDLc.set_title("K-Robots - " + roundstats +
+				renderer->set_title("K-Robots - " + roundstats +
 						" [" + dtos(cps, 1) + 
 						" cycles/sec]",
 						"K-Robots");
@@ -883,25 +1394,21 @@ bool run_round(bool print_outcomes, bool report_errors, bool verbose,
 			// This gets rid of MOUSEOVER and other irrelevant
 			// events. It slows down graphics a bit, but this isn't
 			// where the bottleneck lies.
-			while (graphics && (SDLc.get_next_event() != -1) && 
-					!blocking) {
-				int px;
-				switch(SDLc.get_last_event()) {
-					case SDL_VIDEORESIZE:
-						px = SDLc.get_event_resize().w;
+			while (graphics && !blocking) {
+				int px, key = renderer->get_next_key(px);
+				if (key == KEY_NONE) break;
 
+				switch(key) {
+					case KEY_RESIZED:
 						renderer->resize_displays(px,
 								arena_size);
 						break;
-					case SDL_QUIT:
+					case KEY_CLOSED:
 						keypress = 'Q';
 						blocking = true;
 						break;
-					case SDL_KEYDOWN:
-						keypress = 
-							translate_SDL_keypress(
-							 SDLc.
-							 get_event_keypress());
+					default:
+						keypress = key;
 						break;
 				}
 			} 
@@ -959,7 +1466,8 @@ bool run_round(bool print_outcomes, bool report_errors, bool verbose,
 						--statlet_offset;
 					break;
 				case 'D':
-					if (renderer->can_scroll_statlets(
+					if (graphics && renderer->
+							can_scroll_statlets(
 								statlet_offset
 								+1, robots.
 								size()))
@@ -975,11 +1483,22 @@ bool run_round(bool print_outcomes, bool report_errors, bool verbose,
 
 	time_passed = current_cycle;
 
+	if (messages.wants_trace(TRACE_AT_END))
+		for (counter = 0; counter < robots.size(); ++counter)
+			report_CPU_trace(core_store, counter, robots[counter],
+					"at end of round", core_store.
+					cores[counter].get_instructions_run(),
+					disassembler, matchid, messages);
+
+	// Get the messages out before the outcome is printed.
+	messages.summarize_errors(true);
+	messages.flush();
+
 	// Okay, the round has been played. If there's only one left standing, 
 	// he's the victor, so increment his victory count. Also, increment the
 	// rounds counter for all, and merge the local stats into the global 
 	// stats.
-	list<robot *>::const_iterator vpos = live_robots.begin();
+	vector<robot *>::const_iterator vpos = live_robots.begin();
 	vpos++;
 	bool only_one_survivor = (vpos == live_robots.end() &&
 			!live_robots.empty());
@@ -990,40 +1509,40 @@ bool run_round(bool print_outcomes, bool report_errors, bool verbose,
 			robots[counter].record_victory();
 
 		global_robot_stats[counter].add_information(robots[counter].
-				get_local_stats(), false);
+				get_local_stats());
+	}
+
+	// Record the final state, now that the stats are final too.
+	if (recorder != NULL) {
+		recorder->record_frame(current_cycle, robots, missiles, mines,
+				explosions);
+		recorder->end_round(current_cycle);
 	}
 
+	// And hash it, so that even the last few cycles are checked.
+	if (hasher != NULL)
+		hasher->hash_state(curmatch, current_cycle, robots, core_store,
+				missiles, mines);
+
 	// All done, output local stats.
-	if (print_outcomes) {
-		presenter present;
-		cout << "Match " << curmatch << "/" << maxmatch << " (Match ID "
-			<< matchid << ") results:";
-		cout << endl << endl;
-		string header = present.local_header();
-		cout << header << endl;
-		cout << string(header.size(), '~') << endl; 
-		for (counter = 0; counter < robots.size(); ++counter) 
-			cout << present.single_summary(robots[counter].
-					get_local_stats(),
-					*global_robot_stats[counter].get_sum(),
-					counter+1) << endl;
-		
-		// If user requested it, also print a machine-readable
-		// tournament info type output.
-		if (per_round_tinfo > 0) {
-			for (counter = 0; counter < robots.size(); ++counter) {
-				cout << "(" << matchid << "/ext)\t";
-				cout << present.get_tournament_line(
-						robots[counter].
-						get_local_stats(),
-						per_round_tinfo, 1) << endl;
-			}
-		}
+	if (print_outcomes)
+		print_round_outcome(curmatch, maxmatch, matchid, robots,
+				global_robot_stats, per_round_tinfo);
 
-		cout << endl;
-		// Status ("No clear victor", etc) goes here.
+	if (results != NULL)
+		results->write_round(curmatch, matchid, current_cycle,
+				get_abs_time() - round_start, robots);
+
+	if (cacheable && !abort)
+		cache->store(cache_key, robots, current_cycle);
 
+#ifdef PHASE_TIMING
+	if (messages.wants(LOG_EVENTS)) {
+		messages.write(phase_times.round_breakdown());
+		messages.flush();
 	}
+	phase_times.end_round();
+#endif
 
 	// If this isn't the last match, clean up the comms array and CPU
 	// memory so no information leaks from one round to the next. There's
@@ -1044,6 +1563,258 @@ bool run_round(bool print_outcomes, bool report_errors, bool verbose,
 	return(!abort);
 }
 
+// Plays back the rounds recorded in a replay log. In graphics mode, this shows
+// the rounds as they happened; otherwise, it just prints the outcomes. Either
+// way, global_robot_stats ends up as it would have after running the rounds.
+// Keys work as in run_round, and also:
+//	LEFT/RIGHT: Seek back or forward.
+//	+/-: Play slower or faster. Unlike a live round, a replay can go
+//		faster than real time without skipping frames since there are
+//		no CPUs to run.
+// Returns false if the user aborted.
+bool play_replay(replay_reader & replay, bool print_outcomes, 
+		int per_round_tinfo, bool graphics, bool show_scanarcs, 
+		int framerate, blasts explosions, render_thread * renderer,
+		const coordinate arena_size, SDLHandler & SDLc,
+		vector<global_round_info> & global_robot_stats, 
+		int & time_passed) {
+
+	size_t counter;
+
+	int statlet_offset = 0;
+
+	int speed = 1;			// Cycles to advance per frame shown.
+	const int max_speed = 1024;
+	const int seek_length = 1000;	// Cycles to seek per keypress.
+
+	bool abort = false;
+	time_passed = 0;
+
+	for (int round = 0; round < replay.get_num_rounds() && !abort; 
+			++round) {
+		const replay_round_index & info = replay.get_round(round);
+
+		if (!replay.get_round_stats(round, global_robot_stats)) {
+			cerr << "Error: Could not read round " << round + 1 <<
+				" of replay." << endl;
+			return(false);
+		}
+
+		vector<robot> robots = make_replay_robots(replay.get_names(),
+				global_robot_stats);
+		list<missile> missiles;
+		list<mine> mines;
+
+		int last_frame = info.frames.size() - 1;
+		int frame = graphics ? 0 : last_frame;
+		bool finished = false;
+
+		string roundstats = "Match " + itos(info.curmatch) + "/" + 
+			itos(info.maxmatch) + " (Match ID " + 
+			lltos(info.matchid) + ")";
+		cout << roundstats << " [replay]" << endl;
+
+		if (graphics) {
+			renderer->begin_round(replay.get_names(),
+					global_robot_stats, info.matchid,
+					info.curmatch, info.maxmatch,
+					info.maxcycles);
+			renderer->set_title("K-Robots - " + roundstats + 
+					" [replay]", "K-Robots");
+		}
+
+		while (!finished) {
+			if (!replay.get_frame(round, frame, robots, missiles,
+						mines, explosions)) {
+				cerr << "Error: Replay frame is damaged." <<
+					endl;
+				return(false);
+			}
+
+			if (frame == last_frame) finished = true;
+			if (!graphics) continue;
+
+			int cycle = info.frames[frame].cycle;
+
+			renderer->publish(cycle, robots, missiles, mines,
+					explosions, speed * framerate,
+					show_scanarcs, statlet_offset);
+
+			SDLc.wait_for_frame_refresh();
+
+			// Go to the frame speed cycles ahead, or the next
+			// one if that's further.
+			int next_frame = replay.find_frame(round, cycle + 
+					speed);
+			if (next_frame <= frame && frame < last_frame)
+				next_frame = frame + 1;
+
+			int keypress = -1;
+			while (keypress != 'Q') {
+				int px, key = renderer->get_next_key(px);
+				if (key == KEY_NONE) break;
+
+				switch(key) {
+					case KEY_RESIZED:
+						renderer->resize_displays(px,
+								arena_size);
+						break;
+					case KEY_CLOSED:
+						keypress = 'Q';
+						break;
+					default:
+						keypress = key;
+						break;
+				}
+			}
+
+			switch(keypress) {
+				case ' ':
+					finished = true;
+					break;
+				case 'Q':
+					finished = true;
+					abort = true;
+					break;
+				case 'W':
+					print_outcomes = !print_outcomes;
+					break;
+				case 'A':
+					show_scanarcs = !show_scanarcs;
+					break;
+				case '+':
+					if (speed > 1) speed /= 2;
+					break;
+				case '-':
+					if (speed < max_speed) speed *= 2;
+					break;
+				case '<':
+					next_frame = replay.find_frame(round,
+							cycle - seek_length);
+					finished = false;
+					break;
+				case '>':
+					next_frame = replay.find_frame(round,
+							cycle + seek_length);
+					break;
+				case 'U':
+					if (statlet_offset > 0) 
+						--statlet_offset;
+					break;
+				case 'D':
+					if (renderer->can_scroll_statlets(
+								statlet_offset
+								+1, robots.
+								size()))
+						++statlet_offset;
+					break;
+			}
+
+			frame = next_frame;
+		}
+
+		// Skipping ahead or aborting gives the outcome as recorded,
+		// not as of where we stopped.
+		if (frame != last_frame && !replay.get_frame(round, 
+					last_frame, robots, missiles, mines,
+					explosions)) {
+			cerr << "Error: Replay frame is damaged." << endl;
+			return(false);
+		}
+
+		time_passed += info.frames[last_frame].cycle;
+
+		for (counter = 0; counter < robots.size(); ++counter)
+			global_robot_stats[counter].add_information(
+					robots[counter].get_local_stats());
+
+		if (print_outcomes)
+			print_round_outcome(info.curmatch, info.maxmatch, 
+					info.matchid, robots, 
+					global_robot_stats, per_round_tinfo);
+	}
+
+	return(!abort);
+}
+
+// ------- Server mode ------
+
+// Runs the jobs sent to the server (see server.cc), each as its own bout,
+// with everything the job doesn't set taken from the command line. Set the
+// settings before serving. There's no graphics or keyboard, and nothing
+// is printed apart from the results.
+
+class bout_runner : public job_runner {
+	public:
+		double granularity;
+		int framerate;
+		bool old_shields;
+		int robot_radius, crash_range, missile_hit_radius;
+		coordinate arena_size;
+		int maxweight, min_victory_margin;
+		const cmd_parse * disassembler;
+		const game_balance * balancer;
+		Font * stdfont;
+		SDLHandler * SDLc;
+		const blasts * explosions;
+		int CPU_threads;
+		periodic_detector * periods;
+
+		void run(const server_job & job, core_storage & cores,
+				results_sink & results);
+};
+
+void bout_runner::run(const server_job & job, core_storage & cores,
+		results_sink & results) {
+
+	size_t counter;
+	vector<global_round_info> bot_stats;
+	for (counter = 0; counter < job.filenames.size(); ++counter)
+		bot_stats.push_back(global_round_info(snip_extraneous(
+						job.filenames[counter])));
+
+	// The round records include the CPU time.
+	for (counter = 0; counter < cores.cores.size(); ++counter)
+		cores.cores[counter].set_timing(true);
+
+	parallel_cores * cpu_pool = NULL;
+	if (CPU_threads > 1)
+		cpu_pool = new parallel_cores(CPU_threads, cores);
+
+	vector<robot> robot_prototypes;
+	comms_registry comms_lookup;
+	ticktimer kbd_trigger(1.0, 1);
+	message_log messages;		// Nothing but the results.
+
+	single_rand round_determine(random(), 0, RND_INIT);
+	snapshot_settings snapshots;
+	snapshots.at_cycle = -1;
+	snapshots.every = 0;
+	snapshots.resume = NULL;
+	snapshots.bout_rng = &round_determine;
+
+	int time_passed;
+	for (int curmatch = 1; curmatch <= job.rounds; ++curmatch) {
+		matchid_t matchid;
+		if (curmatch <= (int)job.matchids.size())
+			matchid = job.matchids[curmatch-1];
+		else	matchid = round_determine.irand();
+
+		run_round(false, false, false, granularity,
+			framerate, 0, cores, *explosions, job.filenames,
+			robot_prototypes, comms_lookup, old_shields,
+			job.max_CPU_speed, robot_radius, crash_range,
+			missile_hit_radius, job.missile_insanity, arena_size,
+			maxweight, job.maxcycles, min_victory_margin,
+			curmatch, job.rounds, matchid, NULL, *disassembler,
+			*balancer, *stdfont, *SDLc, NULL, bot_stats,
+			time_passed, kbd_trigger, cpu_pool, snapshots, NULL,
+			NULL, periods, &results, NULL, messages);
+	}
+
+	if (cpu_pool != NULL) delete cpu_pool;
+}
+
 map<string, Color> make_palette() {
 	map<string, Color> toRet;
 
@@ -1111,6 +1882,9 @@ void print_usage(string program_name) {
 	cout << "\t-r2\t\t Write basic bout info to ktr2.rep. " << endl;
 	cout << "\t-r3\t\t Write detailed bout info to ktr2.rep. " << endl;
 	cout << "\t-r4\t\t Write very detailed bout info to ktr2.rep. " << endl;
+	cout << "\t-r5\t\t As -r4, plus what each robot cost to simulate: "
+		<< "\n\t\t\tinstructions, port calls, interrupts, scans, "
+		<< "\n\t\t\tand nanoseconds spent running its CPU." << endl;
 	cout << "\t-i1\t\t Write per-round stats to console after each round"
 		<< "\n\t\t\t(simple)" << endl;
 	cout << "\t-i2\t\t Write per-round stats to console after each round"
@@ -1119,6 +1893,8 @@ void print_usage(string program_name) {
 		<< "\n\t\t\t(detailed)" << endl;
 	cout << "\t-i4\t\t Write per-round stats to console after each round"
 		<< "\n\t\t\t(very detailed)" << endl;
+	cout << "\t-i5\t\t Write per-round stats to console after each round"
+		<< "\n\t\t\t(very detailed, with costs as for -r5)" << endl;
 	cout << "\t-s\t\t Do not write any round- or bout outcome information "
 		<< endl << "\t\t\tto the console." << endl;
 	cout << "\t-v\t\t Be verbose - write information about compilation, as "
@@ -1127,6 +1903,24 @@ void print_usage(string program_name) {
 	cout << "\t-w\t\t Do not write any round outcome information to " 
 		<< "\n\t\t\tthe console, only the outcome of the entire bout."
 		<< endl;
+	cout << "\t--log <file>\t Write the robot errors and per-cycle " <<
+		"information\n\t\t\tto <file> instead of the console." <<
+		endl;
+	cout << "\t--error-repeats <num>\n\t\t\t Show the same robot error"
+		<< " in full at most <num>\n\t\t\ttimes a round (default 3),"
+		<< " and after that only\n\t\t\thow many more times it " <<
+		"happened. 0 shows all." << endl;
+	cout << "\t--trace <when>\t Show the last instructions each robot "
+		<< "ran, with their\n\t\t\toperands, registers and cost, "
+		<< "when it has an error\n\t\t\t(error), when it dies (death)"
+		<< " or at the end of\n\t\t\tthe round (end). May be given "
+		<< "more than once." << endl;
+	cout << "\t--trace-length <num>\n\t\t\t Show the last <num> "
+		<< "instructions (default 16)." << endl;
+	cout << "\t--time-budget <num>\n\t\t\t Play rounds (up to the " 
+		<< "number given by -m) only\n\t\t\tas long as the next one "
+		<< "is likely to finish within\n\t\t\t<num> seconds of "
+		<< "starting K-Robots." << endl;
 	cout << endl;
 	cout << "Compile-time options:" << endl;
 	cout << "\t-# <num>\t Limit the robots to a maximum of <num> " <<
@@ -1143,6 +1937,11 @@ void print_usage(string program_name) {
 	cout << "\t-l <num>\t Time out a round after <num> times thousand " <<
 		"\n\t\t\tcycles." << endl;
 	cout << "\t-m <num>\t Run a match of <num> rounds in all. " << endl;
+	cout << "\t-p <num>\t Run the robot CPUs on <num> threads. The outcome" <<
+		"\n\t\t\tis the same as with one thread, but robots that"<<
+		"\n\t\t\tcan change transponder or comms channel make"<<
+		"\n\t\t\tthe CPUs run one at a time while alive. Only"<<
+		"\n\t\t\tfaster with many robots or a high -t." << endl;
 	cout << "\t-t <num>\t Limit CPU execution time to <num> CPU cycles " <<
 		"\n\t\t\tper game cycle, maximum. #TIME limits apply if " <<
 		"\n\t\t\tlower than <num>." << endl;
@@ -1154,6 +1953,70 @@ void print_usage(string program_name) {
 	cout << "\t-% <num>\t Enable insane missiles. These missiles go at a "<<
 		"base\n\t\t\tspeed of (100.1 + 50 * num) m/s, subject to "<<
 		"overburn\n\t\t\tand #config boosts as usual." << endl;
+	cout << endl;
+	cout << "Snapshot options:" << endl;
+	cout << "\t--snapshot-at <num>\n\t\t\t Save the state of the round " <<
+		"when it reaches\n\t\t\tcycle <num>." << endl;
+	cout << "\t--snapshot-every <num>\n\t\t\t Save the state of the " <<
+		"round every <num> cycles." << endl;
+	cout << "\t--snapshot-file <file>\n\t\t\t Save snapshots to <file> " <<
+		"(default krobots.snap).\n\t\t\tEach snapshot replaces " <<
+		"the previous one." << endl;
+	cout << "\t--resume <file>\t Continue the bout from the snapshot in " <<
+		"<file>.\n\t\t\tThe robots and options must be the same as"<<
+		"\n\t\t\twhen the snapshot was saved." << endl;
+	cout << endl;
+	cout << "Replay options:" << endl;
+	cout << "\t--record <file>\t Record the rounds to the replay log " <<
+		"<file>." << endl;
+	cout << "\t--record-every <num>\n\t\t\t Record every <num> cycles " <<
+		"instead of every cycle,\n\t\t\tfor a smaller log." << endl;
+	cout << "\t--play <file>\t Play back the replay log <file>. No " <<
+		"robot files\n\t\t\tare needed. Left and right arrow keys " <<
+		"seek.\n\t\t\tWithout graphics, just prints the outcomes." <<
+		endl;
+	cout << endl;
+	cout << "Determinism checking options:" << endl;
+	cout << "\t--hash-every <num>\n\t\t\t Write a hash of the state of " <<
+		"the robots, CPUs,\n\t\t\tmissiles, mines and RNGs every " <<
+		"<num> cycles." << endl;
+	cout << "\t--hash-file <file>\n\t\t\t Write the hashes to <file> " <<
+		"(default krobots.hash)." << endl;
+	cout << "\t--hash-check <file>\n\t\t\t Compare the hashes to those " <<
+		"in <file>, written\n\t\t\tby an earlier run of the same bout,"
+		<< " and report where\n\t\t\tthey first differ." << endl;
+	cout << endl;
+	cout << "Results options:" << endl;
+	cout << "\t--results <target>\n\t\t\t After each round, append its " <<
+		"results to <target>:\n\t\t\ta file, - for standard output, "
+		<< "or fd:<num> for\n\t\t\tan open file descriptor." << endl;
+	cout << "\t--results-format <format>\n\t\t\t Write the results as " <<
+		"jsonl (one JSON object\n\t\t\tper round, the default) or " <<
+		"csv (one row per\n\t\t\trobot per round)." << endl;
+	cout << "\t--results-cache <file>\n\t\t\t Look up each round in " <<
+		"<file> and skip it if\n\t\t\tit's been run before with " <<
+		"the same robots\n\t\t\tand settings. New rounds are " <<
+		"added to it." << endl;
+	cout << "\t--distributions\t Show how each robot's stats were " <<
+		"spread\n\t\t\tover the rounds at the end of the bout." <<
+		endl;
+	cout << endl;
+	cout << "Speed options:" << endl;
+	cout << "\t--skip-periodic <num>\n\t\t\t Every <num> cycles, check " <<
+		"whether the round has\n\t\t\tsettled into a loop. If so, " <<
+		"skip ahead to the\n\t\t\tcycle limit with the stats " <<
+		"extrapolated." << endl;
+	cout << "\t--speed-file <file>\n\t\t\t Write cycles, instructions " <<
+		"and time taken to\n\t\t\t<file> as JSON, for " <<
+		"benchmark.sh." << endl;
+	cout << endl;
+	cout << "Server options:" << endl;
+	cout << "\t--serve <target>\n\t\t\t Stay resident and run the " <<
+		"jobs read from\n\t\t\t<target>, one per line: - for " <<
+		"standard input,\n\t\t\totherwise a Unix socket to listen " <<
+		"on. See\n\t\t\tserver.cc for the format." << endl;
+	cout << "\t--workers <num>\n\t\t\t Run up to <num> jobs at once." 
+		<< endl;
 }
 
 // Half-
@@ -1167,7 +2030,17 @@ bool setup_user_parameters(int argc, char * * argv,
 		bool & graphics, bool & text_input, bool & run_battles, 
 		bool & show_scanarcs, bool & report_errors, bool & old_shield,
 		bool & strict_compile, bool & display_speed_info,
-		vector<string> & filenames) {
+		int & CPU_threads, snapshot_settings & snapshots, 
+		string & resume_file, string & record_file, 
+		int & record_interval, string & play_file, 
+		string & hash_file, int & hash_interval, 
+		string & hash_check_file, int & periodic_interval,
+		string & speed_file, string & results_target,
+		results_format & results_type, bool & show_distributions,
+		string & cache_file, string & serve_target, int & workers,
+		string & log_file, int & error_repeats,
+		vector<bool> & trace_at, int & trace_length,
+		int & time_budget, vector<string> & filenames) {
 
 	int c, index;
 
@@ -1194,6 +2067,63 @@ bool setup_user_parameters(int argc, char * * argv,
 	// 	-q: Compatible compilation (quirks mode). (instead of Quiet)
 	// 	-s: Silent mode, report nothing.
 	// 	-z <num>: Force first battle to have MatchID <num>
+	// 	-p <num>: Run robot CPUs on <num> threads
+	//
+	// Long options (there aren't enough letters for everything):
+	// 	--snapshot-file <file>: Where to save snapshots
+	// 	--snapshot-at <num>: Save a snapshot when reaching cycle <num>
+	// 	--snapshot-every <num>: Save a snapshot every <num> cycles
+	// 	--resume <file>: Continue from a snapshot
+	// 	--record <file>: Record a replay log
+	// 	--record-every <num>: Record a replay frame every <num> cycles
+	// 	--play <file>: Play back a replay log
+	// 	--hash-every <num>: Hash the state every <num> cycles
+	// 	--hash-file <file>: Where to write the state hashes
+	// 	--hash-check <file>: Compare state hashes against <file>
+	// 	--skip-periodic <num>: Check for loops every <num> cycles
+	// 	--log <file>: Where to write robot errors and verbose info
+	// 	--error-repeats <num>: Show the same error <num> times a round
+	// 	--trace <when>: Show robots' last instructions on error, death
+	// 		or at the end of the round
+	// 	--trace-length <num>: Show the last <num> instructions
+	// 	--time-budget <num>: Stop starting rounds that won't finish
+	// 		within <num> seconds
+
+	enum { OPT_SNAPSHOT_FILE = 256, OPT_SNAPSHOT_AT, OPT_SNAPSHOT_EVERY,
+		OPT_RESUME, OPT_RECORD, OPT_RECORD_EVERY, OPT_PLAY,
+		OPT_HASH_EVERY, OPT_HASH_FILE, OPT_HASH_CHECK,
+		OPT_SKIP_PERIODIC, OPT_SPEED_FILE, OPT_RESULTS,
+		OPT_RESULTS_FORMAT, OPT_DISTRIBUTIONS, OPT_RESULTS_CACHE,
+		OPT_SERVE, OPT_WORKERS, OPT_LOG, OPT_ERROR_REPEATS,
+		OPT_TRACE, OPT_TRACE_LENGTH, OPT_TIME_BUDGET };
+
+	static struct option long_options[] = {
+		{"snapshot-file", required_argument, NULL, OPT_SNAPSHOT_FILE},
+		{"snapshot-at", required_argument, NULL, OPT_SNAPSHOT_AT},
+		{"snapshot-every", required_argument, NULL, OPT_SNAPSHOT_EVERY},
+		{"resume", required_argument, NULL, OPT_RESUME},
+		{"record", required_argument, NULL, OPT_RECORD},
+		{"record-every", required_argument, NULL, OPT_RECORD_EVERY},
+		{"play", required_argument, NULL, OPT_PLAY},
+		{"hash-every", required_argument, NULL, OPT_HASH_EVERY},
+		{"hash-file", required_argument, NULL, OPT_HASH_FILE},
+		{"hash-check", required_argument, NULL, OPT_HASH_CHECK},
+		{"skip-periodic", required_argument, NULL, OPT_SKIP_PERIODIC},
+		{"speed-file", required_argument, NULL, OPT_SPEED_FILE},
+		{"results", required_argument, NULL, OPT_RESULTS},
+		{"results-format", required_argument, NULL, 
+			OPT_RESULTS_FORMAT},
+		{"distributions", no_argument, NULL, OPT_DISTRIBUTIONS},
+		{"results-cache", required_argument, NULL, OPT_RESULTS_CACHE},
+		{"serve", required_argument, NULL, OPT_SERVE},
+		{"workers", required_argument, NULL, OPT_WORKERS},
+		{"log", required_argument, NULL, OPT_LOG},
+		{"error-repeats", required_argument, NULL, OPT_ERROR_REPEATS},
+		{"trace", required_argument, NULL, OPT_TRACE},
+		{"trace-length", required_argument, NULL, OPT_TRACE_LENGTH},
+		{"time-budget", required_argument, NULL, OPT_TIME_BUDGET},
+		{NULL, 0, NULL, 0}
+	};
 
 	// Arguments are case insensitive. Maybe make that lowercase only here.
 
@@ -1201,7 +2131,8 @@ bool setup_user_parameters(int argc, char * * argv,
 
 	bool success = true;
 
-	while ((c = getopt(argc, argv, "d:t:l:z:i:qsm:gr:cwvabe#:%:@")) != -1) {
+	while ((c = getopt_long(argc, argv, "d:t:l:z:i:qsm:gr:cwvabe#:%:@p:",
+					long_options, NULL)) != -1) {
 		if (optarg) 
 			ext = optarg;
 
@@ -1314,6 +2245,150 @@ bool setup_user_parameters(int argc, char * * argv,
 					else	missile_insanity = 0;
 				}
 				break; 
+			case 'p': // Parallel CPU threads
+				if (!is_integer(ext, false) || stoi(ext) <= 0) {
+					cerr << "Error: Invalid number of " <<
+						"threads specified." << endl;
+					success = false;
+				} else
+					CPU_threads = stoi(ext);
+				break;
+			case OPT_SNAPSHOT_FILE:
+				snapshots.filename = ext;
+				break;
+			case OPT_SNAPSHOT_AT:
+				if (!is_integer(ext, false) || stoi(ext) < 0) {
+					cerr << "Error: Invalid snapshot cycle"
+						<< " specified." << endl;
+					success = false;
+				} else
+					snapshots.at_cycle = stoi(ext);
+				break;
+			case OPT_SNAPSHOT_EVERY:
+				if (!is_integer(ext, false) || stoi(ext) <= 0) {
+					cerr << "Error: Invalid snapshot " <<
+						"interval specified." << endl;
+					success = false;
+				} else
+					snapshots.every = stoi(ext);
+				break;
+			case OPT_RESUME:
+				resume_file = ext;
+				break;
+			case OPT_RECORD:
+				record_file = ext;
+				break;
+			case OPT_RECORD_EVERY:
+				if (!is_integer(ext, false) || stoi(ext) <= 0) {
+					cerr << "Error: Invalid recording " <<
+						"interval specified." << endl;
+					success = false;
+				} else
+					record_interval = stoi(ext);
+				break;
+			case OPT_PLAY:
+				play_file = ext;
+				break;
+			case OPT_HASH_EVERY:
+				if (!is_integer(ext, false) || stoi(ext) <= 0) {
+					cerr << "Error: Invalid hashing " <<
+						"interval specified." << endl;
+					success = false;
+				} else {
+					hash_interval = stoi(ext);
+					if (hash_file.empty())
+						hash_file = "krobots.hash";
+				}
+				break;
+			case OPT_HASH_FILE:
+				hash_file = ext;
+				break;
+			case OPT_HASH_CHECK:
+				hash_check_file = ext;
+				break;
+			case OPT_SKIP_PERIODIC:
+				if (!is_integer(ext, false) || stoi(ext) <= 0) {
+					cerr << "Error: Invalid loop check " <<
+						"interval specified." << endl;
+					success = false;
+				} else
+					periodic_interval = stoi(ext);
+				break;
+			case OPT_SPEED_FILE:
+				speed_file = ext;
+				break;
+			case OPT_RESULTS:
+				results_target = ext;
+				break;
+			case OPT_RESULTS_FORMAT:
+				if (ext == "jsonl")
+					results_type = RF_JSONL;
+				else if (ext == "csv")
+					results_type = RF_CSV;
+				else {
+					cerr << "Error: Unknown results " <<
+						"format " << ext << endl;
+					success = false;
+				}
+				break;
+			case OPT_DISTRIBUTIONS:
+				show_distributions = true;
+				break;
+			case OPT_RESULTS_CACHE:
+				cache_file = ext;
+				break;
+			case OPT_SERVE:
+				serve_target = ext;
+				break;
+			case OPT_WORKERS:
+				if (!is_integer(ext, false) || stoi(ext) <= 0) {
+					cerr << "Error: Invalid number of " <<
+						"workers specified." << endl;
+					success = false;
+				} else
+					workers = stoi(ext);
+				break;
+			case OPT_LOG:
+				log_file = ext;
+				break;
+			case OPT_ERROR_REPEATS:
+				if (!is_integer(ext, false) || stoi(ext) < 0) {
+					cerr << "Error: Invalid number of " <<
+						"error repeats specified." << 
+						endl;
+					success = false;
+				} else
+					error_repeats = stoi(ext);
+				break;
+			case OPT_TRACE:
+				if (ext == "error")
+					trace_at[TRACE_ON_ERROR] = true;
+				else if (ext == "death")
+					trace_at[TRACE_ON_DEATH] = true;
+				else if (ext == "end")
+					trace_at[TRACE_AT_END] = true;
+				else {
+					cerr << "Error: Unknown trace event " <<
+						ext << endl;
+					success = false;
+				}
+				break;
+			case OPT_TRACE_LENGTH:
+				if (!is_integer(ext, false) || stoi(ext) < 1) {
+					cerr << "Error: Invalid trace length " <<
+						"specified." << endl;
+					success = false;
+				} else
+					trace_length = stoi(ext);
+				break;
+			case OPT_TIME_BUDGET:
+				if (!is_integer(ext, false) || stoi(ext) <= 0) {
+					cerr << "Error: Invalid time budget " <<
+						"specified." << endl;
+					success = false;
+				} else
+					time_budget = stoi(ext);
+				break;
 			case 'v': // Verbose
 				verbose = true;
 				break;
@@ -1368,6 +2443,9 @@ bool load_font(Font & destination, string filename) {
 
 int main(int argc, char * * argv) {
 
+	// The time budget counts compiling the robots too.
+	double launch_time = get_abs_time();
+
 	coordinate arena_size(1000, 1000);
 
 	// Set parameter defaults.
@@ -1399,6 +2477,42 @@ int main(int argc, char * * argv) {
 	bool use_predet_matchid = false;
 
 	int max_CPU_speed = 5;		// In CPU cycles per game cycle.
+	int CPU_threads = 1;		// Threads to run robot CPUs on.
+
+	snapshot_settings snapshots;	// No snapshots unless asked for.
+	snapshots.filename = "krobots.snap";
+	snapshots.at_cycle = -1;
+	snapshots.every = 0;
+	snapshots.resume = NULL;
+	snapshots.bout_rng = NULL;
+	string resume_file;		// Snapshot to resume from, if any.
+
+	string record_file;		// Replay log to record to, if any,
+	int record_interval = 1;	// and how many cycles between frames.
+	string play_file;		// Replay log to play back, if any.
+
+	string hash_file;		// State hashes to write, if any,
+	int hash_interval = 100;	// and how many cycles between them.
+	string hash_check_file;		// State hashes to compare against.
+
+	int periodic_interval = 0;	// Check for loops every this many
+					// cycles, or never if 0.
+	string speed_file;		// Where to write speed info as JSON.
+	string results_target;		// Where to write round results as
+	results_format results_type = RF_JSONL;	// data, if anywhere.
+	bool show_distributions = false;	// Summary of the stats over
+						// the rounds at the end.
+	string cache_file;		// Cache of round outcomes, if any.
+	string serve_target;		// Where to take jobs from in server
+	int workers = 1;		// mode, and how many to run at once.
+	string log_file;		// Where to write messages, if not to
+	int error_repeats = 3;		// the console, and how many times
+					// the same error is shown.
+	vector<bool> trace_at(TRACE_NUM_EVENTS, false);	// When to show
+	int trace_length = 16;		// the robots' last instructions, and
+					// how many.
+	int time_budget = 0;		// Seconds the bout must finish
+					// within, or 0 if there's no limit.
 	bool old_shields = false;	// Old shields take no damage upon hit.
 	bool report_errors = false;
 
@@ -1428,17 +2542,59 @@ int main(int argc, char * * argv) {
 			maxcycle, predet_matchid, verbose, print_outcomes, 
 			print_final_outcome, graphics, text_input, run_battles, 
 			show_scanarcs, report_errors, old_shields, 
-			strict_compile, show_speed_info, filenames);
+			strict_compile, show_speed_info, CPU_threads, 
+			snapshots, resume_file, record_file, record_interval,
+			play_file, hash_file, hash_interval, hash_check_file,
+			periodic_interval, speed_file, results_target,
+			results_type, show_distributions, cache_file, 
+			serve_target, workers, log_file, error_repeats, 
+			trace_at, trace_length, time_budget, filenames);
+
+	// When playing back, the robots are those in the recording.
+	replay_reader replay;
+	if (!play_file.empty() && correct_params) {
+		if (!replay.open(play_file))
+			return(-1);
+		if (!filenames.empty())
+			cout << "Warning: Playing back a replay, so the " << 
+				"robots given are ignored." << endl;
+		filenames = replay.get_names();
+	}
 
-	if (filenames.empty())
+	// The server gets its robots from the jobs.
+	if (!serve_target.empty()) {
+		if (!filenames.empty())
+			cout << "Warning: Running as a server, so the robots " 
+				<< "given are ignored." << endl;
+		filenames.clear();
+		graphics = false;
+		text_input = false;
+
+		if (!record_file.empty() || !hash_file.empty() ||
+				!hash_check_file.empty() || 
+				!results_target.empty() || !cache_file.empty()
+				|| snapshots.every > 0 || snapshots.at_cycle 
+				!= -1 || !resume_file.empty())
+			cout << "Warning: Replays, state hashes, snapshots, " <<
+				"--results and the results cache\nare not " <<
+				"available in server mode." << endl;
+		record_file.clear();
+		hash_file.clear();
+		hash_check_file.clear();
+		results_target.clear();
+		cache_file.clear();
+		snapshots.every = 0;
+		snapshots.at_cycle = -1;
+		resume_file.clear();
+	} else if (filenames.empty())
 		cerr << "Error: no robots specified." << endl;
 
-	if (filenames.empty() || !correct_params) {
+	if ((filenames.empty() && serve_target.empty()) || !correct_params) {
 		print_usage(argv[0]);
 		return(-1);
 	}
 	
-	if (filenames.size() == 1) {
+	if (filenames.size() == 1 && serve_target.empty()) {
 		cout << "Warning: Only one robot has been entered." << endl;
 	}
 
@@ -1446,6 +2602,11 @@ int main(int argc, char * * argv) {
 	if (!run_battles)
 		graphics = false;
 
+#ifdef NOSDL
+	// Built without SDL (see headless.cc), so there's nothing to show.
+	graphics = false;
+#endif
+
 	/////////////////////////////////////////////////////////////////////
 
 	ConsoleKeyboard * ckbd = NULL;
@@ -1491,32 +2652,156 @@ int main(int argc, char * * argv) {
 
 	///////////// Init weapons and comms structures /////////////
 
-	vector<set<robot *> > comms_lookup(65536); // Quite cumbersome.
-						   // Fixed bug that crashed
-						   // when negative channels
-						   // were specified.
+	comms_registry comms_lookup;
+	vector<robot> robot_prototypes;
 
 	///////////////////////////// Init robots ///////////////////
 
 	core_storage core_store(256);
+	vector<uint64_t> source_hashes;
 
-	if (!compile_robots(filenames, maxweight, maxlines, verbose,
-				strict_compile,	core_store))
+	// Replays don't need the programs.
+	if (play_file.empty() && !compile_robots(filenames, maxweight, 
+				maxlines, verbose, strict_compile, core_store,
+				source_hashes))
 		return(-1);
 
 	if (!run_battles)
 		return(0);
 
+	// Only time the CPUs if the times are going to be shown.
+	if (tournament_level >= 5 || per_round_tourn_level >= 5 ||
+			!results_target.empty())
+		for (size_t idx = 0; idx < core_store.cores.size(); ++idx)
+			core_store.cores[idx].set_timing(true);
+
+	parallel_cores * cpu_pool = NULL;
+	if (CPU_threads > 1 && play_file.empty() && serve_target.empty())
+		cpu_pool = new parallel_cores(CPU_threads, core_store);
+
 	vector<global_round_info> bot_stats;
+	vector<string> robot_names;
 	size_t counter;
 
-	for (counter = 0; counter < filenames.size(); ++counter)
-		bot_stats.push_back(global_round_info(snip_extraneous(
-						filenames[counter])));
+	for (counter = 0; counter < filenames.size(); ++counter) {
+		if (play_file.empty())
+			robot_names.push_back(snip_extraneous(filenames[
+						counter]));
+		else	robot_names.push_back(filenames[counter]);
+		bot_stats.push_back(global_round_info(robot_names[counter]));
+	}
+
+	state_hasher * hasher = NULL;
+	if ((!hash_file.empty() || !hash_check_file.empty()) && 
+			play_file.empty()) {
+		hasher = new state_hasher(hash_interval);
+		if (!hash_check_file.empty() && 
+				!hasher->open_reference(hash_check_file)) {
+			cerr << "Error: Could not read state hashes from " <<
+				hash_check_file << endl;
+			return(-1);
+		}
+		if (!hash_file.empty() && !hasher->open_output(hash_file)) {
+			cerr << "Error: Could not open hash file " << 
+				hash_file << " for writing!" << endl;
+			return(-1);
+		}
+	}
+
+	periodic_detector * periods = NULL;
+	if (periodic_interval > 0)
+		periods = new periodic_detector(periodic_interval);
+
+	results_sink * results = NULL;
+	if (!results_target.empty()) {
+		results = new results_sink();
+		if (!results->open(results_target, results_type)) {
+			cerr << "Error: Could not open " << results_target <<
+				" for writing results." << endl;
+			return(-1);
+		}
+	}
+
+	// Robot errors and per-cycle info are written by a thread of their
+	// own, so as not to hold up the rounds.
+	message_log messages;
+	for (int event = 0; event < TRACE_NUM_EVENTS; ++event)
+		messages.enable_trace((trace_event)event, trace_at[event]);
+	// A trace on error goes with the error.
+	messages.enable(LOG_ERRORS, report_errors || verbose ||
+			trace_at[TRACE_ON_ERROR]);
+	messages.enable(LOG_CYCLES, verbose);
+	messages.enable(LOG_EVENTS, verbose);
+	messages.set_max_repeats(error_repeats);
+	if (!log_file.empty() && !messages.set_file(log_file)) {
+		cerr << "Error: Could not open " << log_file << " for writing "
+			<< "messages." << endl;
+		return(-1);
+	}
+	if (report_errors || verbose || messages.wants_any_trace())
+		messages.start();
+
+	// Only keep the traces if they're going to be shown.
+	if (messages.wants_any_trace())
+		for (size_t idx = 0; idx < core_store.cores.size(); ++idx)
+			core_store.cores[idx].set_trace_length(trace_length);
+
+	// The cache would skip rounds that should be shown, recorded or
+	// checked, so it's only used when just the outcomes are wanted.
+	results_cache * cache = NULL;
+	if (!cache_file.empty() && play_file.empty()) {
+		if (graphics || !record_file.empty() || hasher != NULL)
+			cout << "Warning: Not using the results cache, since " 
+				<< "the rounds have to be run." << endl;
+		else {
+			cache = new results_cache();
+			if (!cache->open(cache_file)) {
+				cerr << "Error: Could not open results cache "
+					<< cache_file << endl;
+				return(-1);
+			}
+
+			// Everything that changes what happens in a round,
+			// apart from the robots and the Match ID.
+			snapshot_writer settings;
+			settings.put_int(maxlines);
+			settings.put_bool(strict_compile);
+			settings.put_int(maxweight);
+			settings.put_int(max_CPU_speed);
+			settings.put_int(robot_radius);
+			settings.put_int(crash_range);
+			settings.put_int(missile_hit_radius);
+			settings.put_int(missile_insanity);
+			settings.put_coordinate(arena_size);
+			settings.put_int(maxcycle);
+			settings.put_int(min_victory_margin);
+			settings.put_bool(old_shields);
+			settings.put_double(granularity);
+#ifdef PORTABLE_MATH
+			// Its rounds play out differently from the ordinary
+			// build's.
+			settings.put_bool(true);
+#endif
+
+			cache->set_bout(source_hashes, 
+					hash_bytes(settings.get_data()));
+		}
+	}
+
+	replay_recorder * recorder = NULL;
+	if (!record_file.empty() && play_file.empty()) {
+		recorder = new replay_recorder(record_interval);
+		if (!recorder->open(record_file, robot_names)) {
+			cerr << "Error: Could not open replay file " << 
+				record_file << " for writing!" << endl;
+			return(-1);
+		}
+	}
 
 	// Set up graphics if so required.
 	arena_disp * gui = NULL;
 	Display * vmem = NULL;
+	render_thread * drawer = NULL;
 
 	Font stdfont;
 
@@ -1536,9 +2821,12 @@ int main(int argc, char * * argv) {
 		}
 
 		if (!setup_graphics(vmem, gui, basis_x, basis_y, stdfont,
-					arena_size, core_store.get_num_cores()))
+					arena_size, filenames.size()))
 			return(-1);
 
+		drawer = new render_thread(*gui, SDLc, palette, explosions,
+				robot_disp_radius, buffer_thickness, 
+				arena_size, scan_lag);
 	}
 	
 	// ------------------------ DONE -------------------
@@ -1549,7 +2837,18 @@ int main(int argc, char * * argv) {
 	bool global_quit = false;
 
 	double start = get_abs_time();
-	int tot_cycles = 0, this_cycle = 0;
+	uint64_t tot_cycles = 0;
+	int this_cycle = 0;
+
+	// For the time budget: how many cycles the rounds that were simulated
+	// have taken, how long that took, and the most cycles any of them
+	// took. The next round is assumed to take as many cycles as that, at
+	// the speed so far. Rounds answered from the results cache take next
+	// to no time, so they're left out.
+	uint64_t budget_cycles = 0;
+	double rounds_time = 0;
+	int longest_round = 0;
+	bool out_of_time = false;
 
 	double kbd_check_rate;
 	if (graphics)
@@ -1562,36 +2861,155 @@ int main(int argc, char * * argv) {
 	game_balance balancer;
 	cmd_parse disassembler;
 
+	if (!serve_target.empty()) {
+		bout_runner runner;
+		runner.granularity = granularity;
+		runner.framerate = framerate;
+		runner.old_shields = old_shields;
+		runner.robot_radius = robot_radius;
+		runner.crash_range = crash_range;
+		runner.missile_hit_radius = missile_hit_radius;
+		runner.arena_size = arena_size;
+		runner.maxweight = maxweight;
+		runner.min_victory_margin = min_victory_margin;
+		runner.disassembler = &disassembler;
+		runner.balancer = &balancer;
+		runner.stdfont = &stdfont;
+		runner.SDLc = &SDLc;
+		runner.explosions = &explosions;
+		runner.CPU_threads = CPU_threads;
+		runner.periods = periods;
+
+		// A client that goes away shouldn't take the server with it.
+		signal(SIGPIPE, SIG_IGN);
+
+		match_server server(runner, workers, maxweight, maxlines,
+				strict_compile, maxcycle, max_CPU_speed,
+				missile_insanity);
+
+		if (serve_target == "-")
+			return(server.serve_stream(0, 1) ? 0 : -1);
+
+		server.serve_socket(serve_target);
+		cerr << "Error: Could not serve on socket " << serve_target 
+			<< endl;
+		return(-1);
+	}
+
 	use_predet_matchid = (predet_matchid != -1);
 
 	unsigned int seed = round(get_abs_time() * 1e3);
 	srandom(seed); // Bluesky: Use /dev/urandom
 
 	single_rand round_determine(random(), 0, RND_INIT);
+	snapshots.bout_rng = &round_determine;
+
+	int first_match = 1;
+
+	// If resuming, pick up where the snapshot left off: the match it was
+	// saved in, with the same Match ID, RNG state and stats so far. The
+	// rest of the snapshot is read by run_round.
+	snapshot_reader resume_from;
+	if (!resume_file.empty()) {
+		if (!resume_from.read_from(resume_file)) {
+			cerr << "Error: Could not read snapshot " << 
+				resume_file << endl;
+			return(-1);
+		}
+
+		int snap_matches;
+		if (!read_snapshot_header(resume_from, filenames, first_match,
+					snap_matches, predet_matchid, 
+					round_determine, bot_stats))
+			return(-1);
 
-	for (curmatch = 1; curmatch <= matches && !global_quit; ++curmatch) {
+		if (snap_matches != matches)
+			cout << "Warning: Snapshot was saved in a bout of " <<
+				snap_matches << " rounds, but " << matches << 
+				" were requested." << endl;
+
+		if (first_match > matches) {
+			cerr << "Error: Snapshot is from beyond the last " <<
+				"round." << endl;
+			return(-1);
+		}
+
+		use_predet_matchid = true;
+		snapshots.resume = &resume_from;
+	}
+
+	if (!play_file.empty()) {
+		global_quit = !play_replay(replay, print_outcomes, 
+				per_round_tourn_level, graphics, show_scanarcs,
+				framerate, explosions, drawer, arena_size,
+				SDLc, bot_stats, this_cycle);
+		tot_cycles += this_cycle;
+		matches = replay.get_num_rounds();
+	} else for (curmatch = first_match; curmatch <= matches && 
+			!global_quit; ++curmatch) {
 		// DEBUG: Just to make sure; might slow us down, later..
 		/*srandom(1);
 		srand(1);*/
 
+		// There's nothing to go by before the first round, so that
+		// one is always played.
+		if (time_budget > 0 && budget_cycles > 0) {
+			double next_round = longest_round * rounds_time / 
+				budget_cycles;
+			if (get_abs_time() - launch_time + next_round > 
+					time_budget) {
+				out_of_time = true;
+				break;
+			}
+		}
+		double round_start = get_abs_time();
+		int hits_before = 0;
+		if (cache != NULL) hits_before = cache->get_hits();
+
 		if (use_predet_matchid) {
 			matchid = predet_matchid;
 			use_predet_matchid = false;
 		} else
 			matchid = round_determine.irand();
 
-		global_quit = !run_round(print_outcomes, report_errors, verbose,
-			graphics, show_scanarcs, granularity, framerate,
+		global_quit = !run_round(print_outcomes, graphics,
+			show_scanarcs, granularity, framerate,
 			per_round_tourn_level, core_store, explosions,
-			filenames, comms_lookup, old_shields, max_CPU_speed, 
-			robot_radius, crash_range, missile_hit_radius,
-			missile_insanity, arena_size, maxweight, maxcycle, 
-			min_victory_margin, curmatch, matches, matchid, gui, 
-			palette, robot_disp_radius, buffer_thickness, scan_lag,
-			disassembler, balancer, stdfont, SDLc, ckbd,
-			bot_stats, this_cycle, kbd_trigger);
+			filenames, robot_prototypes, comms_lookup, old_shields,
+			max_CPU_speed, robot_radius, crash_range,
+			missile_hit_radius, missile_insanity, arena_size,
+			maxweight, maxcycle, min_victory_margin, curmatch,
+			matches, matchid, drawer, disassembler, balancer,
+			stdfont, SDLc, ckbd, bot_stats, this_cycle,
+			kbd_trigger, cpu_pool, snapshots, recorder, hasher,
+			periods, results, cache, messages);
+
+		// Couldn't restore the round, so there's nothing sensible to
+		// report.
+		if (snapshots.resume != NULL)
+			return(-1);
 
 		tot_cycles += this_cycle;
+
+		if (cache == NULL || cache->get_hits() == hits_before) {
+			budget_cycles += this_cycle;
+			rounds_time += get_abs_time() - round_start;
+			longest_round = max(longest_round, this_cycle);
+		}
+	}
+
+	// Then the outcomes are for the rounds that were played.
+	if (out_of_time) {
+		if (print_final_outcome)
+			cout << endl << "Out of time after " << curmatch - 1 <<
+				" of " << matches << " rounds." << endl;
+		matches = curmatch - 1;
+	}
+
+	bool diverged = false;
+	if (hasher != NULL) {
+		hasher->finish();
+		diverged = hasher->has_diverged();
 	}
 
 	presenter present;
@@ -1607,6 +3025,13 @@ int main(int argc, char * * argv) {
 					get_sum(), counter+1) << endl;
 	}
 
+	if (show_distributions) {
+		cout << endl;
+		for (counter = 0; counter < bot_stats.size(); ++counter)
+			cout << present.distribution(bot_stats[counter],
+					counter+1) << endl;
+	}
+
 	if (tournament_level > 0) {
 		ofstream tournament_out(tournament_file.c_str());
 
@@ -1627,17 +3052,78 @@ int main(int argc, char * * argv) {
 		tournament_out.close();
 	}
 
+	if (show_speed_info && cache != NULL)
+		cout << "Results cache: " << cache->get_hits() << 
+			" rounds known, " << cache->get_misses() << " run." <<
+			endl;
+
+	// Cycles skipped as periodic weren't simulated, so they don't count
+	// towards the speed.
+	uint64_t skipped_cycles = 0;
+	if (periods != NULL)
+		skipped_cycles = periods->get_cycles_skipped();
+	uint64_t simulated_cycles = tot_cycles - skipped_cycles;
+
 	// Deallocate
 
+	// The render thread uses the display, so stop it first.
+	if (drawer != NULL) delete drawer;
 	if (gui != NULL) delete gui;
 	if (vmem != NULL) delete vmem;
+	if (cpu_pool != NULL) delete cpu_pool;
+	if (recorder != NULL) delete recorder;
+	if (hasher != NULL) delete hasher;
+	if (periods != NULL) delete periods;
+	if (results != NULL) delete results;
+	if (cache != NULL) delete cache;
 	// ckbd gets removed by itself, since it's static.
 
 	// Finally, show how much time was used.
+	double span = get_abs_time() - start;
+
 	if (show_speed_info) {
-		double span = get_abs_time() - start;
-		cout << tot_cycles << " in " << span << " seconds, for an " <<
-			"average of " << tot_cycles/(double)span << " cps. " 
-			<< endl;
+		cout << simulated_cycles << " in " << span << " seconds, for "
+			<< "an average of " << simulated_cycles/(double)span <<
+			" cps. " << endl;
+		if (skipped_cycles > 0)
+			cout << skipped_cycles << " more skipped as periodic."
+				<< endl;
+	}
+
+#ifdef PHASE_TIMING
+	if (show_speed_info)
+		cout << endl << phase_times.bout_breakdown();
+#endif
+
+	// The same, for scripts. The instruction count is over every round,
+	// since the cores are kept between rounds.
+	if (!speed_file.empty()) {
+		uint64_t instructions = 0;
+		for (counter = 0; counter < core_store.cores.size(); ++counter)
+			instructions += core_store.cores[counter].
+				get_instructions_run();
+
+		ofstream speed_out(speed_file.c_str());
+		if (!speed_out) {
+			cerr << "Error: Could not open speed file " << 
+				speed_file << " for writing!" << endl;
+			return(-1);
+		}
+
+		speed_out.precision(9);
+		speed_out << "{\"cycles\": " << simulated_cycles << 
+			", \"skipped_cycles\": " << skipped_cycles <<
+			", \"instructions\": " << instructions << 
+			", \"seconds\": " << span << ", \"cps\": " << 
+			simulated_cycles/span << ", \"ips\": " << 
+			instructions/span;
+#ifdef PHASE_TIMING
+		speed_out << ", \"phases\": " << phase_times.bout_json();
+#endif
+		speed_out << "}" << endl;
 	}
+
+	// So that scripts checking for determinism can tell.
+	if (diverged) return(1);
+	return(0);
 }
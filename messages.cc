@@ -0,0 +1,296 @@
+// Messages from the simulation while it runs: the per-cycle information of
+// -v, the events that go with it (snapshots saved, periodic rounds skipped),
+// and the robot errors of -e.
+
+// Writing to the console is slow, and used to be done for every line, in the
+// middle of the simulation. Now the simulation hands the text to this class,
+// which puts it in a ring buffer, and a writer thread of its own takes it out
+// and writes it, to standard output or to a file (--log). Only the thread
+// running the rounds writes messages (the parallel CPUs report their errors
+// through it, see advance_CPUs), so the ring needs no locking: the simulation
+// only ever moves the head, the writer only the tail, and each publishes
+// what it's done through its own (atomic) index. If the ring is full, the
+// simulation waits for the writer; nothing is dropped.
+
+// Each kind of message can be turned on or off by itself. Formatting a
+// message is the expensive part, so check wants() before doing so.
+
+// A robot that has an error every cycle would fill the console with the same
+// line over and over. So the same error (same robot, same place, same kind)
+// is only shown in full the first few times in a round. After that it's
+// counted, and a line saying how many more times it happened is written now
+// and then (see summarize_errors) and at the end of the round.
+
+// A robot's instruction trace (see corelogic) can also be written when it
+// has an error (if the error is shown), when it dies, or at the end of the
+// round; which of these is wanted is kept here too.
+
+// Whatever goes to standard output directly, such as the round results, must
+// wait until the messages written before it are out, or the two will be
+// mixed up: call flush() first.
+
+#ifndef _KROB_MESSAGES
+#define _KROB_MESSAGES
+
+#include "tools.cc"
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <map>
+
+using namespace std;
+
+typedef enum log_category { LOG_CYCLES = 0, LOG_EVENTS = 1, LOG_ERRORS = 2,
+	LOG_NUM_CATEGORIES = 3 };
+
+typedef enum trace_event { TRACE_ON_ERROR = 0, TRACE_ON_DEATH = 1,
+	TRACE_AT_END = 2, TRACE_NUM_EVENTS = 3 };
+
+// What makes two errors the same.
+typedef struct error_key {
+	int robot_idx, IP, error;
+
+	bool operator<(const error_key & other) const;
+};
+
+bool error_key::operator<(const error_key & other) const {
+	if (robot_idx != other.robot_idx) return(robot_idx < other.robot_idx);
+	if (IP != other.IP) return(IP < other.IP);
+	return(error < other.error);
+}
+
+typedef struct error_repeats {
+	string description;	// As shown the first time
+	int times_seen;
+	int times_unshown;	// Since the last summary
+};
+
+class message_log {
+	private:
+		bool enabled[LOG_NUM_CATEGORIES];
+		bool traced[TRACE_NUM_EVENTS];
+
+		// The ring. Slots from tail up to head are waiting to be
+		// written. Head and tail only ever go up; the slot is the
+		// count modulo the ring size.
+		vector<string> ring;
+		size_t head, tail;
+
+		pthread_t writer;
+		bool running;
+		bool quitting;
+
+		ostream * out;
+		ofstream log_file;
+
+		int max_repeats;
+		map<error_key, error_repeats> repeats;
+
+		static void * writer_loop(void * us);
+		// Writes what's in the ring; returns false if there was
+		// nothing.
+		bool drain();
+
+	public:
+		message_log();
+		~message_log();
+
+		void enable(log_category category, bool on) {
+			enabled[category] = on; }
+		bool wants(log_category category) const {
+			return(enabled[category]); }
+
+		void enable_trace(trace_event event, bool on) {
+			traced[event] = on; }
+		bool wants_trace(trace_event event) const {
+			return(traced[event]); }
+		bool wants_any_trace() const;
+
+		// Write to this file instead of standard output. Must be
+		// called before start.
+		bool set_file(string filename);
+		// How many times the same error is shown in full in a round;
+		// 0 for every time.
+		void set_max_repeats(int max_repeats_in) {
+			max_repeats = max_repeats_in; }
+
+		// Starts the writer. Until then, messages are written
+		// directly.
+		void start();
+
+		// The text should end in a newline; it may be several lines.
+		void write(string text);
+		// Waits until everything written so far is out.
+		void flush();
+
+		// Returns true if this error should be shown; if so, call
+		// show_error with its description. Otherwise, it's counted
+		// for the next summary.
+		bool count_error(int robot_idx, int IP, int error);
+		void show_error(int robot_idx, int IP, int error,
+				string description);
+
+		// Writes how many times each error has happened since it
+		// was last summarized, if it wasn't shown. If end_of_round,
+		// starts over, so that errors in the next round are shown
+		// in full again.
+		void summarize_errors(bool end_of_round);
+};
+
+message_log::message_log() {
+	for (int counter = 0; counter < LOG_NUM_CATEGORIES; ++counter)
+		enabled[counter] = false;
+	for (int counter = 0; counter < TRACE_NUM_EVENTS; ++counter)
+		traced[counter] = false;
+
+	ring.resize(4096);
+	head = 0;
+	tail = 0;
+	running = false;
+	quitting = false;
+	out = &cout;
+	max_repeats = 3;
+}
+
+message_log::~message_log() {
+	if (!running) return;
+
+	flush();
+	__atomic_store_n(&quitting, true, __ATOMIC_RELEASE);
+	pthread_join(writer, NULL);
+}
+
+bool message_log::wants_any_trace() const {
+	for (int counter = 0; counter < TRACE_NUM_EVENTS; ++counter)
+		if (traced[counter]) return(true);
+
+	return(false);
+}
+
+bool message_log::set_file(string filename) {
+	log_file.open(filename.c_str());
+	if (!log_file) return(false);
+
+	out = &log_file;
+	return(true);
+}
+
+void message_log::start() {
+	if (running) return;
+
+	if (pthread_create(&writer, NULL, writer_loop, this) == 0)
+		running = true;
+}
+
+bool message_log::drain() {
+	size_t first = tail, last = __atomic_load_n(&head, __ATOMIC_ACQUIRE);
+
+	if (last == first) return(false);
+
+	for (size_t pos = first; pos != last; ++pos) {
+		string & text = ring[pos % ring.size()];
+		*out << text;
+		text.clear();
+	}
+	out->flush();
+
+	// Everything up to here is out and flushed, so the simulation can
+	// write to standard output once it sees this.
+	__atomic_store_n(&tail, last, __ATOMIC_RELEASE);
+	return(true);
+}
+
+void * message_log::writer_loop(void * us_in) {
+	message_log * us = (message_log *)us_in;
+
+	for (;;) {
+		if (us->drain()) continue;
+		if (__atomic_load_n(&us->quitting, __ATOMIC_ACQUIRE))
+			return(NULL);
+		usleep(1000);
+	}
+}
+
+void message_log::write(string text) {
+	if (!running) {
+		*out << text;
+		return;
+	}
+
+	// Wait for room.
+	while (head - __atomic_load_n(&tail, __ATOMIC_ACQUIRE) >= ring.size())
+		sched_yield();
+
+	ring[head % ring.size()].swap(text);
+	// The slot must be filled before the writer sees it.
+	__atomic_store_n(&head, head + 1, __ATOMIC_RELEASE);
+}
+
+void message_log::flush() {
+	if (!running) {
+		out->flush();
+		return;
+	}
+
+	while (__atomic_load_n(&tail, __ATOMIC_ACQUIRE) != head)
+		sched_yield();
+}
+
+bool message_log::count_error(int robot_idx, int IP, int error) {
+	error_key key;
+	key.robot_idx = robot_idx;
+	key.IP = IP;
+	key.error = error;
+
+	map<error_key, error_repeats>::iterator pos = repeats.find(key);
+
+	if (pos == repeats.end()) return(true);
+
+	++pos->second.times_seen;
+	if (max_repeats == 0 || pos->second.times_seen <= max_repeats)
+		return(true);
+
+	++pos->second.times_unshown;
+	return(false);
+}
+
+void message_log::show_error(int robot_idx, int IP, int error,
+		string description) {
+
+	error_key key;
+	key.robot_idx = robot_idx;
+	key.IP = IP;
+	key.error = error;
+
+	if (repeats.find(key) == repeats.end()) {
+		error_repeats & first = repeats[key];
+		first.description = description;
+		first.times_seen = 1;
+		first.times_unshown = 0;
+	}
+
+	write(description + "\n");
+}
+
+void message_log::summarize_errors(bool end_of_round) {
+	string summary;
+
+	for (map<error_key, error_repeats>::iterator pos = repeats.begin();
+			pos != repeats.end(); ++pos) {
+		if (pos->second.times_unshown == 0) continue;
+
+		summary += pos->second.description + " (" +
+			itos(pos->second.times_unshown) + " more times)\n";
+		pos->second.times_unshown = 0;
+	}
+
+	if (!summary.empty()) write(summary);
+
+	if (end_of_round) repeats.clear();
+}
+
+#endif
@@ -33,8 +33,25 @@ class mine : public Unit {
 		double get_hit_time() { return(hit_at); }
 		void explode();
 		bool should_explode() { return(s_explode); }
+
+		void save_state(snapshot_writer & out) const;
+		void load_state(snapshot_reader & in);
 };
 
+void mine::save_state(snapshot_writer & out) const {
+	Unit::save_state(out);
+	out.put_int(layer);
+	out.put_double(hit_at);
+	out.put_bool(s_explode);
+}
+
+void mine::load_state(snapshot_reader & in) {
+	Unit::load_state(in);
+	layer = in.get_int();
+	hit_at = in.get_double();
+	s_explode = in.get_bool();
+}
+
 void mine::update_hit_time(double relative_time) {
 	hit_at = relative_time;
 }
@@ -75,8 +75,29 @@ class missile : public Unit {
 				double impact_time, const coordinate 
 				robot_center_mass);
 
+		// The target only matters while handling a crash, so it
+		// isn't saved.
+		void save_state(snapshot_writer & out) const;
+		void load_state(snapshot_reader & in);
 };
 
+void missile::save_state(snapshot_writer & out) const {
+	Unit::save_state(out);
+	out.put_bool(overburning);
+	out.put_int(shooter);
+	out.put_double(hit_at);
+	out.put_double(base_weapon_power);
+}
+
+void missile::load_state(snapshot_reader & in) {
+	Unit::load_state(in);
+	overburning = in.get_bool();
+	shooter = in.get_int();
+	hit_at = in.get_double();
+	base_weapon_power = in.get_double();
+	target = NULL;
+}
+
 void missile::update_time_on_target(double relative_time) {
 	// Register that this is the time we hit.
 	hit_at = relative_time;
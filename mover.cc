@@ -15,6 +15,7 @@
 
 #include "tools.cc"
 #include "coordinate.cc"
+#include "snapshot.cc"
 #include <math.h>
 #include <assert.h>
 #include <iostream>	// required for min, for some reason
@@ -88,6 +89,8 @@ class Mover {
 
 		// Put/get
 		void set_desired_heading(double dshi);
+		// Face this way, as if we'd been made facing it.
+		void set_start_heading(double start_heading);
 		void set_desired_throttle(double dsv);
 		double get_heading() const { return(heading); }
 		double get_desired_heading() const { return(desired_heading); }
@@ -132,6 +135,11 @@ class Mover {
 		// parameters.
 		coordinate predict_motion(const coordinate & old_pos,
 				const double seconds_passed) const;
+
+		// Snapshots. Everything is saved, including the cache, so that
+		// a restored mover behaves exactly like the original.
+		void save_state(snapshot_writer & out) const;
+		void load_state(snapshot_reader & in);
 };
 
 // Setters
@@ -142,6 +150,15 @@ void Mover::set_desired_heading(double dshi) {
 	desired_heading = dshi;
 }
 
+void Mover::set_start_heading(double start_heading) {
+	heading = start_heading;
+	desired_heading = start_heading;
+	cached_heading = -1;
+	cached_mulcos = 1;
+	cached_mulsin = 0;
+	set_altered();
+}
+
 void Mover::set_desired_throttle(double dsv) {
 	double new_throttle = min(max_speed, max(min_speed, dsv));
 	if (new_throttle == desired_throttle) return;
@@ -204,8 +221,8 @@ coordinate Mover::predict_motion(const coordinate & old_pos,
 		cosval = cached_mulcos;
 		sinval = cached_mulsin;
 	} else {
-		cosval = cos(hex_to_radian(new_heading));
-		sinval = sin(hex_to_radian(new_heading));
+		cosval = phys_cos(hex_to_radian(new_heading));
+		sinval = phys_sin(hex_to_radian(new_heading));
 	}
 	
 	return(coordinate(
@@ -269,6 +286,9 @@ Mover::Mover(double smin, double smax, double multiplier,
 	desired_throttle = start_throttle;
 	speed_bonus = 0; // fixes valgrind error
 	cached_heading = -1;
+	does_crash = false;
+	cached_mulcos = 1;
+	cached_mulsin = 0;
 
 	set_speed_bonus(1); // Nothing special.
 	set_altered();
@@ -374,8 +394,10 @@ void Mover::move(const double cycles_passed) {
 
 		if (new_heading != cached_heading) {
 			cached_heading = new_heading;
-			cached_mulcos = cos(hex_to_radian(cached_heading));
-			cached_mulsin = sin(hex_to_radian(cached_heading));
+			cached_mulcos = phys_cos(hex_to_radian(
+						cached_heading));
+			cached_mulsin = phys_sin(hex_to_radian(
+						cached_heading));
 		}
 
 		// DEBUG
@@ -413,4 +435,47 @@ void Mover::move(const double cycles_passed) {
 
 }
 
+void Mover::save_state(snapshot_writer & out) const {
+	out.put_coordinate(position);
+	out.put_double(speed_multiplier);
+	out.put_double(speed_bonus);
+	out.put_double(min_speed);
+	out.put_double(max_speed);
+	out.put_double(throttle);
+	out.put_double(desired_throttle);
+	out.put_double(heading);
+	out.put_double(desired_heading);
+	out.put_double(degs_per_sec);
+	out.put_double(units_per_sec);
+	// The odometer only counts up. Robots that read it are kept track
+	// of elsewhere (robot::note_counter_read).
+	if (!out.comparing())
+		out.put_double(odometer);
+	out.put_bool(altered);
+	out.put_bool(does_crash);
+	out.put_double(cached_heading);
+	out.put_double(cached_mulcos);
+	out.put_double(cached_mulsin);
+}
+
+void Mover::load_state(snapshot_reader & in) {
+	position = in.get_coordinate();
+	speed_multiplier = in.get_double();
+	speed_bonus = in.get_double();
+	min_speed = in.get_double();
+	max_speed = in.get_double();
+	throttle = in.get_double();
+	desired_throttle = in.get_double();
+	heading = in.get_double();
+	desired_heading = in.get_double();
+	degs_per_sec = in.get_double();
+	units_per_sec = in.get_double();
+	odometer = in.get_double();
+	altered = in.get_bool();
+	does_crash = in.get_bool();
+	cached_heading = in.get_double();
+	cached_mulcos = in.get_double();
+	cached_mulsin = in.get_double();
+}
+
 #endif
@@ -80,7 +80,8 @@ class Unit : public Mover {
 					acceleration_rate, start_heading,
 					start_throttle, coordinate(0,0)) {
 				radius = radius_in; cloaked = is_cloaked; 
-			transponder = transponder_in; is_dead = false; }
+			transponder = transponder_in; is_dead = false; 
+			move_tus = 0; clear_crash(); other_throttle = 0; }
 
 		Unit(const coordinate & start_pos, double min_epower, 
 				double max_epower, double max_speed,
@@ -92,16 +93,42 @@ class Unit : public Mover {
 					acceleration_rate, start_heading,
 					start_velocity, start_pos) {
 				radius = radius_in; cloaked = is_cloaked; 
-			transponder = transponder_in; }
+			transponder = transponder_in; is_dead = false; 
+			move_tus = 0; clear_crash(); other_throttle = 0; }
 
 		//void move(double seconds_elapsed);
 
 		void cloak() { cloaked = true; }
 		void uncloak() { cloaked = false; }
-		bool is_cloaked() { return(cloaked); }
+		bool is_cloaked() const { return(cloaked); }
 
-		int get_radius() { return(radius); }
+		int get_radius() const { return(radius); }
 		void set_radius(unsigned int radius_in) { radius = radius_in; }
+
+		void save_state(snapshot_writer & out) const;
+		void load_state(snapshot_reader & in);
 };
 
+void Unit::save_state(snapshot_writer & out) const {
+	Mover::save_state(out);
+	out.put_bool(cloaked);
+	out.put_uint(radius);
+	out.put_int(transponder);
+	out.put_double(move_tus);
+	out.put_int(crashed_with);
+	out.put_double(other_throttle);
+	out.put_bool(is_dead);
+}
+
+void Unit::load_state(snapshot_reader & in) {
+	Mover::load_state(in);
+	cloaked = in.get_bool();
+	radius = in.get_uint();
+	transponder = in.get_int();
+	move_tus = in.get_double();
+	crashed_with = in.get_int();
+	other_throttle = in.get_double();
+	is_dead = in.get_bool();
+}
+
 #endif
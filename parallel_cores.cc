@@ -0,0 +1,213 @@
+// Run the robots' CPUs for a cycle on multiple threads.
+//
+// Within a cycle, robots only affect each other through missiles, mines,
+// transmissions, transponder IDs and comms channels. If none of the robots
+// alive can change their transponder or channel (see corelogic::
+// parallel_safe), the rest can be held back in per-robot queues
+// (deferred.cc) while every CPU runs against the same, unchanging view of the
+// arena. The caller then flushes the queues in robot order, which gives the
+// same result as running the CPUs one after another. If some live robot
+// isn't safe, can_run returns false and the caller should do it the usual
+// way.
+//
+// Starting threads is expensive compared to a single cycle, so the threads
+// are kept around and woken up by a barrier each cycle. The main thread does
+// a share of the work too. This only pays off with many robots or a high CPU
+// speed (-t); in small matches, the barriers take more time than the CPUs.
+
+#ifndef _KROB_PARCORES
+#define _KROB_PARCORES
+
+#include "robot.cc"
+#include "deferred.cc"
+#include "stored_cores.cc"
+#include "cpu/corelogic.cc"
+#include <pthread.h>
+#include <vector>
+#include <list>
+#include <set>
+
+using namespace std;
+
+class parallel_cores;
+
+typedef struct worker_info {
+	parallel_cores * owner;
+	int thread_number;
+};
+
+// An error, the IP of the instruction that caused it, and when it happened
+// (by the core's instruction count), so the trace can be cut off there.
+typedef struct core_error {
+	run_error error;
+	int IP;
+	uint64_t instruction;
+};
+
+class parallel_cores {
+	private:
+		int num_threads;
+		vector<pthread_t> workers;
+		vector<worker_info> worker_data;
+		pthread_barrier_t start_gate, end_gate;
+		bool quitting;
+
+		// Per core: can it be run in parallel? This doesn't change
+		// between rounds, so we only check once.
+		vector<bool> safe_core;
+
+		// Per robot: what it did this cycle.
+		vector<deferred_effects> effects;
+		vector<list<core_error> > errors;
+
+		// The cycle currently being run.
+		core_storage * cur_cores;
+		vector<robot> * cur_robots;
+		const vector<Unit *> * cur_live_units;
+		comms_registry * cur_comms_lookup;
+		coordinate cur_arena_size;
+		bool cur_log_errors;
+
+		static void * worker_loop(void * info);
+		void run_share(int thread_number);
+
+	public:
+		parallel_cores(int num_threads_in, const core_storage & cores);
+		~parallel_cores();
+
+		bool can_run(const vector<robot> & robots) const;
+
+		// Afterwards, the robots are still deferring: call
+		// flush_deferred_effects on each, in order.
+		void execute(core_storage & robot_cores, vector<robot> & robots,
+				const vector<Unit *> & live_units,
+				comms_registry & comms_lookup,
+				const coordinate arena_size, bool log_errors);
+
+		const list<core_error> & get_errors(int robot_idx) const {
+			return(errors[robot_idx]); }
+};
+
+parallel_cores::parallel_cores(int num_threads_in, const core_storage &
+		cores) {
+
+	assert(num_threads_in > 0);
+
+	num_threads = num_threads_in;
+	quitting = false;
+
+	for (size_t counter = 0; counter < cores.cores.size(); ++counter)
+		safe_core.push_back(cores.cores[counter].parallel_safe());
+
+	effects.resize(cores.cores.size());
+	errors.resize(cores.cores.size());
+
+	cur_cores = NULL;
+	cur_robots = NULL;
+	cur_live_units = NULL;
+	cur_comms_lookup = NULL;
+	cur_log_errors = false;
+
+	pthread_barrier_init(&start_gate, NULL, num_threads);
+	pthread_barrier_init(&end_gate, NULL, num_threads);
+
+	// Thread 0 is the main thread, so only start the others.
+	workers.resize(num_threads - 1);
+	worker_data.resize(num_threads - 1);
+	for (size_t counter = 0; counter < workers.size(); ++counter) {
+		worker_data[counter].owner = this;
+		worker_data[counter].thread_number = counter + 1;
+		pthread_create(&workers[counter], NULL, worker_loop,
+				&worker_data[counter]);
+	}
+}
+
+parallel_cores::~parallel_cores() {
+	quitting = true;
+	pthread_barrier_wait(&start_gate);
+
+	for (size_t counter = 0; counter < workers.size(); ++counter)
+		pthread_join(workers[counter], NULL);
+
+	pthread_barrier_destroy(&start_gate);
+	pthread_barrier_destroy(&end_gate);
+}
+
+void * parallel_cores::worker_loop(void * info) {
+	parallel_cores * us = ((worker_info *)info)->owner;
+	int thread_number = ((worker_info *)info)->thread_number;
+
+	for (;;) {
+		pthread_barrier_wait(&us->start_gate);
+		if (us->quitting) return(NULL);
+		us->run_share(thread_number);
+		pthread_barrier_wait(&us->end_gate);
+	}
+}
+
+// Robots are dealt out round robin. Which thread runs which robot doesn't
+// affect the outcome, so there's no need for anything fancier.
+void parallel_cores::run_share(int thread_number) {
+
+	for (size_t idx = thread_number; idx < cur_robots->size();
+			idx += num_threads) {
+		robot & shell = (*cur_robots)[idx];
+		corelogic & core = cur_cores->cores[idx];
+		deferred_effects & queue = effects[idx];
+
+		errors[idx].clear();
+		shell.defer_effects(&queue);
+
+		run_error cpu_error(ERR_NOERR);
+		int cycles_permitted = shell.withdraw_CPU_cycles();
+
+		// Same as the ordinary loop in advance_CPUs, except the
+		// missiles and mines end up in the queue.
+		while (cycles_permitted > 0 && !shell.dead()) {
+			if (!core.execute_multiple(cycles_permitted, shell,
+					*cur_live_units, queue.missiles,
+					queue.mines, *cur_comms_lookup, 1, 1,
+					cur_arena_size, false, cpu_error,
+					cycles_permitted)) {
+				shell.update_error(cpu_error);
+				if (cur_log_errors) {
+					core_error error;
+					error.error = cpu_error;
+					error.IP = core.get_old_IP();
+					error.instruction = core.
+						get_instructions_run();
+					errors[idx].push_back(error);
+				}
+			}
+		}
+	}
+}
+
+bool parallel_cores::can_run(const vector<robot> & robots) const {
+	for (size_t counter = 0; counter < robots.size(); ++counter)
+		if (!safe_core[counter] && !robots[counter].dead())
+			return(false);
+
+	return(true);
+}
+
+void parallel_cores::execute(core_storage & robot_cores,
+		vector<robot> & robots, const vector<Unit *> & live_units,
+		comms_registry & comms_lookup,
+		const coordinate arena_size, bool log_errors) {
+
+	assert(robots.size() <= effects.size());
+
+	cur_cores = &robot_cores;
+	cur_robots = &robots;
+	cur_live_units = &live_units;
+	cur_comms_lookup = &comms_lookup;
+	cur_arena_size = arena_size;
+	cur_log_errors = log_errors;
+
+	pthread_barrier_wait(&start_gate);
+	run_share(0);
+	pthread_barrier_wait(&end_gate);
+}
+
+#endif
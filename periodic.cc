@@ -0,0 +1,200 @@
+// Detection of rounds that have settled into a loop.
+
+// Many rounds run to the cycle limit with the robots doing the same thing
+// over and over. If the whole state of the round (robots, CPUs, missiles,
+// mines, random number generators) is the same at two points in time, then
+// everything that happens after the second point is a repeat of what
+// happened after the first, and we might as well skip ahead to the end.
+
+// "The same" here means the same up to a shift in time: points in time are
+// compared relative to the present (see snapshot_writer), and things that
+// only count up without affecting anything, like the statistics, are left
+// out. Some things count up but can be read by the robots: the clock, the
+// odometer, and the time since the robot was last hurt or hit something
+// (INT 11). A robot that reads any of these during the loop might act
+// differently later, so that keeps the round from being skipped.
+
+// Every so many cycles, the state is hashed and looked up among the hashes
+// seen before in the round. On a match, we have a candidate period. Then we
+// run for one more period, save the state at its start, and check that the
+// state at its end is exactly the same. If it is, we know how much the stats
+// change per period, and can skip whole periods up to the cycle limit,
+// leaving less than a period to run as usual.
+
+#ifndef _KROB_PERIODIC
+#define _KROB_PERIODIC
+
+#include "statehash.cc"
+#include "snapshot.cc"
+#include "robot.cc"
+#include "missile.cc"
+#include "mine.cc"
+#include "stored_cores.cc"
+#include "global_stats.cc"
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <list>
+#include <map>
+
+using namespace std;
+
+class periodic_detector {
+	private:
+		int interval;
+
+		// Hash of the state at each checked cycle so far.
+		map<uint64_t, int> seen;
+
+		// If confirm_at isn't -1, we're checking a candidate period
+		// that started with the given state and stats.
+		int confirm_at, period;
+		string period_start_state;
+		vector<round_info> period_start_stats;
+
+		// Over all rounds, so speed reports can leave these out.
+		uint64_t total_skipped;
+
+		string comparison_state(int cycle,
+				const vector<robot> & robots,
+				const core_storage & core_store,
+				const list<missile> & missiles,
+				const list<mine> & mines) const;
+
+	public:
+		periodic_detector(int interval_in);
+
+		// Forget everything; call at the start of each round.
+		void reset();
+
+		bool wants_check(double cycle) const;
+
+		// Returns how many cycles can be skipped, or 0 if none. If
+		// nonzero, the caller must move the state that far forward
+		// in time and then call extrapolate_stats.
+		int check(int cycle, int maxcycles,
+				const vector<robot> & robots,
+				const core_storage & core_store,
+				const list<missile> & missiles,
+				const list<mine> & mines);
+
+		void extrapolate_stats(vector<robot> & robots,
+				int cycles_skipped);
+
+		uint64_t get_cycles_skipped() const { return(total_skipped); }
+};
+
+periodic_detector::periodic_detector(int interval_in) {
+	interval = interval_in;
+	total_skipped = 0;
+	reset();
+}
+
+void periodic_detector::reset() {
+	seen.clear();
+	confirm_at = -1;
+	period = 0;
+	period_start_state.clear();
+	period_start_stats.clear();
+}
+
+bool periodic_detector::wants_check(double cycle) const {
+	// Time is only shifted by whole cycles.
+	if (cycle != (int)cycle) return(false);
+
+	if (confirm_at != -1) return((int)cycle == confirm_at);
+	return((int)cycle % interval == 0);
+}
+
+string periodic_detector::comparison_state(int cycle,
+		const vector<robot> & robots, const core_storage & core_store,
+		const list<missile> & missiles,
+		const list<mine> & mines) const {
+
+	snapshot_writer out;
+	out.set_comparison(true);
+	out.set_time_base(cycle);
+
+	// The RNGs are part of the robots already.
+	for (int counter = 0; counter < SP_RNGS; ++counter)
+		save_state_part((state_part)counter, out, robots, core_store,
+				missiles, mines);
+
+	return(out.get_data());
+}
+
+int periodic_detector::check(int cycle, int maxcycles,
+		const vector<robot> & robots, const core_storage & core_store,
+		const list<missile> & missiles, const list<mine> & mines) {
+
+	string state = comparison_state(cycle, robots, core_store, missiles,
+			mines);
+	size_t counter;
+
+	if (confirm_at == -1) {
+		uint64_t hash = hash_bytes(state);
+		map<uint64_t, int>::const_iterator pos = seen.find(hash);
+
+		if (pos == seen.end()) {
+			seen[hash] = cycle;
+			return(0);
+		}
+
+		// Not worth it if we'd be done before confirming.
+		period = cycle - pos->second;
+		if (cycle + 2 * period > maxcycles) {
+			seen[hash] = cycle;
+			return(0);
+		}
+
+		confirm_at = cycle + period;
+		period_start_state = state;
+		period_start_stats.clear();
+		for (counter = 0; counter < robots.size(); ++counter)
+			period_start_stats.push_back(robots[counter].
+					get_local_stats());
+		return(0);
+	}
+
+	// The hashes may have matched by accident, or a robot may have
+	// looked at a counter during the period. If so, start
+	// over.
+	bool confirmed = (state == period_start_state);
+	for (counter = 0; counter < robots.size() && confirmed; ++counter)
+		if (robots[counter].get_last_counter_read() >= confirm_at -
+				period)
+			confirmed = false;
+
+	confirm_at = -1;
+	period_start_state.clear();
+
+	if (!confirmed) {
+		seen.clear();
+		seen[hash_bytes(state)] = cycle;
+		return(0);
+	}
+
+	return(((maxcycles - cycle) / period) * period);
+}
+
+void periodic_detector::extrapolate_stats(vector<robot> & robots,
+		int cycles_skipped) {
+
+	for (size_t counter = 0; counter < robots.size(); ++counter) {
+		round_info per_period = robots[counter].get_local_stats();
+		for (int idx = 0; idx < META_RI_ALL; ++idx)
+			per_period.data[idx] -= period_start_stats[counter].
+				data[idx];
+
+		robots[counter].extrapolate_local_stats(per_period,
+				cycles_skipped / period);
+	}
+
+	total_skipped += cycles_skipped;
+
+	// Nothing more to find in this round.
+	seen.clear();
+	period_start_stats.clear();
+}
+
+#endif
@@ -0,0 +1,146 @@
+// Timing of the phases of the main loop: how much wall time goes to moving
+// things, running the robot CPUs, rendering, and so on.
+
+// This is only compiled in if PHASE_TIMING is defined (make krobots-phases).
+// Otherwise PHASE_SCOPE expands to nothing and none of this costs anything.
+
+// To time a phase, put PHASE_SCOPE(<phase>) at the start of a block; the
+// time until the end of the block is added to that phase. Phases can be
+// nested, in which case the inner ones (subphases) are counted as part of
+// the outer one as well. Totals are kept both for the current round and for
+// the whole bout.
+
+#ifndef _KROB_PHASETIME
+#define _KROB_PHASETIME
+
+#ifdef PHASE_TIMING
+
+#include "tools.cc"
+#include <stdint.h>
+#include <stdio.h>
+#include <iostream>
+#include <string>
+
+using namespace std;
+
+enum phase { PH_EXPLOSIONS = 0, PH_MOVEMENT, PH_TRACK_LIMITS,
+	PH_MISSILE_CRASHES, PH_MINE_CRASHES, PH_MOVES, PH_INTERNAL, PH_CPUS,
+	PH_TICK, PH_REALIAS, PH_RENDER, PH_KEYBOARD, PH_NUMPHASES };
+
+// Names, and how deep each phase is nested, for printing.
+const string phase_names[PH_NUMPHASES] = { "explosions", "movement",
+	"track_limits", "missile_crashes", "mine_crashes", "moves",
+	"internal", "cpus", "tick", "realias", "render", "keyboard" };
+const int phase_depth[PH_NUMPHASES] = { 0, 0, 1, 1, 1, 1, 0, 0, 0, 0, 0,
+	0 };
+
+class phase_timer {
+	private:
+		uint64_t round_ns[PH_NUMPHASES], bout_ns[PH_NUMPHASES];
+		uint64_t round_calls[PH_NUMPHASES], bout_calls[PH_NUMPHASES];
+
+		string breakdown(const uint64_t ns[PH_NUMPHASES],
+				const uint64_t calls[PH_NUMPHASES]) const;
+
+	public:
+		phase_timer();
+
+		void add(phase which, uint64_t ns) {
+			round_ns[which] += ns;
+			++round_calls[which];
+		}
+
+		// Adds the round to the bout and starts on a new one.
+		void end_round();
+
+		string round_breakdown() const { return(breakdown(round_ns,
+					round_calls)); }
+		string bout_breakdown() const { return(breakdown(bout_ns,
+					bout_calls)); }
+
+		// The bout totals as a JSON object.
+		string bout_json() const;
+};
+
+phase_timer::phase_timer() {
+	for (int counter = 0; counter < PH_NUMPHASES; ++counter) {
+		round_ns[counter] = 0; bout_ns[counter] = 0;
+		round_calls[counter] = 0; bout_calls[counter] = 0;
+	}
+}
+
+void phase_timer::end_round() {
+	for (int counter = 0; counter < PH_NUMPHASES; ++counter) {
+		bout_ns[counter] += round_ns[counter];
+		bout_calls[counter] += round_calls[counter];
+		round_ns[counter] = 0;
+		round_calls[counter] = 0;
+	}
+}
+
+// Percentages are of the sum of the top level phases. Snapshots, hashing
+// and other checkpoints aren't timed.
+string phase_timer::breakdown(const uint64_t ns[PH_NUMPHASES],
+		const uint64_t calls[PH_NUMPHASES]) const {
+
+	int counter;
+	uint64_t total = 0;
+	for (counter = 0; counter < PH_NUMPHASES; ++counter)
+		if (phase_depth[counter] == 0)
+			total += ns[counter];
+
+	string out = "Phase                 seconds      %       calls\n";
+	char line[128];
+
+	for (counter = 0; counter < PH_NUMPHASES; ++counter) {
+		snprintf(line, sizeof(line), "%*s%-*s %10.4f %6.1f %11llu\n",
+				2 * phase_depth[counter], "",
+				20 - 2 * phase_depth[counter],
+				phase_names[counter].c_str(), 
+				ns[counter] / 1e9,
+				total > 0 ? 100.0 * ns[counter] / total : 0.0,
+				(unsigned long long)calls[counter]);
+		out += line;
+	}
+
+	return(out);
+}
+
+string phase_timer::bout_json() const {
+	string out = "{";
+
+	for (int counter = 0; counter < PH_NUMPHASES; ++counter) {
+		if (counter > 0) out += ", ";
+		out += "\"" + phase_names[counter] + "\": {\"calls\": " +
+			lltos((long long)bout_calls[counter]) + 
+			", \"ns\": " + lltos((long long)bout_ns[counter]) +
+			"}";
+	}
+
+	return(out + "}");
+}
+
+phase_timer phase_times;
+
+// Adds the time from construction to destruction to the given phase.
+class phase_scope {
+	private:
+		phase which;
+		uint64_t start;
+
+	public:
+		phase_scope(phase which_in) { which = which_in;
+			start = get_monotonic_ns(); }
+		~phase_scope() { phase_times.add(which, get_monotonic_ns() -
+				start); }
+};
+
+#define PHASE_SCOPE(which) phase_scope phase_scope_##which(which)
+
+#else
+
+#define PHASE_SCOPE(which)
+
+#endif
+
+#endif
@@ -0,0 +1,188 @@
+// Portable trigonometry, for replaying matches the same way on any machine.
+
+// The simulation only uses +, -, *, /, sqrt, floor, round and fmod on doubles,
+// which IEEE 754 requires to give the correctly rounded (and so the same)
+// result everywhere, and sin, cos and atan2, which it doesn't: the C library
+// on one machine may be off by an ulp where another's isn't, and that's
+// enough for a robot to miss where it hit before. With PORTABLE_MATH defined,
+// the simulation uses the functions below instead, which are made from the
+// exact operations only, so that the same Match ID plays out the same on any
+// IEEE machine (x86-64, ARM, ...). They're as accurate as the C library's
+// to within an ulp or so, but not identical to them, so a portable build
+// doesn't replay matches from an ordinary build or vice versa.
+
+// The compiler must not fuse a*b+c into one instruction (which rounds once
+// instead of twice) or otherwise reorder arithmetic, because that changes
+// results too. GCC does the former by default on ARM, so build with
+// -ffp-contract=off and without -ffast-math; make krobots-portable does.
+
+// The polynomials and constants are those of fdlibm (Sun Microsystems, 1993):
+// "Permission to use, copy, modify, and distribute this software is freely
+// granted, provided that this notice is preserved."
+
+#ifndef _KROB_PORTABLE_MATH
+#define _KROB_PORTABLE_MATH
+
+#include <math.h>
+
+using namespace std;
+
+// sin and cos on [-pi/4, pi/4].
+double portable_sin_kernel(double x) {
+	const double S1 = -1.66666666666666324348e-01,
+	      S2 =  8.33333333332248946124e-03,
+	      S3 = -1.98412698298579493134e-04,
+	      S4 =  2.75573137070700676789e-06,
+	      S5 = -2.50507602534068634195e-08,
+	      S6 =  1.58969099521155010221e-10;
+
+	double z = x * x, v = z * x;
+	double r = S2 + z * (S3 + z * (S4 + z * (S5 + z * S6)));
+	return(x + v * (S1 + z * r));
+}
+
+double portable_cos_kernel(double x) {
+	const double C1 =  4.16666666666666019037e-02,
+	      C2 = -1.38888888888741095749e-03,
+	      C3 =  2.48015872894767294178e-05,
+	      C4 = -2.75573143513906633035e-07,
+	      C5 =  2.08757232129817482790e-09,
+	      C6 = -1.13596475577881948265e-11;
+
+	double z = x * x;
+	double r = z * (C1 + z * (C2 + z * (C3 + z * (C4 + z * (C5 +
+							z * C6)))));
+	return(1.0 - (0.5 * z - z * r));
+}
+
+// Brings x to [-pi/4, pi/4] and gives which quarter turn it came from. Pi/2 is
+// split in two so that subtracting multiples of it loses nothing; good for
+// the angles we see (a few turns either way), if not for huge ones.
+double portable_reduce(double x, int & quadrant) {
+	const double invpio2 = 6.36619772367581382433e-01,
+	      pio2_1 = 1.57079632673412561417e+00,
+	      pio2_1t = 6.07710050650619224932e-11;
+
+	double k = floor(x * invpio2 + 0.5);
+	quadrant = (int)fmod(k, 4);
+	if (quadrant < 0) quadrant += 4;
+
+	return((x - k * pio2_1) - k * pio2_1t);
+}
+
+double portable_sin(double x) {
+	if (!finite(x)) return(x - x);
+
+	int quadrant;
+	double r = portable_reduce(x, quadrant);
+
+	switch(quadrant) {
+		case 0: return(portable_sin_kernel(r));
+		case 1: return(portable_cos_kernel(r));
+		case 2: return(-portable_sin_kernel(r));
+		default: return(-portable_cos_kernel(r));
+	}
+}
+
+double portable_cos(double x) {
+	if (!finite(x)) return(x - x);
+
+	int quadrant;
+	double r = portable_reduce(x, quadrant);
+
+	switch(quadrant) {
+		case 0: return(portable_cos_kernel(r));
+		case 1: return(-portable_sin_kernel(r));
+		case 2: return(-portable_cos_kernel(r));
+		default: return(portable_sin_kernel(r));
+	}
+}
+
+double portable_atan(double x) {
+	const double atanhi[] = { 4.63647609000806093515e-01,
+		7.85398163397448278999e-01, 9.82793723247329054082e-01,
+		1.57079632679489655800e+00 };
+	const double atanlo[] = { 2.26987774529616870924e-17,
+		3.06161699786838301793e-17, 1.39033110312309984516e-17,
+		6.12323399573676603587e-17 };
+	const double aT[] = { 3.33333333333329318027e-01,
+		-1.99999999998764832476e-01, 1.42857142725034663711e-01,
+		-1.11111104054623557880e-01, 9.09088713343650656196e-02,
+		-7.69187620504482999495e-02, 6.66107313738753120669e-02,
+		-5.83357013379057348645e-02, 4.97687799461593236017e-02,
+		-3.65315727442169155270e-02, 1.62858201153657823623e-02 };
+
+	if (isnan(x)) return(x);
+
+	double ax = fabs(x);
+	int id;
+
+	if (ax >= 7.3786976294838206464e19)	// 2^66
+		return(copysign(atanhi[3] + atanlo[3], x));
+
+	if (ax < 0.4375) {
+		if (ax < 7.450580596923828125e-9) return(x);	// 2^-27
+		id = -1;
+	} else if (ax < 1.1875) {
+		if (ax < 0.6875) {
+			id = 0;
+			ax = (2.0 * ax - 1.0) / (2.0 + ax);
+		} else {
+			id = 1;
+			ax = (ax - 1.0) / (ax + 1.0);
+		}
+	} else if (ax < 2.4375) {
+		id = 2;
+		ax = (ax - 1.5) / (1.0 + 1.5 * ax);
+	} else {
+		id = 3;
+		ax = -1.0 / ax;
+	}
+
+	if (id < 0) ax = x;
+
+	double z = ax * ax, w = z * z;
+	double s1 = z * (aT[0] + w * (aT[2] + w * (aT[4] + w * (aT[6] +
+							w * (aT[8] + w * aT[10])))));
+	double s2 = w * (aT[1] + w * (aT[3] + w * (aT[5] + w * (aT[7] +
+							w * aT[9]))));
+
+	if (id < 0) return(ax - ax * (s1 + s2));
+
+	z = atanhi[id] - ((ax * (s1 + s2) - atanlo[id]) - ax);
+	return(copysign(z, x));
+}
+
+double portable_atan2(double y, double x) {
+	const double pi = 3.1415926535897931160e+00,
+	      pi_lo = 1.2246467991473531772e-16,
+	      pio2 = 1.5707963267948965580e+00;
+
+	if (isnan(x) || isnan(y)) return(x + y);
+
+	if (x == 0) {
+		if (y != 0) return(copysign(pio2, y));
+		// Signed zeroes, as in C.
+		if (signbit(x)) return(copysign(pi, y));
+		return(y);
+	}
+
+	double z = portable_atan(fabs(y / x));
+
+	if (x > 0) return(copysign(z, y));
+	return(copysign(pi - (z - pi_lo), y));
+}
+
+// What the simulation uses.
+
+#ifdef PORTABLE_MATH
+double phys_sin(double x) { return(portable_sin(x)); }
+double phys_cos(double x) { return(portable_cos(x)); }
+double phys_atan2(double y, double x) { return(portable_atan2(y, x)); }
+#else
+double phys_sin(double x) { return(sin(x)); }
+double phys_cos(double x) { return(cos(x)); }
+double phys_atan2(double y, double x) { return(atan2(y, x)); }
+#endif
+
+#endif
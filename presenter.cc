@@ -10,6 +10,7 @@
 #include "global_stats.cc"
 #include "tools.cc"
 #include <math.h>
+#include <stdio.h>
 #include <string>
 
 using namespace std;
@@ -35,6 +36,8 @@ class presenter {
 		string global_summary(const round_info & source, int idx);
 		string get_tournament_line(const round_info & source,
 				int detail_level, const double sum_of_how_many);
+		string distribution(const global_round_info & source,
+				int idx);
 };
 
 presenter::presenter() {
@@ -120,7 +123,7 @@ string presenter::single_summary(const round_info & source_local,
 	    shots = source_local.get_one(RI_SHOTSFIRED);
 
 	// Truncate robot name if there isn't any space for the full name.
-	string trunc_robot_name = source_local.robot_name;
+	string trunc_robot_name = source_local.robot_name();
 	if (trunc_robot_name.size() > namelen) {
 		trunc_robot_name.resize(namelen-3);
 		trunc_robot_name += "...";
@@ -160,7 +163,7 @@ string presenter::global_summary(const round_info & source, int idx) {
 	     deaths = source.get_one(RI_DEATHS),
 	     shots = source.get_one(RI_SHOTSFIRED);
 
-	string trunc_robot_name = source.robot_name;
+	string trunc_robot_name = source.robot_name();
 	if (trunc_robot_name.size() > namelen) {
 		trunc_robot_name.resize(namelen-3);
 		trunc_robot_name += "...";
@@ -182,6 +185,8 @@ string presenter::global_summary(const round_info & source, int idx) {
 // /R3:  Wins Trials Kills Deaths EndingArmor EndingHeat ShotsFired Name
 // /R4:  Wins Trials Kills Deaths EndingArmor EndingHeat ShotsFired Hits 
 // 		DamageTotal CyclesLived ErrorCount Name
+// /R5:  As R4, then Instructions PortCalls Interrupts Scans CPUNanoseconds
+// 		Name. (Not in ATR2.)
 string presenter::get_tournament_line(const round_info & source,
 		int detail_level, const double sum_of_how_many) {
 
@@ -195,17 +200,26 @@ string presenter::get_tournament_line(const round_info & source,
 	     hits = source.get_one(RI_HITS),
 	     damagetotal = source.get_one(RI_DAMAGE) * 100,
 	     cycleslived = source.get_one(RI_LIFESPAN),
-	     errorcount = source.get_one(RI_ERRORS);
+	     errorcount = source.get_one(RI_ERRORS),
+	     instructions = source.get_one(RI_INSTRUCTIONS),
+	     portcalls = source.get_one(RI_PORTCALLS),
+	     interrupts = source.get_one(RI_INTERRUPTS),
+	     scans = source.get_one(RI_SCANS),
+	     cputime = source.get_one(RI_CPUTIME);
 
-	string name = source.robot_name;
+	string name = source.robot_name();
 
 	string report = "";
 
 	if (detail_level < 1) detail_level = 1;
-	if (detail_level > 4) detail_level = 4;
+	if (detail_level > 5) detail_level = 5;
 
 	// Fallthrough makes this shorter.
 	switch(detail_level) {
+		case 5:
+			report = lltos(instructions) + " " + lltos(portcalls) +
+				" " + lltos(interrupts) + " " + lltos(scans) +
+				" " + lltos(cputime) + " " + report;
 		case 4:
 			report = lltos(hits) + " " + lltos(damagetotal) + " " +
 				lltos(cycleslived) + " " + lltos(errorcount) 
@@ -227,4 +241,34 @@ string presenter::get_tournament_line(const round_info & source,
 	return(report);
 }
 
+// How each statistic was distributed over the rounds: one line per
+// statistic with mean, standard deviation, minimum, 10th percentile, median,
+// 90th percentile and maximum. The percentiles are estimates (see
+// global_stats.cc), so they may not be any value that was actually seen.
+string presenter::distribution(const global_round_info & source, int idx) {
+
+	string toRet = right_just(itos(idx), num_len) + " - " +
+		source.get_sum()->robot_name() + "\n";
+
+	char line[160];
+	snprintf(line, sizeof(line), "%*s%-14s %11s %11s %11s %11s %11s %11s "
+			"%11s\n", num_len + 3, "", "Statistic", "Mean", 
+			"Std.dev", "Min", "10%", "Median", "90%", "Max");
+	toRet += line;
+
+	for (int counter = 0; counter < META_RI_ALL; ++counter) {
+		const stat_summary & dist = source.get_distribution(counter);
+		snprintf(line, sizeof(line), "%*s%-14s %11.5g %11.5g %11.5g "
+				"%11.5g %11.5g %11.5g %11.5g\n", num_len + 3,
+				"", info_names[counter].c_str(), 
+				dist.get_mean(), dist.get_stddev(), 
+				dist.get_min(), dist.get_quantile(0),
+				dist.get_quantile(1), dist.get_quantile(2), 
+				dist.get_max());
+		toRet += line;
+	}
+
+	return(toRet);
+}
+
 #endif
@@ -1,6 +1,7 @@
 #ifndef _KROB_RAND
 #define _KROB_RAND
 
+#include "snapshot.cc"
 #include <stdint.h>
 
 // Portable RNG, used for replaying matches with given Match IDs on different
@@ -29,6 +30,9 @@ class single_rand {
 				rnd_minors type_minor);
 		uint32_t irand();
 		double drand();
+
+		void save_state(snapshot_writer & out) const;
+		void load_state(snapshot_reader & in);
 };
 
 single_rand::single_rand(matchid_t seed, uint32_t type_major,
@@ -56,10 +60,29 @@ uint32_t single_rand::irand() {
 double single_rand::drand() {
 	double maximum = (double)((uint64_t)-1);
 	// Clock two then group since double is more finegrained than 2^-32.
-	uint64_t dx = ((uint64_t)irand()) << 32 + irand();
+	// (One at a time, so that they're drawn in the same order whatever
+	// the compiler.)
+	uint64_t dx = ((uint64_t)irand()) << 32;
+	dx += irand();
 	return(dx/maximum);
 }
 
+void single_rand::save_state(snapshot_writer & out) const {
+	out.put_uint(x);
+	out.put_uint(y);
+	out.put_uint(z);
+	out.put_uint(w);
+	out.put_uint(v);
+}
+
+void single_rand::load_state(snapshot_reader & in) {
+	x = in.get_uint();
+	y = in.get_uint();
+	z = in.get_uint();
+	w = in.get_uint();
+	v = in.get_uint();
+}
+
 /*
 #include <iostream>
 
@@ -0,0 +1,302 @@
+// Drawing the graphics mode display in a thread of its own, so that the
+// simulation doesn't have to wait for it.
+
+// At each frame, the simulation publishes the visible state of the arena,
+// serialized the same way as a replay frame (see replay.cc), and goes on.
+// The render thread takes the latest frame published, loads it into robots
+// of its own (again like the replay player does) and draws it. If the
+// simulation publishes faster than frames can be drawn, the frames that
+// weren't drawn in time are skipped. The simulation never waits for the
+// drawing, only for the frame rate (SDLHandler::wait_for_frame_refresh).
+
+// SDL isn't safe to use from more than one thread at once, so everything
+// that touches the window (drawing, resizing, the title, and reading
+// events) goes through this class, which takes turns.
+
+#ifndef _KROB_RENDER_THREAD
+#define _KROB_RENDER_THREAD
+
+#include "handler.cc"
+#include "arena_disp.cc"
+#include "replay.cc"
+#include "snapshot.cc"
+#include "color.cc"
+#include <pthread.h>
+#include <map>
+#include <string>
+#include <vector>
+#include <list>
+
+using namespace std;
+
+// Everything about a frame that isn't part of the arena state.
+typedef struct frame_info {
+	int cycle;
+	double cycles_per_sec;
+	bool show_scanarcs;
+	int statlet_offset;
+};
+
+class render_thread {
+	private:
+		arena_disp & renderer;
+		SDLHandler & SDLc;
+
+		pthread_t thread;
+		pthread_mutex_t frame_lock;	// For the pending state.
+		pthread_mutex_t video_lock;	// For using SDL at all.
+		pthread_cond_t frame_ready;
+		bool quitting;
+
+		// Set by the simulation, taken by the render thread.
+		bool new_round, new_frame;
+		vector<robot> pending_robots;
+		vector<global_round_info> pending_stats;
+		matchid_t pending_matchid;
+		int pending_curmatch, pending_maxmatch, pending_maxcycles;
+		string pending_frame;
+		frame_info pending_info;
+
+		// Only used by the render thread.
+		vector<robot> robots;
+		vector<global_round_info> stats;	// What robots point to
+		list<missile> missiles;
+		list<mine> mines;
+		blasts explosions;
+		matchid_t matchid;
+		int curmatch, maxmatch, maxcycles;
+
+		// Drawing settings.
+		Color black, midgrey, border_grey, lightgrey, dkblue, cyan,
+		      white, yellow;
+		int robot_disp_radius, buffer_thickness;
+		coordinate arena_size;
+		double scan_lag, sonar_lag, radar_lag, x_separation;
+
+		static void * render_loop(void * owner);
+		void draw(const string & frame, const frame_info & info);
+
+	public:
+		// The blasts are only used for their colors.
+		render_thread(arena_disp & renderer_in, SDLHandler & SDLc_in,
+				const map<string, Color> & palette,
+				const blasts & explosions_in,
+				int robot_disp_radius_in,
+				int buffer_thickness_in,
+				const coordinate arena_size_in,
+				double scan_lag_in);
+		~render_thread();
+
+		// Start of a round: the robots' names and stats so far.
+		void begin_round(const vector<string> & names,
+				const vector<global_round_info> &
+				global_robot_stats, matchid_t matchid_in,
+				int curmatch_in, int maxmatch_in,
+				int maxcycles_in);
+
+		// Hands a frame over to be drawn, replacing any that hasn't
+		// been drawn yet.
+		void publish(int cycle, const vector<robot> & robots_in,
+				const list<missile> & missiles_in,
+				const list<mine> & mines_in,
+				const blasts & explosions_in,
+				double cycles_per_sec, bool show_scanarcs,
+				int statlet_offset);
+
+		// The rest is the window, done between frames.
+		void set_title(string title, string minimized_title);
+		int get_next_key(int & new_width);
+		void resize_displays(int new_xsize, const coordinate
+				arena_size_in);
+		bool can_scroll_statlets(int scroll_number, int num_robots);
+};
+
+render_thread::render_thread(arena_disp & renderer_in,
+		SDLHandler & SDLc_in, const map<string, Color> & palette,
+		const blasts & explosions_in, int robot_disp_radius_in,
+		int buffer_thickness_in,
+		const coordinate arena_size_in, double scan_lag_in) :
+	renderer(renderer_in), SDLc(SDLc_in) {
+
+	black = palette.find("black")->second;
+	midgrey = palette.find("midgrey")->second;
+	border_grey = palette.find("border_grey")->second;
+	lightgrey = palette.find("lightgrey")->second;
+	dkblue = palette.find("dkblue")->second;
+	cyan = palette.find("cyan")->second;
+	white.set(1, 1, 1);
+	yellow.set(0, 1, 1);
+	explosions = explosions_in;
+
+	robot_disp_radius = robot_disp_radius_in;
+	buffer_thickness = buffer_thickness_in;
+	arena_size = arena_size_in;
+
+	scan_lag = scan_lag_in;
+	sonar_lag = scan_lag * 3;	// Because sonar takes so long time
+	radar_lag = scan_lag * 2.5;	// Because the effect would be missed
+					// otherwise.
+	x_separation = 0.01;
+
+	quitting = false;
+	new_round = false;
+	new_frame = false;
+	matchid = 0; curmatch = 0; maxmatch = 0; maxcycles = 0;
+
+	pthread_mutex_init(&frame_lock, NULL);
+	pthread_mutex_init(&video_lock, NULL);
+	pthread_cond_init(&frame_ready, NULL);
+
+	pthread_create(&thread, NULL, render_loop, this);
+}
+
+render_thread::~render_thread() {
+	pthread_mutex_lock(&frame_lock);
+	quitting = true;
+	pthread_cond_signal(&frame_ready);
+	pthread_mutex_unlock(&frame_lock);
+
+	pthread_join(thread, NULL);
+
+	pthread_cond_destroy(&frame_ready);
+	pthread_mutex_destroy(&video_lock);
+	pthread_mutex_destroy(&frame_lock);
+}
+
+void * render_thread::render_loop(void * owner) {
+	render_thread * us = (render_thread *)owner;
+	string frame;
+	frame_info info;
+
+	for (;;) {
+		pthread_mutex_lock(&us->frame_lock);
+		while (!us->quitting && !us->new_frame)
+			pthread_cond_wait(&us->frame_ready, &us->frame_lock);
+
+		if (us->quitting) {
+			pthread_mutex_unlock(&us->frame_lock);
+			return(NULL);
+		}
+
+		// The robots were made by the simulation thread, pointing at
+		// the pending stats, and swapping keeps them where they are.
+		if (us->new_round) {
+			us->robots.swap(us->pending_robots);
+			us->stats.swap(us->pending_stats);
+			us->matchid = us->pending_matchid;
+			us->curmatch = us->pending_curmatch;
+			us->maxmatch = us->pending_maxmatch;
+			us->maxcycles = us->pending_maxcycles;
+			us->new_round = false;
+		}
+
+		frame.swap(us->pending_frame);
+		info = us->pending_info;
+		us->new_frame = false;
+		pthread_mutex_unlock(&us->frame_lock);
+
+		us->draw(frame, info);
+	}
+}
+
+void render_thread::draw(const string & frame, const frame_info & info) {
+	snapshot_reader decoder;
+	decoder.set_data(frame);
+	read_arena_state(decoder, robots, missiles, mines, explosions);
+	if (!decoder.ok()) return;
+
+	pthread_mutex_lock(&video_lock);
+
+	if (!renderer.render_all(x_separation, border_grey, white, black,
+				dkblue, midgrey, lightgrey, lightgrey, white,
+				yellow, cyan, matchid, info.cycle, maxcycles,
+				curmatch, maxmatch, robots, missiles, mines,
+				explosions, robot_disp_radius, arena_size,
+				buffer_thickness, info.cycles_per_sec,
+				scan_lag, sonar_lag, radar_lag,
+				info.show_scanarcs, info.statlet_offset))
+		cerr << "Error: Can't draw display!" << endl;
+	else	renderer.display();
+
+	pthread_mutex_unlock(&video_lock);
+}
+
+void render_thread::begin_round(const vector<string> & names,
+		const vector<global_round_info> & global_robot_stats,
+		matchid_t matchid_in, int curmatch_in, int maxmatch_in,
+		int maxcycles_in) {
+
+	pthread_mutex_lock(&frame_lock);
+
+	// Making the robots here also puts their names in the name table
+	// (see global_stats.cc), so that loading frames in the render thread
+	// only ever reads from it.
+	pending_stats = global_robot_stats;
+	pending_robots = make_replay_robots(names, pending_stats);
+	pending_matchid = matchid_in;
+	pending_curmatch = curmatch_in;
+	pending_maxmatch = maxmatch_in;
+	pending_maxcycles = maxcycles_in;
+	new_round = true;
+
+	// A frame from the last round doesn't fit the new robots.
+	new_frame = false;
+
+	pthread_mutex_unlock(&frame_lock);
+}
+
+void render_thread::publish(int cycle, const vector<robot> & robots_in,
+		const list<missile> & missiles_in, const list<mine> & mines_in,
+		const blasts & explosions_in, double cycles_per_sec,
+		bool show_scanarcs, int statlet_offset) {
+
+	// Serialize before taking the lock so the render thread doesn't have
+	// to wait for it.
+	snapshot_writer frame;
+	write_arena_state(frame, robots_in, missiles_in, mines_in,
+			explosions_in);
+
+	pthread_mutex_lock(&frame_lock);
+
+	pending_frame = frame.get_data();
+	pending_info.cycle = cycle;
+	pending_info.cycles_per_sec = cycles_per_sec;
+	pending_info.show_scanarcs = show_scanarcs;
+	pending_info.statlet_offset = statlet_offset;
+	new_frame = true;
+	pthread_cond_signal(&frame_ready);
+
+	pthread_mutex_unlock(&frame_lock);
+}
+
+void render_thread::set_title(string title, string minimized_title) {
+	pthread_mutex_lock(&video_lock);
+	SDLc.set_title(title, minimized_title);
+	pthread_mutex_unlock(&video_lock);
+}
+
+int render_thread::get_next_key(int & new_width) {
+	pthread_mutex_lock(&video_lock);
+	int key = SDLc.get_next_key(new_width);
+	pthread_mutex_unlock(&video_lock);
+
+	return(key);
+}
+
+void render_thread::resize_displays(int new_xsize,
+		const coordinate arena_size_in) {
+	pthread_mutex_lock(&video_lock);
+	renderer.resize_displays(new_xsize, arena_size_in);
+	pthread_mutex_unlock(&video_lock);
+}
+
+bool render_thread::can_scroll_statlets(int scroll_number, int num_robots) {
+	pthread_mutex_lock(&video_lock);
+	bool can_scroll = renderer.can_scroll_statlets(scroll_number,
+			num_robots);
+	pthread_mutex_unlock(&video_lock);
+
+	return(can_scroll);
+}
+
+#endif
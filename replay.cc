@@ -0,0 +1,593 @@
+// Replay logs: a recording of what happened in each round, detailed enough to
+// show the rounds again through the ordinary display, but without needing the
+// robot programs or running any robot CPU.
+
+// The recording consists of frames, each of which is the visible state of the
+// arena (robots, missiles, mines and blasts) at some cycle, serialized the
+// same way as for snapshots. Most frames are stored as the difference from
+// the frame before, which is small since little changes from one cycle to
+// the next. Every so often there's a keyframe with the whole state, so that
+// the player can seek to any point by going to the closest keyframe before
+// it and applying the differences from there.
+
+// File layout: a header with the robot names, then a sequence of records,
+// each a tag byte, a cycle number and a length-prefixed payload:
+//	R - start of round: match numbers, Match ID, and the stats so far.
+//	K - keyframe: the full arena state.
+//	D - delta frame: differences from the previous frame.
+//	E - end of round.
+// Since every record carries its own length, the player can index a file
+// in one pass without decoding anything, and a recording that was cut short
+// is still readable up to where it ends.
+
+#ifndef _KROB_REPLAY
+#define _KROB_REPLAY
+
+#include "snapshot.cc"
+#include "robot.cc"
+#include "missile.cc"
+#include "mine.cc"
+#include "blast.cc"
+#include "colorman.cc"
+#include "game_balance.cc"
+#include "global_stats.cc"
+#include <fstream>
+#include <string>
+#include <vector>
+#include <list>
+
+using namespace std;
+
+const string replay_magic = "KROBREPL";
+const int replay_version = 3;
+
+// How many frames between keyframes. Lower makes seeking faster and the
+// file larger.
+const int replay_keyframe_interval = 256;
+
+// --- Arena state ---
+
+// This is everything the display needs to know to draw a frame. Snapshots
+// use it too, adding the CPUs and round bookkeeping.
+
+void write_arena_state(snapshot_writer & out, const vector<robot> & robots,
+		const list<missile> & missiles, const list<mine> & mines,
+		const blasts & explosions) {
+
+	for (size_t counter = 0; counter < robots.size(); ++counter)
+		robots[counter].save_state(out);
+
+	out.put_uint(missiles.size());
+	for (list<missile>::const_iterator pos = missiles.begin(); pos !=
+			missiles.end(); ++pos)
+		pos->save_state(out);
+
+	out.put_uint(mines.size());
+	for (list<mine>::const_iterator pos = mines.begin(); pos !=
+			mines.end(); ++pos)
+		pos->save_state(out);
+
+	explosions.save_state(out);
+}
+
+// The robots must already exist; see the comment on robot::load_state
+// regarding comms.
+void read_arena_state(snapshot_reader & in, vector<robot> & robots,
+		list<missile> & missiles, list<mine> & mines,
+		blasts & explosions) {
+
+	for (size_t counter = 0; counter < robots.size(); ++counter)
+		robots[counter].load_state(in);
+
+	// The constructor arguments don't matter, since loading overwrites
+	// all of them.
+	missiles.clear();
+	uint32_t num_ordnance = in.get_uint();
+	for (uint32_t counter = 0; counter < num_ordnance && in.ok();
+			++counter) {
+		missiles.push_back(missile(coordinate(0, 0), 0, 0, 0, false,
+					1, 0));
+		missiles.back().load_state(in);
+	}
+
+	mines.clear();
+	num_ordnance = in.get_uint();
+	for (uint32_t counter = 0; counter < num_ordnance && in.ok();
+			++counter) {
+		mines.push_back(mine(coordinate(0, 0), 0, 0));
+		mines.back().load_state(in);
+	}
+
+	explosions.load_state(in);
+}
+
+// Create robots to load replayed state into. Only the name, colors and
+// stats pointer matter, since everything else is overwritten by each frame.
+// The colors are picked the same way as generate_robot does.
+vector<robot> make_replay_robots(const vector<string> & names,
+		vector<global_round_info> & global_robot_stats) {
+
+	vector<robot> robots;
+	game_balance limits;
+	color_manager colorman;
+
+	for (size_t counter = 0; counter < names.size(); ++counter) {
+		int UID = counter + 1;
+		robot next(0, UID, names[counter], limits.get_min_throttle(),
+				limits.get_max_throttle(),
+				limits.get_speed_multiplier(),
+				limits.get_turn_rate(),
+				limits.get_accel_value(), 0, 0, 1,
+				limits.get_scanner_range(5), 16, 0, 1,
+				limits.get_heat_shutdown(),
+				limits.get_heat_hysteresis(),
+				limits.get_sonar_range(),
+				limits.get_missile_speed(), false,
+				&global_robot_stats[counter]);
+		next.set_colors(colorman.robot_color(UID, 1, 1),
+				colorman.shield_color(UID));
+		robots.push_back(next);
+	}
+
+	return(robots);
+}
+
+// --- Delta coding ---
+
+// Differences are stored as (skip, length, bytes) runs: skip this many bytes
+// that are the same as in the previous frame, then replace this many with
+// the bytes given. Short stretches of equal bytes are included in the
+// literal run, since a new run would cost more than it saves.
+
+void put_varint(string & out, uint32_t val) {
+	while (val >= 128) {
+		out.push_back((char)((val & 127) | 128));
+		val >>= 7;
+	}
+	out.push_back((char)val);
+}
+
+bool get_varint(const string & in, size_t & pos, uint32_t & val) {
+	val = 0;
+	for (int shift = 0; shift < 35 && pos < in.size(); shift += 7) {
+		unsigned char next = in[pos++];
+		val |= (uint32_t)(next & 127) << shift;
+		if (next < 128) return(true);
+	}
+	return(false);
+}
+
+string encode_delta(const string & old_frame, const string & new_frame) {
+	string out;
+	put_varint(out, new_frame.size());
+
+	const size_t min_gap = 4;
+	size_t pos = 0, last_end = 0;
+
+	while (pos < new_frame.size()) {
+		// Find the next byte that differs.
+		while (pos < new_frame.size() && pos < old_frame.size() &&
+				new_frame[pos] == old_frame[pos])
+			++pos;
+		if (pos == new_frame.size()) break;
+
+		// Then find where the difference ends: the first stretch of
+		// min_gap equal bytes, or the end.
+		size_t run_end = pos, same = 0;
+		while (run_end < new_frame.size() && same < min_gap) {
+			if (run_end < old_frame.size() && new_frame[run_end] ==
+					old_frame[run_end])
+				++same;
+			else	same = 0;
+			++run_end;
+		}
+		run_end -= same;
+
+		put_varint(out, pos - last_end);
+		put_varint(out, run_end - pos);
+		out.append(new_frame, pos, run_end - pos);
+
+		pos = run_end;
+		last_end = run_end;
+	}
+
+	return(out);
+}
+
+// Returns false if the delta is damaged.
+bool apply_delta(string & frame, const string & delta) {
+	size_t pos = 0;
+	uint32_t new_size, skip, length;
+
+	if (!get_varint(delta, pos, new_size)) return(false);
+	frame.resize(new_size);
+
+	size_t frame_pos = 0;
+	while (pos < delta.size()) {
+		if (!get_varint(delta, pos, skip) || !get_varint(delta, pos,
+					length))
+			return(false);
+		if (length > delta.size() - pos || frame_pos + skip + length >
+				new_size)
+			return(false);
+		frame_pos += skip;
+		frame.replace(frame_pos, length, delta, pos, length);
+		frame_pos += length;
+		pos += length;
+	}
+
+	return(true);
+}
+
+// --- Recording ---
+
+class replay_recorder {
+	private:
+		ofstream out;
+		string last_frame;
+		int frames_since_keyframe;
+		int interval;		// Record every this many cycles.
+
+		void write_record(char tag, int cycle, const string & payload);
+
+	public:
+		replay_recorder(int interval_in) { frames_since_keyframe = 0;
+			interval = interval_in; }
+
+		bool open(string filename, const vector<string> & names);
+
+		bool wants_frame(int cycle) const { 
+			return(cycle % interval == 0); }
+
+		void begin_round(int curmatch, int maxmatch, matchid_t matchid,
+				int maxcycles, const vector<global_round_info> &
+				global_robot_stats);
+		void record_frame(int cycle, const vector<robot> & robots,
+				const list<missile> & missiles,
+				const list<mine> & mines,
+				const blasts & explosions);
+		void end_round(int cycle);
+};
+
+void replay_recorder::write_record(char tag, int cycle,
+		const string & payload) {
+
+	string header(1, tag);
+	put_varint(header, cycle);
+	put_varint(header, payload.size());
+
+	out.write(header.data(), header.size());
+	out.write(payload.data(), payload.size());
+}
+
+bool replay_recorder::open(string filename, const vector<string> & names) {
+	out.open(filename.c_str(), ios::out | ios::binary | ios::trunc);
+	if (!out) return(false);
+
+	snapshot_writer header;
+	header.put_string(replay_magic);
+	header.put_int(replay_version);
+	header.put_uint(names.size());
+	for (size_t counter = 0; counter < names.size(); ++counter)
+		header.put_string(names[counter]);
+
+	out.write(header.get_data().data(), header.size());
+	return(out.good());
+}
+
+void replay_recorder::begin_round(int curmatch, int maxmatch,
+		matchid_t matchid, int maxcycles,
+		const vector<global_round_info> & global_robot_stats) {
+
+	snapshot_writer info;
+	info.put_int(curmatch);
+	info.put_int(maxmatch);
+	info.put_uint(matchid);
+	info.put_int(maxcycles);
+	for (size_t counter = 0; counter < global_robot_stats.size();
+			++counter)
+		global_robot_stats[counter].save_state(info);
+
+	write_record('R', 0, info.get_data());
+
+	// Each round starts with a keyframe.
+	last_frame.clear();
+	frames_since_keyframe = 0;
+}
+
+void replay_recorder::record_frame(int cycle, const vector<robot> & robots,
+		const list<missile> & missiles, const list<mine> & mines,
+		const blasts & explosions) {
+
+	snapshot_writer frame;
+	write_arena_state(frame, robots, missiles, mines, explosions);
+
+	if (last_frame.empty() || frames_since_keyframe >=
+			replay_keyframe_interval) {
+		write_record('K', cycle, frame.get_data());
+		frames_since_keyframe = 0;
+	} else {
+		write_record('D', cycle, encode_delta(last_frame,
+					frame.get_data()));
+		++frames_since_keyframe;
+	}
+
+	last_frame = frame.get_data();
+}
+
+// Flush at the end of each round so that a recording that's interrupted
+// still has every round that finished.
+void replay_recorder::end_round(int cycle) {
+	write_record('E', cycle, "");
+	out.flush();
+}
+
+// --- Playback ---
+
+typedef struct replay_frame_index {
+	int cycle;
+	streampos offset;	// Of the payload
+	uint32_t length;
+	bool keyframe;
+};
+
+typedef struct replay_round_index {
+	int curmatch, maxmatch;
+	matchid_t matchid;
+	int maxcycles;
+	streampos info_offset;
+	uint32_t info_length;
+	vector<replay_frame_index> frames;
+};
+
+class replay_reader {
+	private:
+		ifstream in;
+		vector<string> names;
+		vector<replay_round_index> rounds;
+
+		// The frame we currently have decoded, or -1 if none.
+		int cur_round, cur_frame;
+		string frame_data;
+
+		bool read_payload(streampos offset, uint32_t length,
+				string & dest);
+
+	public:
+		replay_reader() { cur_round = -1; cur_frame = -1; }
+
+		// Opens the file and indexes all the rounds in it.
+		bool open(string filename);
+
+		const vector<string> & get_names() const { return(names); }
+		int get_num_rounds() const { return(rounds.size()); }
+		const replay_round_index & get_round(int round) const {
+			return(rounds[round]); }
+
+		// Loads the stats as of the start of the round.
+		bool get_round_stats(int round, vector<global_round_info> &
+				global_robot_stats);
+
+		// Returns the index of the last frame at or before the
+		// given cycle (or the first frame if there's none).
+		int find_frame(int round, int cycle) const;
+
+		// Decodes the given frame into the given structures. Going
+		// forwards one frame at a time is cheap; anything else goes
+		// through the nearest keyframe.
+		bool get_frame(int round, int frame, vector<robot> & robots,
+				list<missile> & missiles, list<mine> & mines,
+				blasts & explosions);
+};
+
+bool replay_reader::read_payload(streampos offset, uint32_t length,
+		string & dest) {
+	dest.resize(length);
+	in.clear();
+	in.seekg(offset);
+	if (length > 0)
+		in.read(&dest[0], length);
+	return(in.good());
+}
+
+bool replay_reader::open(string filename) {
+	in.open(filename.c_str(), ios::in | ios::binary);
+	if (!in) {
+		cerr << "Error: Could not open replay file " << filename <<
+			endl;
+		return(false);
+	}
+
+	// The header is short, but we don't know how short, so read a
+	// generous amount and see how much was used.
+	string header_data(65536, 0);
+	in.read(&header_data[0], header_data.size());
+	header_data.resize(in.gcount());
+
+	snapshot_reader header;
+	header.set_data(header_data);
+
+	if (header.get_string() != replay_magic || header.get_int() !=
+			replay_version) {
+		cerr << "Error: " << filename << " is not a replay file, or "
+			<< "is from an incompatible version." << endl;
+		return(false);
+	}
+
+	uint32_t num_robots = header.get_uint();
+	for (uint32_t counter = 0; counter < num_robots && header.ok();
+			++counter)
+		names.push_back(header.get_string());
+
+	if (!header.ok()) {
+		cerr << "Error: Replay file header is damaged." << endl;
+		return(false);
+	}
+
+	in.clear();
+	in.seekg(0, ios::end);
+	streampos file_size = in.tellg();
+
+	// Now index the records. Stop at the first one that's incomplete;
+	// that's where recording was interrupted.
+	streampos pos = header.get_position();
+	string record_head;
+	bool in_round = false;
+
+	for (;;) {
+		in.clear();
+		in.seekg(pos);
+		record_head.resize(11);
+		in.read(&record_head[0], record_head.size());
+		record_head.resize(in.gcount());
+		if (record_head.empty()) break;
+
+		size_t head_pos = 1;
+		uint32_t cycle, length;
+		if (!get_varint(record_head, head_pos, cycle) ||
+				!get_varint(record_head, head_pos, length))
+			break;
+
+		streampos payload_at = pos + (streamoff)head_pos;
+		if (payload_at + (streamoff)length > file_size)
+			break;
+
+		char tag = record_head[0];
+		if (tag == 'R') {
+			string info;
+			if (!read_payload(payload_at, length, info)) break;
+			snapshot_reader info_in;
+			info_in.set_data(info);
+
+			replay_round_index next;
+			next.curmatch = info_in.get_int();
+			next.maxmatch = info_in.get_int();
+			next.matchid = info_in.get_uint();
+			next.maxcycles = info_in.get_int();
+			next.info_offset = payload_at;
+			next.info_length = length;
+			if (!info_in.ok()) break;
+
+			rounds.push_back(next);
+			in_round = true;
+		} else if ((tag == 'K' || tag == 'D') && in_round) {
+			// A round must start with a keyframe.
+			if (tag == 'D' && rounds.back().frames.empty())
+				break;
+			replay_frame_index next;
+			next.cycle = cycle;
+			next.offset = payload_at;
+			next.length = length;
+			next.keyframe = (tag == 'K');
+			rounds.back().frames.push_back(next);
+		} else if (tag == 'E' && in_round)
+			in_round = false;
+		else	break;
+
+		pos = payload_at + (streamoff)length;
+	}
+
+	if (pos != file_size)
+		cerr << "Warning: Replay file " << filename << " is cut short "
+			<< "or damaged. Playing what's there." << endl;
+
+	// Drop rounds without any frames; there's nothing to show.
+	while (!rounds.empty() && rounds.back().frames.empty())
+		rounds.pop_back();
+
+	if (rounds.empty()) {
+		cerr << "Error: Replay file " << filename << " contains no "
+			<< "rounds." << endl;
+		return(false);
+	}
+
+	return(true);
+}
+
+bool replay_reader::get_round_stats(int round, vector<global_round_info> &
+		global_robot_stats) {
+
+	string info;
+	if (!read_payload(rounds[round].info_offset,
+				rounds[round].info_length, info))
+		return(false);
+
+	snapshot_reader info_in;
+	info_in.set_data(info);
+	info_in.get_int();
+	info_in.get_int();
+	info_in.get_uint();
+	info_in.get_int();
+
+	for (size_t counter = 0; counter < global_robot_stats.size();
+			++counter)
+		global_robot_stats[counter].load_state(info_in);
+
+	return(info_in.ok());
+}
+
+int replay_reader::find_frame(int round, int cycle) const {
+	const vector<replay_frame_index> & frames = rounds[round].frames;
+
+	// Binary search for the first frame past the cycle.
+	int low = 0, high = frames.size();
+	while (low < high) {
+		int mid = (low + high) / 2;
+		if (frames[mid].cycle <= cycle)
+			low = mid + 1;
+		else	high = mid;
+	}
+
+	return(max(0, low - 1));
+}
+
+bool replay_reader::get_frame(int round, int frame, vector<robot> & robots,
+		list<missile> & missiles, list<mine> & mines,
+		blasts & explosions) {
+
+	const vector<replay_frame_index> & frames = rounds[round].frames;
+	if (frame < 0 || frame >= (int)frames.size()) return(false);
+
+	// If we can't just go forwards from where we are, go back to the
+	// keyframe.
+	int start = cur_frame + 1;
+	if (round != cur_round || frame < cur_frame || cur_frame == -1) {
+		start = frame;
+		while (!frames[start].keyframe)
+			--start;
+	} else {
+		// If there's a keyframe on the way, start there instead.
+		for (int counter = frame; counter > cur_frame; --counter)
+			if (frames[counter].keyframe) {
+				start = counter;
+				break;
+			}
+	}
+
+	string payload;
+	for (int counter = start; counter <= frame; ++counter) {
+		if (!read_payload(frames[counter].offset,
+					frames[counter].length, payload)) {
+			cur_round = -1;
+			return(false);
+		}
+
+		if (frames[counter].keyframe)
+			frame_data = payload;
+		else if (!apply_delta(frame_data, payload)) {
+			cur_round = -1;
+			return(false);
+		}
+	}
+
+	cur_round = round;
+	cur_frame = frame;
+
+	snapshot_reader decoder;
+	decoder.set_data(frame_data);
+	read_arena_state(decoder, robots, missiles, mines, explosions);
+
+	return(decoder.ok() && decoder.at_end());
+}
+
+#endif
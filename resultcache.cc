@@ -0,0 +1,279 @@
+// Cache of round outcomes, so that rounds that have been run before don't
+// have to be run again.
+
+// A round is deterministic given the robot programs, the game settings, the
+// Match ID, and the stats from earlier rounds in the bout (since robots can
+// read their kill and death counts and so on). If all of those are the same
+// as for a round that's in the cache, we can just take the stats from there
+// instead of running it. This is mostly useful for ladders and tournaments
+// that run the same pairings with the same Match IDs (-z) over and over.
+
+// The robots are identified by a hash of their source, not their names, and
+// their order matters: it decides their IDs and where they start out. The
+// settings are given as a fingerprint computed by the caller; anything that
+// changes what happens in a round has to go into it.
+
+// File layout: a header (magic and version), then records, each a length
+// and a payload. The payload starts with the key, then the number of
+// robots, how many cycles the round went on, and each robot's stats for the
+// round. Records are only ever added at the end, so several bouts can share
+// a cache one after another, and a record that was cut short is ignored.
+// When opening, we read the keys (but nothing else) of every record into an
+// index, so that lookups only have to read the record that matches.
+
+#ifndef _KROB_RESULTCACHE
+#define _KROB_RESULTCACHE
+
+#include "snapshot.cc"
+#include "statehash.cc"
+#include "global_stats.cc"
+#include "robot.cc"
+#include <stdint.h>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+#include <map>
+
+using namespace std;
+
+const string cache_magic = "KROBCACH";
+// Bump this whenever the simulator changes what happens in a round, so
+// that old outcomes aren't reused.
+const int cache_version = 2;
+
+// Hash of a robot's source file, or 0 if it can't be read.
+uint64_t hash_source(string filename) {
+	ifstream in(filename.c_str(), ios::in | ios::binary);
+	if (!in) return(0);
+
+	string contents((istreambuf_iterator<char>(in)), 
+			istreambuf_iterator<char>());
+	return(hash_bytes(contents));
+}
+
+class results_cache {
+	private:
+		fstream file;
+		map<uint64_t, streampos> index;	// Key to record payload.
+		streampos append_at;		// End of the last record.
+		int hits, misses;
+
+		// What's the same for every round of the bout.
+		vector<uint64_t> robot_hashes;
+		uint64_t settings;
+
+		uint64_t get_uint64(snapshot_reader & in) const;
+		void put_uint64(snapshot_writer & out, uint64_t val) const;
+
+	public:
+		results_cache() { hits = 0; misses = 0; settings = 0; }
+
+		// Opens the cache file, creating it if it doesn't exist.
+		bool open(string filename);
+
+		// Sets the robots (hashes of their source, in order) and the
+		// settings fingerprint for the rounds to come.
+		void set_bout(const vector<uint64_t> & robot_hashes_in,
+				uint64_t settings_in) { 
+			robot_hashes = robot_hashes_in;
+			settings = settings_in; }
+
+		// Returns the key for a round with the given Match ID and
+		// the given stats from the earlier rounds.
+		uint64_t make_key(matchid_t matchid, 
+				const vector<global_round_info> &
+				global_robot_stats) const;
+
+		// If the round is in the cache, sets the robots' stats and
+		// the number of cycles from it and returns true.
+		bool lookup(uint64_t key, vector<robot> & robots,
+				int & cycles);
+		void store(uint64_t key, const vector<robot> & robots,
+				int cycles);
+
+		int get_hits() const { return(hits); }
+		int get_misses() const { return(misses); }
+};
+
+uint64_t results_cache::get_uint64(snapshot_reader & in) const {
+	uint64_t upper = in.get_uint();
+	return((upper << 32) | in.get_uint());
+}
+
+void results_cache::put_uint64(snapshot_writer & out, uint64_t val) const {
+	out.put_uint(val >> 32);
+	out.put_uint(val & 0xFFFFFFFF);
+}
+
+bool results_cache::open(string filename) {
+	// Create it if it isn't there; fstream won't open a missing file for
+	// both reading and writing.
+	{
+		ifstream test(filename.c_str(), ios::in | ios::binary);
+		if (!test) {
+			ofstream create(filename.c_str(), ios::out |
+					ios::binary);
+			if (!create) return(false);
+
+			snapshot_writer header;
+			header.put_string(cache_magic);
+			header.put_int(cache_version);
+			create.write(header.get_data().data(), header.size());
+			if (!create.good()) return(false);
+		}
+	}
+
+	file.open(filename.c_str(), ios::in | ios::out | ios::binary);
+	if (!file) return(false);
+
+	string header_data(cache_magic.size() + 8, 0);
+	file.read(&header_data[0], header_data.size());
+	header_data.resize(file.gcount());
+
+	snapshot_reader header;
+	header.set_data(header_data);
+	if (header.get_string() != cache_magic || header.get_int() !=
+			cache_version || !header.ok()) {
+		cerr << "Error: " << filename << " is not a results cache, or "
+			<< "is from an incompatible version." << endl;
+		return(false);
+	}
+
+	file.clear();
+	file.seekg(0, ios::end);
+	streampos file_size = file.tellg();
+
+	// Index the records, stopping at one that's incomplete.
+	streampos pos = header.get_position();
+	string head;
+
+	for (;;) {
+		file.clear();
+		file.seekg(pos);
+		head.resize(12);
+		file.read(&head[0], head.size());
+		if (file.gcount() != (streamsize)head.size()) break;
+
+		snapshot_reader head_in;
+		head_in.set_data(head);
+		uint32_t length = head_in.get_uint();
+		uint64_t key = get_uint64(head_in);
+
+		streampos payload_at = pos + (streamoff)4;
+		if (payload_at + (streamoff)length > file_size) break;
+
+		index[key] = payload_at;
+		pos = payload_at + (streamoff)length;
+	}
+
+	// Anything after the last complete record is garbage; write over it.
+	append_at = pos;
+
+	return(true);
+}
+
+uint64_t results_cache::make_key(matchid_t matchid,
+		const vector<global_round_info> & global_robot_stats) const {
+
+	snapshot_writer key;
+	size_t counter;
+
+	put_uint64(key, settings);
+	put_uint64(key, matchid);
+	key.put_uint(robot_hashes.size());
+	for (counter = 0; counter < robot_hashes.size(); ++counter)
+		put_uint64(key, robot_hashes[counter]);
+
+	// The stats the robots can see. The costs (instructions and so on)
+	// can't be seen, and the CPU time isn't even deterministic.
+	for (counter = 0; counter < global_robot_stats.size(); ++counter)
+		for (int idx = 0; idx < RI_INSTRUCTIONS; ++idx)
+			key.put_long_double(global_robot_stats[counter].
+					get_sum()->data[idx]);
+
+	return(hash_bytes(key.get_data()));
+}
+
+bool results_cache::lookup(uint64_t key, vector<robot> & robots,
+		int & cycles) {
+
+	map<uint64_t, streampos>::const_iterator pos = index.find(key);
+	if (pos == index.end()) {
+		++misses;
+		return(false);
+	}
+
+	// Read the length, then the payload.
+	string data(4, 0);
+	file.clear();
+	file.seekg(pos->second - (streamoff)4);
+	file.read(&data[0], 4);
+
+	snapshot_reader in;
+	in.set_data(data);
+	data.resize(in.get_uint());
+	if (!data.empty())
+		file.read(&data[0], data.size());
+	in.set_data(data);
+
+	// The key is already known; a different number of robots means the
+	// hash collided.
+	get_uint64(in);
+	if (!file.good() || in.get_uint() != robots.size()) {
+		++misses;
+		return(false);
+	}
+
+	cycles = in.get_int();
+
+	vector<round_info> stats;
+	for (size_t counter = 0; counter < robots.size(); ++counter) {
+		round_info robot_stats(robots[counter].get_local_stats());
+		for (int idx = 0; idx < META_RI_ALL; ++idx)
+			robot_stats.data[idx] = in.get_long_double();
+		stats.push_back(robot_stats);
+	}
+
+	if (!in.ok()) {
+		++misses;
+		return(false);
+	}
+
+	for (size_t counter = 0; counter < robots.size(); ++counter)
+		robots[counter].set_local_stats(stats[counter]);
+
+	++hits;
+	return(true);
+}
+
+void results_cache::store(uint64_t key, const vector<robot> & robots,
+		int cycles) {
+
+	if (index.find(key) != index.end()) return;
+
+	snapshot_writer out;
+	put_uint64(out, key);
+	out.put_uint(robots.size());
+	out.put_int(cycles);
+	for (size_t counter = 0; counter < robots.size(); ++counter)
+		for (int idx = 0; idx < META_RI_ALL; ++idx)
+			out.put_long_double(robots[counter].get_local_stats().
+					data[idx]);
+
+	snapshot_writer head;
+	head.put_uint(out.size());
+
+	file.clear();
+	file.seekp(append_at);
+	file.write(head.get_data().data(), head.size());
+	file.write(out.get_data().data(), out.size());
+	file.flush();
+
+	if (file.good()) {
+		index[key] = append_at + (streamoff)4;
+		append_at = file.tellp();
+	}
+}
+
+#endif
@@ -0,0 +1,180 @@
+// Machine-readable round results, written as each round ends.
+
+// Each round becomes one record holding the round number, Match ID, how
+// long the round went on, the wall time it took, and every robot's stats for
+// the round (see global_stats.cc), including what the robot cost to
+// simulate. The records are flushed as they're written, so a bout that's cut
+// short still leaves the rounds it got through, and another program can
+// read them as they come.
+
+// The format is either JSON Lines (one JSON object per round) or CSV (one
+// row per robot per round, after a header row). The target is a file, which
+// is appended to, "-" for standard output, or "fd:<num>" for a file
+// descriptor that's already open, e.g. a pipe set up by the caller.
+
+#ifndef _KROB_RESULTS
+#define _KROB_RESULTS
+
+#include "global_stats.cc"
+#include "robot.cc"
+#include "tools.cc"
+#include <stdio.h>
+#include <stdlib.h>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+enum results_format { RF_JSONL = 0, RF_CSV = 1 };
+
+class results_sink {
+	private:
+		FILE * out;
+		results_format format;
+		bool header_written;
+		string job;
+
+		string csv_escape(const string & in) const;
+		string number(long double value) const;
+
+		void write_jsonl(int curmatch, matchid_t matchid, int cycles,
+				double seconds, const vector<robot> & robots);
+		void write_csv(int curmatch, matchid_t matchid, int cycles,
+				double seconds, const vector<robot> & robots);
+
+	public:
+		results_sink();
+		~results_sink();
+
+		bool open(string target, results_format format_in);
+
+		// Label the records with this job (for server mode). Only
+		// JSON Lines records have a place for it.
+		void set_job(string job_in) { job = job_in; }
+
+		void write_round(int curmatch, matchid_t matchid, int cycles,
+				double seconds, const vector<robot> & robots);
+};
+
+results_sink::results_sink() {
+	out = NULL;
+	format = RF_JSONL;
+	header_written = false;
+}
+
+results_sink::~results_sink() {
+	if (out != NULL && out != stdout)
+		fclose(out);
+}
+
+bool results_sink::open(string target, results_format format_in) {
+	format = format_in;
+
+	if (target == "-")
+		out = stdout;
+	else if (target.substr(0, 3) == "fd:") {
+		if (!is_integer(target.substr(3), false)) return(false);
+		out = fdopen(stoi(target.substr(3)), "a");
+	} else
+		out = fopen(target.c_str(), "a");
+
+	if (out == NULL) return(false);
+
+	// Don't repeat the CSV header when appending to an earlier bout's
+	// results. Pipes can't tell us where they are, so they get one.
+	long pos = ftell(out);
+	header_written = (out != stdout && pos > 0);
+
+	return(true);
+}
+
+string results_sink::csv_escape(const string & in) const {
+	if (in.find_first_of(",\"\n") == string::npos) return(in);
+
+	string escaped = "\"";
+	for (size_t counter = 0; counter < in.size(); ++counter) {
+		if (in[counter] == '"') escaped += '"';
+		escaped += in[counter];
+	}
+
+	return(escaped + "\"");
+}
+
+// Most stats are whole numbers, but armor and heat are fractions.
+string results_sink::number(long double value) const {
+	ostringstream q;
+	q.precision(10);
+	q << (double)value;
+	return(q.str());
+}
+
+void results_sink::write_jsonl(int curmatch, matchid_t matchid, int cycles,
+		double seconds, const vector<robot> & robots) {
+
+	string record = "{";
+	if (!job.empty())
+		record += "\"job\": \"" + json_escape(job) + "\", ";
+
+	record += "\"match\": " + itos(curmatch) + ", \"matchid\": " +
+		lltos(matchid) + ", \"cycles\": " + itos(cycles) +
+		", \"seconds\": " + number(seconds) + ", \"robots\": [";
+
+	for (size_t counter = 0; counter < robots.size(); ++counter) {
+		const round_info & stats = robots[counter].get_local_stats();
+
+		if (counter > 0) record += ", ";
+		record += "{\"name\": \"" + json_escape(stats.robot_name()) +
+			"\"";
+		for (int field = 0; field < META_RI_ALL; ++field)
+			record += ", \"" + info_names[field] + "\": " +
+				number(stats.get_one(field));
+		record += "}";
+	}
+
+	record += "]}\n";
+	fputs(record.c_str(), out);
+}
+
+void results_sink::write_csv(int curmatch, matchid_t matchid, int cycles,
+		double seconds, const vector<robot> & robots) {
+
+	int field;
+
+	if (!header_written) {
+		string header = "match,matchid,cycles,seconds,robot,name";
+		for (field = 0; field < META_RI_ALL; ++field)
+			header += "," + info_names[field];
+		fputs((header + "\n").c_str(), out);
+		header_written = true;
+	}
+
+	string prefix = itos(curmatch) + "," + lltos(matchid) + "," +
+		itos(cycles) + "," + number(seconds) + ",";
+
+	for (size_t counter = 0; counter < robots.size(); ++counter) {
+		const round_info & stats = robots[counter].get_local_stats();
+
+		string row = prefix + itos(counter + 1) + "," +
+			csv_escape(stats.robot_name());
+		for (field = 0; field < META_RI_ALL; ++field)
+			row += "," + number(stats.get_one(field));
+		fputs((row + "\n").c_str(), out);
+	}
+}
+
+void results_sink::write_round(int curmatch, matchid_t matchid, int cycles,
+		double seconds, const vector<robot> & robots) {
+
+	if (out == NULL) return;
+
+	if (format == RF_CSV)
+		write_csv(curmatch, matchid, cycles, seconds, robots);
+	else	write_jsonl(curmatch, matchid, cycles, seconds, robots);
+
+	// So that whoever is reading gets it now, and it survives us being
+	// killed.
+	fflush(out);
+}
+
+#endif
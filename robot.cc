@@ -58,6 +58,9 @@
 #include "blast.cc"
 #include "mine.cc"
 #include "comms.cc"
+#include "comms_registry.cc"
+#include "splash.cc"
+#include "deferred.cc"
 #include "configorder.h"
 #include "global_stats.cc"
 #include <assert.h>
@@ -123,6 +126,11 @@ class robot : public Unit {
 		double clock;		// Counts cycles that have passed.
 					// Note ATR2 doc about wraparound in
 					// memory.
+		// When the program last read the absolute time, the
+		// odometer, or the time since it was last hurt or hit
+		// something, or -1 if never. Mutable since reading memory
+		// mapped sensor info doesn't otherwise change the robot.
+		mutable double last_counter_read;
 		// Random number generator
 		single_rand hardware_rand;
 
@@ -195,6 +203,10 @@ class robot : public Unit {
 		// alter speed or direction).
 		double time_of_edge_collision;
 
+		// If not NULL, transmissions and mine detonations go here
+		// instead of happening at once. See deferred.cc.
+		deferred_effects * pending_effects;
+
 	public:
 		bool is_CPU_working() const; // For CPU interconnection
 
@@ -223,6 +235,14 @@ class robot : public Unit {
 		void adjust_balance(vector<int> & points, game_balance & 
 				balancer);
 
+		// Make a copy of a robot that hasn't been in a round yet
+		// ready for the round with this match ID: the random number
+		// generators are seeded for it, and the robot and turret
+		// face the given ways.
+		void start_round(int matchid, double start_heading,
+				unsigned char start_turret,
+				global_round_info * global_stat);
+
 		int get_UID() const { return(UID); }
 
 		unsigned char turret_heading;	// Updates instantly.
@@ -265,24 +285,26 @@ class robot : public Unit {
 		void receive_transmission(unsigned short data);
 
 		// .. and consequences
-		bool die(blasts & explosions, vector<robot> & other_robots);
+		bool die(blasts & explosions, vector<robot> & other_robots,
+				const splash_grid & splash);
 			// returns false if already dead.
 
 		// Update internal parameters like heat (cool off). This will
 		// also include CPU runs later.
 		bool advance_internally(const double time_elapsed, 
 				const game_balance & heat_balancer, 
-				blasts & explosions, vector<robot> & robots);
+				blasts & explosions, vector<robot> & robots,
+				const splash_grid & splash);
 		int withdraw_CPU_cycles(); // Get available CPU cycles and
 						// set those as used.
 
 		// Sensor-reading functions
-		bool do_scan(const list<Unit *> & active_robots);
-		bool do_scan(const list<Unit *> & active_robots, int span);
+		bool do_scan(const vector<Unit *> & active_robots);
+		bool do_scan(const vector<Unit *> & active_robots, int span);
 		bool get_scan_hit() const; // True if the scan found anything
 
-		int do_radar(const list<Unit *> & active_robots);
-		int do_sonar(const list<Unit *> & active_robots);
+		int do_radar(const vector<Unit *> & active_robots);
+		int do_sonar(const vector<Unit *> & active_robots);
 
 		// Passing through - used for showing when a sonar's called.
 		int get_last_radar_time() const;
@@ -324,6 +346,13 @@ class robot : public Unit {
 		unsigned short usrand() { return(hardware_rand.irand()); }
 		double get_time() const;
 		int get_time_int() const;
+		// The absolute time, the odometer and the time since events
+		// keep counting up, so robots that read them may act
+		// differently later even if everything else is the same. The periodic state detector
+		// needs to know when that happened.
+		void note_counter_read() const { last_counter_read = clock; }
+		double get_last_counter_read() const { 
+			return(last_counter_read); }
 		int get_num_crashes() const { return(crashes); }
 		void reset_crash_count() { crashes = 0; }
 		double get_armor() const { return(armor); }
@@ -358,15 +387,25 @@ class robot : public Unit {
 
 		bool fire(list<missile> & add_to, int offset_to_turret);
 		bool deploy_mine(list<mine> & add_to, int radius);
+		void detonate_mines(list<mine> & laid_mines);
 
 		// Now works.
-		void remove_communications_link(vector<set<robot *> > & lookup);
+		void remove_communications_link(comms_registry & lookup);
 		void set_communications_channel(int new_channel, 
-				vector<set<robot *> > & lookup);
+				comms_registry & lookup);
 		int get_communications_channel() const{ return(comms_channel); }
-		void transmit(unsigned short signal, vector<set<robot *> > &
+		void transmit(unsigned short signal, comms_registry &
 				lookup);
 
+		// For running CPUs in parallel. While deferring, the caller
+		// should pass the queue's own missile and mine lists to the
+		// CPU; flushing then moves everything into the arena proper.
+		void defer_effects(deferred_effects * queue) { 
+			pending_effects = queue; }
+		void flush_deferred_effects(list<missile> & missiles, 
+				list<mine> & mines, 
+				comms_registry & lookup);
+
 		// Inter-round data.
 		// DONE: Check that record_death/record_kill/record_victory are
 		// actually called!
@@ -384,6 +423,12 @@ class robot : public Unit {
 		void record_victory() { local_stats.data[RI_VICTORY]++; }
 		void record_error() { local_stats.data[RI_ERRORS]++; }
 		void increment_round_count() { local_stats.data[RI_RUNS]++; }
+		// What it costs to simulate us. Scans are counted by do_scan.
+		void record_port_call() { local_stats.data[RI_PORTCALLS]++; }
+		void record_interrupt() { local_stats.data[RI_INTERRUPTS]++; }
+		void record_CPU_cost(uint64_t instructions, uint64_t ns) {
+			local_stats.data[RI_INSTRUCTIONS] += instructions;
+			local_stats.data[RI_CPUTIME] += ns; }
 		void record_bot_shot(const Unit * other_bot);
 		void record_bot_mine_hurt(const Unit * other_bot);
 		void record_killed_by(int src) { was_killed_by = src; }
@@ -397,7 +442,15 @@ class robot : public Unit {
 		int get_local_shots_hit() const;
 		int get_local_mines_hit() const;
 
-		round_info get_local_stats() const { return(local_stats); }
+		const round_info & get_local_stats() const { return(local_stats); }
+		// For rounds whose outcome is known without running them.
+		void set_local_stats(const round_info & stats) { 
+			local_stats = stats; }
+		// Add per_period to the stats this many times, for skipping
+		// ahead through a periodic round. The costs aren't added, 
+		// since we didn't have to pay them.
+		void extrapolate_local_stats(const round_info & per_period,
+				int periods);
 
 		int get_all_victories() const;
 		int get_all_deaths() const;
@@ -429,8 +482,52 @@ class robot : public Unit {
 		void set_heat(double h_in) { heat = h_in; }
 		void set_armor(double a_in) { armor = a_in; }
 
+		// Snapshots. Name, message, colors and the global stats
+		// pointer are set up when the robot is created and aren't
+		// saved. Neither is the comms channel registration: the
+		// caller must remove the link before loading and set the
+		// channel again afterwards.
+		void save_state(snapshot_writer & out) const;
+		void load_state(snapshot_reader & in);
+
+		// Only the random number generators, so that state hashing
+		// can tell an RNG divergence apart from the rest.
+		void save_rng_state(snapshot_writer & out) const {
+			hardware_rand.save_state(out);
+			radar_sonar.save_rng_state(out); }
+
 };
 
+void save_scan_result(const scanner_result & in, snapshot_writer & out) {
+	out.put_coordinate(in.position);
+	out.put_int(in.span);
+	out.put_time(in.clock, -1);
+	out.put_uint(in.angle);
+	out.put_uint(in.our_angle);
+	out.put_uint(in.target_angle);
+	out.put_double(in.target_throttle);
+	out.put_double(in.target_abs_speed);
+	out.put_int(in.target_transponder);
+	out.put_int(in.range);
+	out.put_int(in.accuracy);
+	out.put_bool(in.found);
+}
+
+void load_scan_result(scanner_result & out, snapshot_reader & in) {
+	out.position = in.get_coordinate();
+	out.span = in.get_int();
+	out.clock = in.get_time(-1);
+	out.angle = in.get_uint();
+	out.our_angle = in.get_uint();
+	out.target_angle = in.get_uint();
+	out.target_throttle = in.get_double();
+	out.target_abs_speed = in.get_double();
+	out.target_transponder = in.get_int();
+	out.range = in.get_int();
+	out.accuracy = in.get_int();
+	out.found = in.get_bool();
+}
+
 	// PRIVATE
 
 bool robot::is_CPU_working() const { 
@@ -467,6 +564,7 @@ robot::robot(int matchid, int UID_in, string namei, double smin,
 	set_shutdown_margin(shutdown_m);
 	set_keepshift(false);
 	set_clock(0);
+	last_counter_read = -1;
 
 	armor = 1; 
 	heat = 0; 
@@ -492,6 +590,7 @@ robot::robot(int matchid, int UID_in, string namei, double smin,
 	time_of_edge_collision = -1;
 	last_sonar_val = -1;
 	last_detected_transponder = 0;
+	pending_effects = NULL;
 	reset_crash_count();
 
 	// Set default comms and CPU stats.
@@ -508,6 +607,8 @@ robot::robot(int matchid, int UID_in, string namei, double smin,
 	// Clean up some structs and internal variables.
 	bzero(&last_scan, sizeof(last_scan));
 	bzero(&last_successful_scan, sizeof(last_successful_scan));
+	last_scan.clock = -1;			// never scanned
+	last_successful_scan.clock = -1;
 	turret_residue = 0;
 }
 
@@ -566,6 +667,15 @@ void robot:: adjust_balance(vector<int> & points, game_balance & balancer) {
 	set_shield_type(balancer.get_shield_type(points[CNF_SHIELD]));
 }
 
+void robot::start_round(int matchid, double start_heading,
+		unsigned char start_turret, global_round_info * global_stat) {
+	radar_sonar.reseed(matchid, UID);
+	hardware_rand = single_rand(matchid, UID, RND_ROBOT);
+	set_start_heading(start_heading);
+	turret_heading = start_turret;
+	global_stats = global_stat;
+}
+
 // Adjust turret_heading (which is an absolute value) to account for keepshift
 // being off, if it is (in which case the turret stays the same relative to the
 // body). We might need to refactor to have it work the other way around.
@@ -619,6 +729,13 @@ scanner_result robot::aggregate_scan_info() {
 		toRet.target_throttle = target->get_throttle();
 		toRet.target_transponder = target->get_ID();
 		toRet.target_abs_speed = target->get_absolute_speed();
+	} else {
+		// Not used, but keep them the same from run to run so that
+		// state hashes agree.
+		toRet.target_angle = 0;
+		toRet.target_throttle = 0;
+		toRet.target_transponder = 0;
+		toRet.target_abs_speed = 0;
 	}
 	//unsigned char target_angle; // absolute
 	//        double target_throttle;
@@ -803,7 +920,8 @@ void robot::receive_transmission(unsigned short data) {
 	comms_queue.add(data);
 }
 
-bool robot::die(blasts & explosions, vector<robot> & robots) {
+bool robot::die(blasts & explosions, vector<robot> & robots,
+		const splash_grid & splash) {
 	// When we die, this happens:
 	// Health (armor) is set to zero. So is heat, and we immediately stop.
 	// Also, the dead parameter is set to true, we generate an explosion
@@ -812,7 +930,8 @@ bool robot::die(blasts & explosions, vector<robot> & robots) {
 	// BLUESKY: Move the "inflict splash damage" thing elsewhere so we don't
 	// have to reimplement and reimplement. The problem here is that if we
 	// put it inside blast, blast needs to refer to vector<robot>, but
-	// robot needs to refer to blasts, creating a loop.
+	// robot needs to refer to blasts, creating a loop. (The search for
+	// who's in range is shared now; see splash.cc.)
 	
 	if (dead()) return(false);
 
@@ -837,24 +956,24 @@ bool robot::die(blasts & explosions, vector<robot> & robots) {
 	// But then we have to know the exact moment it died. Note this
 	// when doing asynchronous checks in a future version. (Might be easier
 	// just to asynch check on collisions, not on anything else)
-	for (size_t counter = 0; counter < robots.size(); ++counter)
-		record_damage_to_others(robots[counter], robots[counter].
-				register_blast(get_pos().distance(
-						robots[counter].get_pos()), 
-					multiplier, max_hit_radius, 
+	vector<int> in_range;
+	splash.find_in_range(get_pos(), max_hit_radius, in_range);
+
+	for (size_t counter = 0; counter < in_range.size(); ++counter) {
+		robot & victim = robots[in_range[counter]];
+		record_damage_to_others(victim, victim.register_blast(
+					get_pos().distance(victim.get_pos()),
+					multiplier, max_hit_radius,
 					attribution));
+	}
 
 	//cout << "Boom." << endl;
 
-	bool found_killer = false;
-
-	if (was_killed_by != get_UID())
-		for (size_t counter = 0; counter < robots.size() && 
-				!found_killer; ++counter)
-			if (robots[counter].get_UID() == was_killed_by) {
-				robots[counter].record_kill();
-				found_killer = true;
-			}
+	if (was_killed_by != get_UID()) {
+		int killer = splash.find_UID(was_killed_by);
+		if (killer != -1)
+			robots[killer].record_kill();
+	}
 
 	armor = 0;
 	return(true);
@@ -868,7 +987,7 @@ bool robot::die(blasts & explosions, vector<robot> & robots) {
 // explosion effects.
 bool robot::advance_internally(const double time_elapsed, const game_balance &
 		heat_balancer, blasts & explosions, 
-		vector<robot> & other_robots) {
+		vector<robot> & other_robots, const splash_grid & splash) {
 
 	if (dead()) return(false);
 
@@ -942,7 +1061,7 @@ bool robot::advance_internally(const double time_elapsed, const game_balance &
 	// and setting all throttle parameters to zero. Perhaps move this to
 	// another function. DONE.
 	if (get_armor() == 0) {
-		die(explosions, other_robots);
+		die(explosions, other_robots, splash);
 		return(false);
 	}
 
@@ -967,13 +1086,14 @@ int robot::withdraw_CPU_cycles() {
 
 // Should these be const vector<const Unit *> ?
 
-bool robot::do_scan(const list<Unit *> & active_robots) {
+bool robot::do_scan(const vector<Unit *> & active_robots) {
 	// Set our position for the past record.
 	
 	// Update the scanner with the angle of the turret it's attached to.
 	scan_sensor.set_center_hexangle(turret_heading);
 
 	bool retval = scan_sensor.scan(active_robots, get_pos());
+	local_stats.data[RI_SCANS]++;
 
 	// We've scanned, so set up our snapshot of the events.
 	last_scan = aggregate_scan_info();
@@ -985,7 +1105,7 @@ bool robot::do_scan(const list<Unit *> & active_robots) {
 	return(retval);
 }
 
-bool robot::do_scan(const list<Unit *> & active_robots, int span) {
+bool robot::do_scan(const vector<Unit *> & active_robots, int span) {
 	if (span < 0 || span > 256) return(false); // Sanity check
 
 	set_scan_span(span);
@@ -1001,7 +1121,7 @@ bool robot::do_scan(const list<Unit *> & active_robots, int span) {
 // slowly (or from max to min), while the target (the one hit by the ping, as
 // it were) would flash from half max to min.. Nah, that'll be too complex;
 // we'll just set ourselves, not the target.
-int robot::do_radar(const list<Unit *> & active_robots) {
+int robot::do_radar(const vector<Unit *> & active_robots) {
 	int last_radar_val = radar_sonar.check_radar(active_robots, get_pos(), 
 			get_time());
 
@@ -1013,7 +1133,7 @@ int robot::do_radar(const list<Unit *> & active_robots) {
 	return(last_radar_val);
 }
 
-int robot::do_sonar(const list<Unit *> & active_robots) {
+int robot::do_sonar(const vector<Unit *> & active_robots) {
 	last_sonar_val = radar_sonar.check_sonar(active_robots, get_pos(), 
 			get_time());
 
@@ -1217,36 +1337,78 @@ bool robot::deploy_mine(list<mine> & add_to, int detection_radius) {
 	return(true);
 }
 
+// Blow up all the mines we've laid in the list given. If we're deferring,
+// that list only holds the mines laid this cycle, so remember to do the
+// same to the rest once the effects are flushed.
+void robot::detonate_mines(list<mine> & laid_mines) {
+	for (list<mine>::iterator p = laid_mines.begin(); p != 
+			laid_mines.end(); ++p)
+		if (p->layer_UID() == get_UID())
+			p->explode();
+
+	if (pending_effects != NULL)
+		pending_effects->detonate = true;
+}
+
 // We should do a unit test on these. Later, I'm dog tired.
 
-void robot::remove_communications_link(vector<set<robot *> > & lookup) {
-	lookup[comms_channel].erase(this);
+void robot::remove_communications_link(comms_registry & lookup) {
+	lookup.unsubscribe(comms_channel, this);
 }
 
-void robot::set_communications_channel(int new_channel, vector<set<robot *> > &
-		lookup) {
+void robot::set_communications_channel(int new_channel,
+		comms_registry & lookup) {
 
 	// Remove ourselves from the old channel and set type to the new 
 	// channel, then insert ourselves there.
-	//lookup[comms_channel].erase(this);
 	remove_communications_link(lookup); // old channel
 	comms_channel = new_channel;
-	lookup[comms_channel].insert(this);
+	lookup.subscribe(comms_channel, this);
 }
 
-void robot::transmit(unsigned short signal, vector<set<robot *> > &
-		lookup) {
+void robot::transmit(unsigned short signal, comms_registry & lookup) {
 	// For all the robots on the channel (except ourselves), invoke
 	// receive.
-	
-	for (set<robot *>::iterator pos = lookup[comms_channel].begin(); pos !=
-			lookup[comms_channel].end(); ++pos) {
-		robot * ptr = *pos;
+
+	if (pending_effects != NULL) {
+		pending_effects->transmissions.push_back(signal);
+		return;
+	}
+
+	const vector<robot *> & listeners = lookup.get_listeners(comms_channel);
+
+	for (size_t counter = 0; counter < listeners.size(); ++counter) {
+		robot * ptr = listeners[counter];
 		if (ptr == this) continue; // not ourselves
 		ptr->receive_transmission(signal);
 	}
 }
 
+// Apply the effects held back since defer_effects was called, and stop
+// deferring. Missiles and mines are appended in the order they were made, and
+// detonation happens before this cycle's mines are added, since those that
+// should have gone off already did so in detonate_mines.
+void robot::flush_deferred_effects(list<missile> & missiles, 
+		list<mine> & mines, comms_registry & lookup) {
+
+	if (pending_effects == NULL) return;
+
+	deferred_effects * queue = pending_effects;
+	pending_effects = NULL;
+
+	if (queue->detonate)
+		detonate_mines(mines);
+	queue->detonate = false;
+
+	missiles.splice(missiles.end(), queue->missiles);
+	mines.splice(mines.end(), queue->mines);
+
+	for (size_t counter = 0; counter < queue->transmissions.size(); 
+			++counter)
+		transmit(queue->transmissions[counter], lookup);
+	queue->transmissions.clear();
+}
+
 void robot::record_death() {
 	if (is_dead) return;
 	local_stats.data[RI_DEATHS]++;
@@ -1307,6 +1469,13 @@ void robot::record_bot_mine_hurt(const Unit * other_bot) {
 
 // Getters for the various statistics.
 
+void robot::extrapolate_local_stats(const round_info & per_period,
+		int periods) {
+	for (size_t counter = 0; counter < RI_INSTRUCTIONS; ++counter)
+		local_stats.data[counter] += per_period.data[counter] * 
+			periods;
+}
+
 int robot::get_local_deaths() const {	return(local_stats.data[RI_DEATHS]); }
 int robot::get_local_kills() const {	return(local_stats.data[RI_KILLS]); }
 int robot::get_local_shots_fired() const { 
@@ -1342,4 +1511,130 @@ int robot::get_all_mines_hit() const {
 	return(get_local_mines_hit() + global_stats->get_sum()->data[RI_MINEHITS]);
 }
 
+void robot::save_state(snapshot_writer & out) const {
+	Unit::save_state(out);
+
+	out.put_int(UID);
+	out.put_int(shield_type);
+	out.put_bool(old_shield);
+	out.put_int(CPU_speed);
+	out.put_double(armor_thickness);
+	out.put_double(heatsink_factor);
+	out.put_double(weapon_power);
+	out.put_double(base_engine_speed);
+	out.put_double(base_missile_speed);
+	out.put_double(CPU_time_residue);
+
+	save_scan_result(last_scan, out);
+	save_scan_result(last_successful_scan, out);
+	scan_sensor.save_state(out);
+	radar_sonar.save_state(out);
+	out.put_int(last_detected_transponder);
+	out.put_time(clock, -1);
+	if (!out.comparing())
+		out.put_time(last_counter_read, -1);
+	hardware_rand.save_state(out);
+
+	out.put_double(armor);
+	out.put_double(heat);
+	out.put_double(shutdown_temperature);
+	out.put_double(shutdown_margin);
+	out.put_bool(overburning);
+	out.put_bool(shields_up);
+	out.put_bool(keepshift);
+	// The stats only count up, so they'd keep states from ever
+	// repeating.
+	if (!out.comparing())
+		local_stats.save_state(out);
+
+	// The times are zero when nothing's happened yet. Only INT 11 looks
+	// at them, and it counts as reading a counter, so they can be left
+	// out when comparing.
+	out.put_int(last_damaged_by);
+	if (!out.comparing())
+		out.put_time(last_damaged_at, 0);
+	out.put_int(was_killed_by);
+	out.put_int(crashes);
+	out.put_int(mines_available);
+	out.put_int(mines_deployed);
+	out.put_uint(comms_channel);
+	out.put_int(transp_last_impacted);
+	out.put_int(transp_last_blown);
+	if (!out.comparing()) {
+		out.put_time(last_hit_at, 0);
+		out.put_time(last_blown_at, 0);
+	}
+	out.put_int(last_error);
+	out.put_bool(error);
+	out.put_bool(has_shutdown);
+	out.put_double(CPU_cycles_available);
+	out.put_int(CPU_cycles_per_cycle);
+	out.put_int(last_sonar_val);
+	out.put_time(time_of_edge_collision, -1);
+
+	out.put_uint(turret_heading);
+	out.put_double(turret_residue);
+	comms_queue.save_state(out);
+}
+
+void robot::load_state(snapshot_reader & in) {
+	Unit::load_state(in);
+
+	// The UID decides which robot is which; if they don't match, the
+	// snapshot is for some other set of robots.
+	if (in.get_int() != UID) in.fail();
+	shield_type = in.get_int();
+	old_shield = in.get_bool();
+	CPU_speed = in.get_int();
+	armor_thickness = in.get_double();
+	heatsink_factor = in.get_double();
+	weapon_power = in.get_double();
+	base_engine_speed = in.get_double();
+	base_missile_speed = in.get_double();
+	CPU_time_residue = in.get_double();
+
+	load_scan_result(last_scan, in);
+	load_scan_result(last_successful_scan, in);
+	scan_sensor.load_state(in);
+	radar_sonar.load_state(in);
+	last_detected_transponder = in.get_int();
+	clock = in.get_time(-1);
+	last_counter_read = in.get_time(-1);
+	hardware_rand.load_state(in);
+
+	armor = in.get_double();
+	heat = in.get_double();
+	shutdown_temperature = in.get_double();
+	shutdown_margin = in.get_double();
+	overburning = in.get_bool();
+	shields_up = in.get_bool();
+	keepshift = in.get_bool();
+	local_stats.load_state(in);
+
+	last_damaged_by = in.get_int();
+	last_damaged_at = in.get_time(0);
+	was_killed_by = in.get_int();
+	crashes = in.get_int();
+	mines_available = in.get_int();
+	mines_deployed = in.get_int();
+	comms_channel = in.get_uint();
+	transp_last_impacted = in.get_int();
+	transp_last_blown = in.get_int();
+	last_hit_at = in.get_time(0);
+	last_blown_at = in.get_time(0);
+	last_error = in.get_int();
+	error = in.get_bool();
+	has_shutdown = in.get_bool();
+	CPU_cycles_available = in.get_double();
+	CPU_cycles_per_cycle = in.get_int();
+	last_sonar_val = in.get_int();
+	time_of_edge_collision = in.get_time(-1);
+
+	turret_heading = in.get_uint();
+	turret_residue = in.get_double();
+	comms_queue.load_state(in);
+
+	pending_effects = NULL;
+}
+
 #endif
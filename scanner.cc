@@ -12,6 +12,7 @@
 #include "coord_tools.cc"
 #include "object.cc"
 #include "tools.cc"
+#include "snapshot.cc"
 #include <list>
 #include <iostream>
 
@@ -45,7 +46,7 @@ class Scanner {
 		Scanner(int center_ha, int span_in, int scanrange_in,
 				int detection_radius_in);
 
-		bool scan(const list<Unit * > & check_against, 
+		bool scan(const vector<Unit *> & check_against, 
 				const coordinate scanner_pos);
 
 		void set_center_hexangle(int chi) { center_hexangle = chi; }
@@ -62,6 +63,11 @@ class Scanner {
 		int get_center_hexangle() { return(center_hexangle); }
 
 		int get_radius() const { return(scanner_radius); }
+
+		// The detected target is only used right after a scan, so
+		// it isn't saved.
+		void save_state(snapshot_writer & out) const;
+		void load_state(snapshot_reader & in);
 };
 
 // -- //
@@ -78,6 +84,7 @@ Scanner::Scanner() {
 	span = 0;
 	scanner_radius = 0;
 	detection_radius = 0;
+	accuracy = 0;
 }
 
 Scanner::Scanner(int center_ha, int span_in, int scanrange_in,
@@ -87,12 +94,13 @@ Scanner::Scanner(int center_ha, int span_in, int scanrange_in,
 	span = span_in;
 	scanner_radius = scanrange_in;
 	detection_radius = detection_radius_in;
+	accuracy = 0;
 }
 
 
 // But note special case when we're looking North; it seems to lose its grip.
 // DONE: Investigate and fix.
-bool Scanner::scan(const list<Unit *> & robots, const coordinate scanner_pos) {
+bool Scanner::scan(const vector<Unit *> & robots, const coordinate scanner_pos) {
 
 	// The scanner algorithm works like this:
 	// 	For each robot, we find its angle in the polar coordinate system
@@ -123,44 +131,47 @@ bool Scanner::scan(const list<Unit *> & robots, const coordinate scanner_pos) {
 	// that's in the scanner's range". It is.
 	// (Game equipment idea: chaff: returns true with p = 0.5, withstands
 	//  two or three successful scans.)
-	for (list<Unit *>::const_iterator cur_ref = robots.begin(); cur_ref !=
+	for (vector<Unit *>::const_iterator cur_ref = robots.begin(); cur_ref !=
 			robots.end(); ++cur_ref) {
 
 		// Aliasing to fit our earlier code and avoid ugliness like
-		// (*cur_ref)->.
-		Unit * cur = *cur_ref;
+		// (*cur_ref)->. Nearly every robot is thrown out by the
+		// checks below, so get what they need once, up front.
+		const Unit * cur = *cur_ref;
+		const coordinate cur_pos = cur->get_pos();
 
-		double cand_distance = cur->get_pos().sq_distance(scanner_pos);
+		double cand_distance = cur_pos.sq_distance(scanner_pos);
 		if (cand_distance > record_dist && record_dist != -1)
 			continue;
 
-		//cout << "INFORMATSIYA: " << cur->get_pos().x << ", " << cur->get_pos().y << "\t\tus: " << scanner_pos.x << ", " << scanner_pos.y << endl;
+		//cout << "INFORMATSIYA: " << cur_pos.x << ", " << cur_pos.y << "\t\tus: " << scanner_pos.x << ", " << scanner_pos.y << endl;
+
+		// Check that the robot isn't too far away for us to detect.
+		// (This is the same as cur_pos.distance(scanner_pos).)
+		if (sqrt(cand_distance) > scanner_radius) 
+			continue;
+		
+		//cout << "Passed #1" << endl;
 
 		// If it's me, forget it.
-		if (cur->get_pos() == scanner_pos) continue;
+		if (cur_pos == scanner_pos) continue;
 
-		//cout << "Passed #1" << endl;
+		//cout << "Passed #2" << endl;
 
 		// If it's cloaked, ditto.
 		if (cur->is_cloaked()) continue;
 
-		//cout << "Passed #2" << endl;
-		//cout << "Scanner radius is " << scanner_radius << endl;
-	
-		// Check that the robot isn't too far away for us to detect.
-		if (cur->get_pos().distance(scanner_pos) > scanner_radius) 
-			continue;
-		
 		//cout << "Passed #3" << endl;
 
 		// Get the relative angle.
 
-		coordinate normalized = cur->get_pos() - scanner_pos;
+		coordinate normalized = cur_pos - scanner_pos;
 
 		// Perhaps some monotonic function of angle could be used 
 		// instead. Unlikely, but perhaps a precalc table accurate to
 		// within 1 m at 1500 m.
-		double angle = radian_to_hex(atan2(normalized.y, normalized.x));
+		double angle = radian_to_hex(phys_atan2(normalized.y,
+					normalized.x));
 
 		/*cout << "In a shallow field, we wait." << endl;
 		cout << "Detection radius is " << detection_radius << endl;*/
@@ -195,23 +206,22 @@ bool Scanner::scan(const list<Unit *> & robots, const coordinate scanner_pos) {
 			// (Optimization idea: offload these so we look them
 			//  up, since there are only two possibilities.)
 			coordinate end_of_line = scanner_pos;
-			end_of_line.x += scanner_radius * cos(hex_to_radian(
-						approximant));
-			end_of_line.y += scanner_radius * sin(hex_to_radian(
-						approximant));
+			end_of_line.x += scanner_radius * phys_cos(
+					hex_to_radian(approximant));
+			end_of_line.y += scanner_radius * phys_sin(
+					hex_to_radian(approximant));
 
 			// Get the closest point on that line, and figure out
 			// the distance to the robot.
 			// (Then break if it's too far away)
 			double real_dist = close_check.dist_closest_point(
-					scanner_pos, end_of_line, cur->get_pos(),
-					true);
+					scanner_pos, end_of_line, cur_pos, true);
 
 			//cout << "Real distance: " << real_dist << endl;
 
 			if (real_dist > squared_radius)
 /*					close_check.dist_closest_point(scanner_pos,
-						end_of_line, cur->get_pos(),
+						end_of_line, cur_pos,
 						true) >= squared_radius)*/
 				continue;
 		} else {
@@ -228,7 +238,7 @@ bool Scanner::scan(const list<Unit *> & robots, const coordinate scanner_pos) {
 		//	cout << "Angle is " << angle << endl;
 			found_one = true;
 			detected_target = *cur_ref;
-			found_pos = cur->get_pos();
+			found_pos = cur_pos;
 			found_angle = angle;
 			record_dist = cand_distance;
 		}
@@ -301,4 +311,25 @@ int Scanner::get_accuracy() {
 	return(round(accuracy)); 
 }
 
+void Scanner::save_state(snapshot_writer & out) const {
+	out.put_int(center_hexangle);
+	out.put_int(span);
+	out.put_int(scanner_radius);
+	out.put_int(detection_radius);
+	out.put_uint(range_to_target);
+	out.put_double(accuracy);
+	out.put_bool(found);
+}
+
+void Scanner::load_state(snapshot_reader & in) {
+	center_hexangle = in.get_int();
+	span = in.get_int();
+	scanner_radius = in.get_int();
+	detection_radius = in.get_int();
+	range_to_target = in.get_uint();
+	accuracy = in.get_double();
+	found = in.get_bool();
+	detected_target = NULL;
+}
+
 #endif
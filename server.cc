@@ -0,0 +1,491 @@
+// Server mode: stay resident and run bouts as they're asked for, so that
+// each one doesn't have to pay for starting up and compiling the robots.
+
+// Jobs come in one per line, either on standard input or over a Unix domain
+// socket (one client at a time). A job is a list of robot files, and
+// optionally some of these, in any order:
+//	id=<name>		What to call the job in the results (default:
+//				a running count).
+//	rounds=<num>		How many rounds to run (default 1, or as many
+//				as there are Match IDs).
+//	matchids=<a>,<b>,...	Match IDs of the first rounds; the rest are
+//				random.
+//	cycles=<num>		Maximum length of a round, in cycles.
+//	cpu=<num>		Maximum CPU speed, as for -t.
+//	insanity=<num>		Insane missiles, as for -%.
+// Everything else is as given on the command line. Empty lines and lines
+// starting with # are ignored.
+
+// Each round is reported as it ends, as a line of JSON like --results
+// writes, with the job ID added. When a job is done, a line saying so
+// follows:
+//	{"job": "<id>", "status": "done", "rounds": <num>, "seconds": <num>}
+// and if the job couldn't be run, there's instead
+//	{"job": "<id>", "status": "error", "message": "<why>"}
+
+// Robots are compiled the first time a job needs them, and kept for later
+// jobs until their files change. Each job is run in a process of its own,
+// forked off the server, so jobs can't affect each other, and up to a
+// given number of jobs are run at once. The workers send their results to
+// the server through pipes, one per worker, and the server passes them on
+// a line at a time so that the lines of different jobs don't get mixed
+// up.
+
+#ifndef _KROB_SERVER
+#define _KROB_SERVER
+
+#include "stored_cores.cc"
+#include "resultcache.cc"
+#include "results.cc"
+#include "tools.cc"
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <list>
+#include <map>
+
+using namespace std;
+
+typedef struct server_job {
+	string id;
+	vector<string> filenames;
+	vector<matchid_t> matchids;
+	int rounds;
+	int maxcycles, max_CPU_speed, missile_insanity;
+};
+
+// Runs a job in the worker process. The robots have already been compiled
+// into cores, and the results go to results.
+class job_runner {
+	public:
+		virtual ~job_runner() {}
+		virtual void run(const server_job & job, core_storage & cores,
+				results_sink & results) = 0;
+};
+
+// Robots compiled so far, by file name. A robot is compiled again if its
+// file has changed since.
+class core_library {
+	private:
+		core_storage compiled;
+		map<string, pair<uint64_t, int> > by_name; // hash, index
+		int maxweight, maxlines;
+		bool strict_compile;
+
+	public:
+		core_library(int maxweight_in, int maxlines_in,
+				bool strict_compile_in);
+
+		// Adds the given robot's core to cores. If it can't, returns
+		// false and sets error to why.
+		bool get(const string & filename, core_storage & cores,
+				string & error);
+};
+
+core_library::core_library(int maxweight_in, int maxlines_in,
+		bool strict_compile_in) : compiled(256) {
+	maxweight = maxweight_in;
+	maxlines = maxlines_in;
+	strict_compile = strict_compile_in;
+}
+
+bool core_library::get(const string & filename, core_storage & cores,
+		string & error) {
+
+	uint64_t hash = hash_source(filename);
+	map<string, pair<uint64_t, int> >::const_iterator pos =
+		by_name.find(filename);
+
+	if (pos != by_name.end() && pos->second.first == hash) {
+		cores.copy_core(compiled, pos->second.second);
+		return(true);
+	}
+
+	// Compile on the side, so that a robot that doesn't compile doesn't
+	// leave anything behind in the library.
+	core_storage single(256);
+	ifstream inf(filename.c_str());
+	error_container retval = single.insert_core(inf, filename, maxweight,
+			maxlines, false, strict_compile);
+
+	if (retval.error != CER_NOERR) {
+		error = filename + ": " + retval.construct_error_message();
+		return(false);
+	}
+
+	compiled.copy_core(single, 0);
+	by_name[filename] = pair<uint64_t, int>(hash,
+			compiled.get_num_cores() - 1);
+	cores.copy_core(single, 0);
+	return(true);
+}
+
+class match_server {
+	private:
+		job_runner & runner;
+		core_library library;
+		int workers;
+
+		// Defaults for what jobs don't specify.
+		int maxcycles, max_CPU_speed, missile_insanity;
+
+		int jobs_seen;
+
+		typedef struct worker {
+			pid_t pid;
+			string job_id;
+			string pending;		// Incomplete last line.
+		};
+
+		string status_line(const string & id, const string & status,
+				const string & rest) const;
+
+		bool parse_job(const string & line, server_job & job,
+				string & error);
+		bool write_all(int fd, const string & data);
+		bool start_job(const server_job & job, int out_fd,
+				map<int, worker> & running);
+
+	public:
+		match_server(job_runner & runner_in, int workers_in,
+				int maxweight, int maxlines,
+				bool strict_compile, int maxcycles_in,
+				int max_CPU_speed_in, int missile_insanity_in);
+
+		// Runs the jobs read from in_fd until it ends, writing the
+		// results to out_fd.
+		bool serve_stream(int in_fd, int out_fd);
+
+		// Listens on a Unix domain socket, serving each client in
+		// turn. Only returns on error.
+		bool serve_socket(string path);
+};
+
+match_server::match_server(job_runner & runner_in, int workers_in,
+		int maxweight, int maxlines, bool strict_compile,
+		int maxcycles_in, int max_CPU_speed_in,
+		int missile_insanity_in) : runner(runner_in),
+	library(maxweight, maxlines, strict_compile) {
+
+	workers = max(1, workers_in);
+	maxcycles = maxcycles_in;
+	max_CPU_speed = max_CPU_speed_in;
+	missile_insanity = missile_insanity_in;
+	jobs_seen = 0;
+}
+
+string match_server::status_line(const string & id, const string & status,
+		const string & rest) const {
+	return("{\"job\": \"" + json_escape(id) + "\", \"status\": \"" +
+			status + "\"" + rest + "}\n");
+}
+
+bool match_server::parse_job(const string & line, server_job & job,
+		string & error) {
+
+	job.id = itos(++jobs_seen);
+	job.filenames.clear();
+	job.matchids.clear();
+	job.rounds = -1;
+	job.maxcycles = maxcycles;
+	job.max_CPU_speed = max_CPU_speed;
+	job.missile_insanity = missile_insanity;
+
+	istringstream tokens(line);
+	string token;
+
+	while (tokens >> token) {
+		size_t eq = token.find('=');
+		if (eq == string::npos) {
+			job.filenames.push_back(token);
+			continue;
+		}
+
+		string key = token.substr(0, eq), value = token.substr(eq+1);
+
+		if (key == "id") {
+			job.id = value;
+		} else if (key == "matchids") {
+			string id;
+			istringstream ids(value);
+			while (getline(ids, id, ',')) {
+				if (stoui(id) == 0) {
+					error = "Invalid Match ID " + id;
+					return(false);
+				}
+				job.matchids.push_back(stoui(id));
+			}
+		} else if (key == "rounds" || key == "cycles" ||
+				key == "cpu" || key == "insanity") {
+			if (!is_integer(value, false) || stoi(value) < 0) {
+				error = "Invalid " + key + " " + value;
+				return(false);
+			}
+			int number = stoi(value);
+			if (key == "rounds") job.rounds = number;
+			if (key == "cycles") job.maxcycles = number;
+			if (key == "cpu") job.max_CPU_speed = number;
+			if (key == "insanity") job.missile_insanity = number;
+		} else {
+			error = "Unknown setting " + key;
+			return(false);
+		}
+	}
+
+	if (job.filenames.empty()) {
+		error = "No robots specified";
+		return(false);
+	}
+
+	if (job.rounds == -1)
+		job.rounds = max((size_t)1, job.matchids.size());
+
+	return(true);
+}
+
+bool match_server::write_all(int fd, const string & data) {
+	size_t written = 0;
+
+	while (written < data.size()) {
+		ssize_t count = write(fd, data.data() + written,
+				data.size() - written);
+		if (count < 0 && errno == EINTR) continue;
+		if (count <= 0) return(false);
+		written += count;
+	}
+
+	return(true);
+}
+
+bool match_server::start_job(const server_job & job, int out_fd,
+		map<int, worker> & running) {
+
+	core_storage cores(256);
+	string error;
+
+	for (size_t counter = 0; counter < job.filenames.size(); ++counter)
+		if (!library.get(job.filenames[counter], cores, error))
+			return(write_all(out_fd, status_line(job.id, "error",
+						", \"message\": \"" +
+						json_escape(error) + "\"")));
+
+	int pipe_fds[2];
+	if (pipe(pipe_fds) != 0)
+		return(write_all(out_fd, status_line(job.id, "error",
+						", \"message\": \"Could not "
+						"create pipe\"")));
+
+	// Don't let anything buffered be written twice.
+	cout.flush();
+	fflush(stdout);
+
+	pid_t pid = fork();
+	if (pid < 0) {
+		close(pipe_fds[0]);
+		close(pipe_fds[1]);
+		return(write_all(out_fd, status_line(job.id, "error",
+						", \"message\": \"Could not "
+						"start worker\"")));
+	}
+
+	if (pid == 0) {
+		// The worker. Whatever the round code prints for people to
+		// read would get mixed up with the results, so silence it.
+		close(pipe_fds[0]);
+		int null_fd = open("/dev/null", O_WRONLY);
+		if (null_fd >= 0) dup2(null_fd, 1);
+
+		// Otherwise every worker would get the same random Match
+		// IDs.
+		srandom(time(NULL) ^ (getpid() << 16));
+
+		double start = get_abs_time();
+		results_sink results;
+		results.open("fd:" + itos(pipe_fds[1]), RF_JSONL);
+		results.set_job(job.id);
+		runner.run(job, cores, results);
+
+		string done = status_line(job.id, "done", ", \"rounds\": " +
+				itos(job.rounds) + ", \"seconds\": " +
+				dtos(get_abs_time() - start));
+		write_all(pipe_fds[1], done);
+		_exit(0);
+	}
+
+	close(pipe_fds[1]);
+	running[pipe_fds[0]].pid = pid;
+	running[pipe_fds[0]].job_id = job.id;
+	return(true);
+}
+
+bool match_server::serve_stream(int in_fd, int out_fd) {
+
+	list<server_job> queue;
+	map<int, worker> running;
+	string input;
+	bool input_done = false, out_ok = true;
+	char buffer[4096];
+
+	while (!input_done || !queue.empty() || !running.empty()) {
+		while ((int)running.size() < workers && !queue.empty()) {
+			out_ok &= start_job(queue.front(), out_fd, running);
+			queue.pop_front();
+		}
+
+		vector<pollfd> fds;
+		pollfd entry;
+		entry.events = POLLIN;
+		entry.revents = 0;
+
+		if (!input_done) {
+			entry.fd = in_fd;
+			fds.push_back(entry);
+		}
+		for (map<int, worker>::const_iterator pos = running.begin();
+				pos != running.end(); ++pos) {
+			entry.fd = pos->first;
+			fds.push_back(entry);
+		}
+
+		if (fds.empty()) continue;
+
+		if (poll(&fds[0], fds.size(), -1) < 0) {
+			if (errno == EINTR) continue;
+			return(false);
+		}
+
+		for (size_t counter = 0; counter < fds.size(); ++counter) {
+			if (fds[counter].revents == 0) continue;
+
+			int fd = fds[counter].fd;
+			ssize_t count = read(fd, buffer, sizeof(buffer));
+			if (count < 0 && errno == EINTR) continue;
+
+			if (fd == in_fd && !input_done) {
+				if (count <= 0) {
+					input_done = true;
+					input += "\n";
+				} else	input.append(buffer, count);
+
+				size_t newline;
+				while ((newline = input.find('\n')) !=
+						string::npos) {
+					string line = input.substr(0, newline);
+					input.erase(0, newline + 1);
+
+					size_t first = line.find_first_not_of(
+							" \t\r");
+					if (first == string::npos ||
+							line[first] == '#')
+						continue;
+
+					server_job job;
+					string error;
+					if (parse_job(line, job, error))
+						queue.push_back(job);
+					else	out_ok &= write_all(out_fd,
+							status_line(job.id,
+							"error", ", \"message"
+							"\": \"" + json_escape(
+							error) + "\""));
+				}
+				continue;
+			}
+
+			// A worker sent something, or finished.
+			worker & source = running[fd];
+			if (count > 0) {
+				source.pending.append(buffer, count);
+				size_t last = source.pending.rfind('\n');
+				if (last != string::npos) {
+					out_ok &= write_all(out_fd, source.
+							pending.substr(0,
+								last + 1));
+					source.pending.erase(0, last + 1);
+				}
+				continue;
+			}
+
+			int status;
+			waitpid(source.pid, &status, 0);
+			if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+				out_ok &= write_all(out_fd, status_line(
+							source.job_id, "error",
+							", \"message\": \"Worker"
+							" died\""));
+			close(fd);
+			running.erase(fd);
+		}
+
+		// If whoever sent the jobs is gone, there's no one to run
+		// the rest for.
+		if (!out_ok) {
+			input_done = true;
+			queue.clear();
+		}
+	}
+
+	return(out_ok);
+}
+
+bool match_server::serve_socket(string path) {
+	int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (listener < 0) return(false);
+
+	sockaddr_un address;
+	memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	if (path.size() >= sizeof(address.sun_path)) {
+		close(listener);
+		return(false);
+	}
+	strcpy(address.sun_path, path.c_str());
+
+	// A socket left behind by an earlier server is in the way, but
+	// anything else there is someone's file.
+	struct stat existing;
+	if (lstat(path.c_str(), &existing) == 0) {
+		if (!S_ISSOCK(existing.st_mode)) {
+			cerr << "Error: " << path << " exists and is not a " <<
+				"socket." << endl;
+			close(listener);
+			return(false);
+		}
+		unlink(path.c_str());
+	}
+
+	if (bind(listener, (sockaddr *)&address, sizeof(address)) != 0 ||
+			listen(listener, 8) != 0) {
+		close(listener);
+		return(false);
+	}
+
+	for (;;) {
+		int client = accept(listener, NULL, NULL);
+		if (client < 0) {
+			if (errno == EINTR) continue;
+			close(listener);
+			return(false);
+		}
+
+		serve_stream(client, client);
+		close(client);
+	}
+}
+
+#endif
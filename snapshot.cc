@@ -0,0 +1,268 @@
+// Binary snapshots of the simulation state.
+// The writer and reader here only deal with primitive types; each class that
+// has state worth saving provides save_state and load_state functions that
+// use these, and main.cc puts it all together.
+
+// Everything is stored in a fixed size and byte order (little endian), so a
+// snapshot written on one machine can be read on another. Doubles are stored
+// as their IEEE bit patterns so that restoring gives the exact same values;
+// anything less would make the restored round drift from the original.
+
+// Reading past the end, or reading something that doesn't make sense, sets a
+// failure flag instead of aborting; check ok() once you're done.
+
+// Whatever a class saves must also be set by each of its constructors, even
+// if the round would overwrite it before it mattered. Otherwise the snapshot
+// (and the state hash) picks up whatever was in memory before, and the same
+// round saves differently from run to run.
+
+// Points in time (as opposed to durations) are stored relative to a time
+// base, which is normally zero. Writing with one time base and reading with
+// another moves the state forward or back in time. Each time field has a
+// "never" value that stands for no time at all and is kept as is.
+
+// Values that depend on the host rather than the simulation, like time
+// measurements, are zeroed if the writer is set to be reproducible. That's
+// for hashing, where two runs of the same bout should give the same result.
+
+// The writer can also be put in comparison mode, for telling whether two
+// states at different times will play out the same way. Then things that
+// only count up without affecting anything (like statistics) are left out,
+// and counters that only matter modulo something are reduced. The result
+// can't be read back.
+
+#ifndef _KROB_SNAPSHOT
+#define _KROB_SNAPSHOT
+
+#include "coordinate.cc"
+#include <stdint.h>
+#include <string.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include <fstream>
+
+using namespace std;
+
+class snapshot_writer {
+	private:
+		string buffer;
+		double time_base;
+		bool comparison, reproducibility;
+
+	public:
+		snapshot_writer() { time_base = 0; comparison = false;
+			reproducibility = false; }
+
+		void set_time_base(double base) { time_base = base; }
+		void set_comparison(bool comparing) { comparison = comparing; }
+		bool comparing() const { return(comparison); }
+		void set_reproducible(bool reproduce) { reproducibility =
+			reproduce; }
+		bool reproducible() const { return(reproducibility); }
+
+		void put_uint(uint32_t val);
+		void put_int(int32_t val) { put_uint((uint32_t)val); }
+		void put_bool(bool val) { buffer.push_back(val ? 1 : 0); }
+		void put_double(double val);
+		void put_long_double(long double val);
+		void put_coordinate(const coordinate & val);
+		void put_string(const string & val);
+		void put_shorts(const vector<short> & val);
+		void put_time(double val, double never);
+
+		const string & get_data() const { return(buffer); }
+		size_t size() const { return(buffer.size()); }
+
+		// Writes to a temporary file first and then renames it, so
+		// that being killed halfway through writing doesn't destroy
+		// the previous snapshot.
+		bool write_to(string filename) const;
+};
+
+class snapshot_reader {
+	private:
+		string buffer;
+		size_t pos;
+		bool failed;
+		double time_base;
+
+		bool have(size_t bytes);
+
+	public:
+		snapshot_reader() { pos = 0; failed = false; time_base = 0; }
+
+		void set_time_base(double base) { time_base = base; }
+
+		bool read_from(string filename);
+		void set_data(const string & data) { buffer = data; pos = 0;
+			failed = false; }
+		size_t get_position() const { return(pos); }
+
+		uint32_t get_uint();
+		int32_t get_int() { return((int32_t)get_uint()); }
+		bool get_bool();
+		double get_double();
+		long double get_long_double();
+		coordinate get_coordinate();
+		string get_string();
+		void get_shorts(vector<short> & dest);
+		double get_time(double never);
+
+		// For marking data that doesn't make sense as bad.
+		void fail() { failed = true; }
+		bool ok() const { return(!failed); }
+		bool at_end() const { return(pos == buffer.size()); }
+};
+
+void snapshot_writer::put_uint(uint32_t val) {
+	for (int counter = 0; counter < 4; ++counter) {
+		buffer.push_back((char)(val & 255));
+		val >>= 8;
+	}
+}
+
+void snapshot_writer::put_double(double val) {
+	uint64_t bits;
+	memcpy(&bits, &val, sizeof(bits));
+	put_uint((uint32_t)bits);
+	put_uint((uint32_t)(bits >> 32));
+}
+
+// Long doubles don't have a portable format, so we split them into the
+// nearest double and what remains. On x86, the remainder fits in a double
+// without loss, and where long double is double, it's just zero.
+void snapshot_writer::put_long_double(long double val) {
+	double upper = (double)val;
+	put_double(upper);
+	put_double((double)(val - upper));
+}
+
+void snapshot_writer::put_coordinate(const coordinate & val) {
+	put_double(val.x);
+	put_double(val.y);
+}
+
+void snapshot_writer::put_string(const string & val) {
+	put_uint(val.size());
+	buffer += val;
+}
+
+void snapshot_writer::put_shorts(const vector<short> & val) {
+	put_uint(val.size());
+	for (size_t counter = 0; counter < val.size(); ++counter) {
+		buffer.push_back((char)(val[counter] & 255));
+		buffer.push_back((char)((val[counter] >> 8) & 255));
+	}
+}
+
+void snapshot_writer::put_time(double val, double never) {
+	put_bool(val == never);
+	if (val == never)
+		put_double(0);
+	else	put_double(val - time_base);
+}
+
+bool snapshot_writer::write_to(string filename) const {
+	string temp_name = filename + ".tmp";
+
+	ofstream out(temp_name.c_str(), ios::out | ios::binary | ios::trunc);
+	if (!out) return(false);
+
+	out.write(buffer.data(), buffer.size());
+	out.close();
+
+	if (!out) return(false);
+
+	return(rename(temp_name.c_str(), filename.c_str()) == 0);
+}
+
+bool snapshot_reader::have(size_t bytes) {
+	if (failed || buffer.size() - pos < bytes) {
+		failed = true;
+		return(false);
+	}
+	return(true);
+}
+
+bool snapshot_reader::read_from(string filename) {
+	ifstream in(filename.c_str(), ios::in | ios::binary);
+	if (!in) return(false);
+
+	buffer.assign(istreambuf_iterator<char>(in),
+			istreambuf_iterator<char>());
+	pos = 0;
+	failed = false;
+
+	return(!in.bad());
+}
+
+uint32_t snapshot_reader::get_uint() {
+	if (!have(4)) return(0);
+
+	uint32_t val = 0;
+	for (int counter = 3; counter >= 0; --counter)
+		val = (val << 8) | (unsigned char)buffer[pos + counter];
+	pos += 4;
+
+	return(val);
+}
+
+bool snapshot_reader::get_bool() {
+	if (!have(1)) return(false);
+	return(buffer[pos++] != 0);
+}
+
+double snapshot_reader::get_double() {
+	uint64_t bits = get_uint();
+	bits |= ((uint64_t)get_uint()) << 32;
+
+	double val;
+	memcpy(&val, &bits, sizeof(val));
+	return(val);
+}
+
+long double snapshot_reader::get_long_double() {
+	long double upper = get_double();
+	return(upper + get_double());
+}
+
+coordinate snapshot_reader::get_coordinate() {
+	double x = get_double();
+	return(coordinate(x, get_double()));
+}
+
+string snapshot_reader::get_string() {
+	uint32_t length = get_uint();
+	if (!have(length)) return("");
+
+	string val = buffer.substr(pos, length);
+	pos += length;
+	return(val);
+}
+
+// The destination must already have the right size; if the stored vector
+// is of a different size, it's been written by something else, so fail.
+void snapshot_reader::get_shorts(vector<short> & dest) {
+	uint32_t length = get_uint();
+	if (length != dest.size() || !have(length * 2)) {
+		failed = true;
+		return;
+	}
+
+	for (size_t counter = 0; counter < length; ++counter) {
+		dest[counter] = (short)((unsigned char)buffer[pos] |
+				((unsigned char)buffer[pos+1] << 8));
+		pos += 2;
+	}
+}
+
+double snapshot_reader::get_time(double never) {
+	if (get_bool()) {
+		get_double();
+		return(never);
+	}
+	return(get_double() + time_base);
+}
+
+#endif
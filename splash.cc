@@ -0,0 +1,131 @@
+// Broadphase for splash damage: which robots a blast could reach, so that
+// explosions (missiles, mines, and robots dying) only have to check those
+// instead of every robot. Also finds robots by UID without searching. The
+// same grid is used when placing robots at the start of a round, to find the
+// robots already placed that a new one might be too close to.
+
+// The arena is divided into square cells, and each live robot is put in the
+// cell it's in. A query returns every robot in the cells that a circle
+// around the blast touches, so it may return robots that are out of range,
+// but never leaves out one that's in range; the caller still checks the real
+// distance. Since robots move after being put in the grid, the grid can be
+// given some slack (the furthest a robot can have gone since), which the
+// circle is widened by.
+
+// The grid only knows robots by their index in the robot vector, so that it
+// doesn't have to know about robots, and robot.cc can use it. The indices
+// found are in ascending order, so that damage is dealt and credited in the
+// same order as when going through all the robots.
+
+#ifndef _KROB_SPLASH
+#define _KROB_SPLASH
+
+#include "coordinate.cc"
+#include <algorithm>
+#include <vector>
+#include <math.h>
+
+using namespace std;
+
+class splash_grid {
+	private:
+		double cell_size;
+		int xcells, ycells;
+		double slack;
+		vector<vector<int> > cells;
+		vector<int> UID_lookup;		// Robot index by UID, or -1
+
+		int cell_of(double pos, int num_cells) const;
+
+	public:
+		splash_grid();
+
+		// Start over with the given arena size and slack; no robots.
+		void reset(const coordinate arena_size, double slack_in);
+		void add(int robot_idx, const coordinate pos);
+
+		// Puts the robot indices that may be within radius of center
+		// into found, in ascending order.
+		void find_in_range(const coordinate center, double radius,
+				vector<int> & found) const;
+
+		// UIDs stay the same throughout a round, so these only need
+		// to be set once per round.
+		void clear_UIDs() { UID_lookup.clear(); }
+		void add_UID(int UID, int robot_idx);
+		int find_UID(int UID) const;
+};
+
+splash_grid::splash_grid() {
+	// Blasts have a radius of 25 to 35 m, so this usually means a query
+	// looks at one to four cells.
+	cell_size = 100;
+	xcells = 0;
+	ycells = 0;
+	slack = 0;
+}
+
+int splash_grid::cell_of(double pos, int num_cells) const {
+	// Robots that are off the arena (or the dead, that are far off) go
+	// in the cells at the edge.
+	double cell = floor(pos / cell_size);
+	if (cell < 0) return(0);
+	if (cell >= num_cells) return(num_cells - 1);
+	return((int)cell);
+}
+
+void splash_grid::reset(const coordinate arena_size, double slack_in) {
+	int new_xcells = max(1, (int)ceil(arena_size.x / cell_size)),
+	    new_ycells = max(1, (int)ceil(arena_size.y / cell_size));
+
+	if (new_xcells != xcells || new_ycells != ycells) {
+		xcells = new_xcells;
+		ycells = new_ycells;
+		cells.clear();
+		cells.resize(xcells * ycells);
+	} else
+		for (size_t counter = 0; counter < cells.size(); ++counter)
+			cells[counter].clear();
+
+	slack = slack_in;
+}
+
+void splash_grid::add(int robot_idx, const coordinate pos) {
+	cells[cell_of(pos.y, ycells) * xcells + cell_of(pos.x, xcells)].
+		push_back(robot_idx);
+}
+
+void splash_grid::find_in_range(const coordinate center, double radius,
+		vector<int> & found) const {
+
+	found.clear();
+
+	double reach = radius + slack;
+
+	int xmin = cell_of(center.x - reach, xcells),
+	    xmax = cell_of(center.x + reach, xcells),
+	    ymin = cell_of(center.y - reach, ycells),
+	    ymax = cell_of(center.y + reach, ycells);
+
+	for (int y = ymin; y <= ymax; ++y)
+		for (int x = xmin; x <= xmax; ++x) {
+			const vector<int> & here = cells[y * xcells + x];
+			found.insert(found.end(), here.begin(), here.end());
+		}
+
+	sort(found.begin(), found.end());
+}
+
+void splash_grid::add_UID(int UID, int robot_idx) {
+	if (UID < 0) return;
+	if ((size_t)UID >= UID_lookup.size())
+		UID_lookup.resize(UID + 1, -1);
+	UID_lookup[UID] = robot_idx;
+}
+
+int splash_grid::find_UID(int UID) const {
+	if (UID < 0 || (size_t)UID >= UID_lookup.size()) return(-1);
+	return(UID_lookup[UID]);
+}
+
+#endif
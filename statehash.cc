@@ -0,0 +1,285 @@
+// State hashing, for checking that changes to the simulator don't change
+// what happens in it.
+
+// Every so many cycles, the state of each part of the simulation (robots,
+// CPUs, missiles, mines, and random number generators) is serialized the
+// same way as for snapshots, and a hash of each part is written to a text
+// file, one line per hashing point:
+//	<match> <cycle> <robots> <CPUs> <missiles> <mines> <RNGs>
+// after a header line giving the interval. The state at the end of each
+// round is hashed as well.
+// Given a file like that from an earlier run, the hashes can instead be
+// checked as we go, and the first point where they differ is reported
+// along with what parts differ. Run the same bout (same robots, -z, -m and
+// other options) with an old and a new build to see if they agree. Only the
+// first round's Match ID can be fixed (-z), so checks are for single rounds.
+
+// Blasts aren't hashed, because they're only for show and are only kept
+// up to date in graphics mode.
+
+#ifndef _KROB_STATEHASH
+#define _KROB_STATEHASH
+
+#include "snapshot.cc"
+#include "robot.cc"
+#include "missile.cc"
+#include "mine.cc"
+#include "stored_cores.cc"
+#include "cpu/corelogic.cc"
+#include "tools.cc"
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <list>
+
+using namespace std;
+
+enum state_part { SP_ROBOTS = 0, SP_CPUS = 1, SP_MISSILES = 2, SP_MINES = 3,
+	SP_RNGS = 4, SP_NUMPARTS = 5 };
+
+const string state_part_names[SP_NUMPARTS] = { "robots", "CPUs", "missiles",
+	"mines", "RNGs" };
+
+// 64-bit FNV-1a. Not cryptographic, but we're looking for accidents, not
+// adversaries.
+uint64_t hash_bytes(const string & data) {
+	uint64_t hash = 14695981039346656037ULL;
+
+	for (size_t counter = 0; counter < data.size(); ++counter) {
+		hash ^= (unsigned char)data[counter];
+		hash *= 1099511628211ULL;
+	}
+
+	return(hash);
+}
+
+void save_state_part(state_part part, snapshot_writer & out,
+		const vector<robot> & robots,
+		const core_storage & core_store,
+		const list<missile> & missiles, const list<mine> & mines) {
+
+	size_t counter;
+
+	switch(part) {
+		case SP_ROBOTS:
+			for (counter = 0; counter < robots.size(); ++counter)
+				robots[counter].save_state(out);
+			break;
+		case SP_CPUS:
+			for (counter = 0; counter < core_store.cores.size();
+					++counter)
+				core_store.cores[counter].save_state(out);
+			break;
+		case SP_MISSILES:
+			out.put_uint(missiles.size());
+			for (list<missile>::const_iterator pos = 
+					missiles.begin(); pos != 
+					missiles.end(); ++pos)
+				pos->save_state(out);
+			break;
+		case SP_MINES:
+			out.put_uint(mines.size());
+			for (list<mine>::const_iterator pos = mines.begin();
+					pos != mines.end(); ++pos)
+				pos->save_state(out);
+			break;
+		case SP_RNGS:
+			for (counter = 0; counter < robots.size(); ++counter)
+				robots[counter].save_rng_state(out);
+			break;
+		default: break;
+	}
+}
+
+// Hash each part of the state separately, so we can tell which one went
+// wrong.
+void hash_world_state(const vector<robot> & robots,
+		const core_storage & core_store,
+		const list<missile> & missiles, const list<mine> & mines,
+		uint64_t hashes[SP_NUMPARTS]) {
+
+	for (int counter = 0; counter < SP_NUMPARTS; ++counter) {
+		snapshot_writer part;
+		part.set_reproducible(true);
+		save_state_part((state_part)counter, part, robots, 
+				core_store, missiles, mines);
+		hashes[counter] = hash_bytes(part.get_data());
+	}
+}
+
+class state_hasher {
+	private:
+		int interval;
+		ofstream out;
+		ifstream reference;
+		string reference_name;
+		bool checking, started, diverged;
+
+		string hash_line(int curmatch, int cycle,
+				const uint64_t hashes[SP_NUMPARTS]) const;
+		void report(int curmatch, int cycle, string what);
+
+	public:
+		state_hasher(int interval_in);
+
+		bool open_output(string filename);
+		// The interval is taken from the reference.
+		bool open_reference(string filename);
+
+		bool wants_hash(int cycle) const { return(cycle % interval
+				== 0); }
+
+		void hash_state(int curmatch, int cycle,
+				const vector<robot> & robots,
+				const core_storage & core_store,
+				const list<missile> & missiles,
+				const list<mine> & mines);
+
+		// Call after the last round, to catch the reference going
+		// on for longer than we did.
+		void finish();
+
+		bool has_diverged() const { return(diverged); }
+};
+
+state_hasher::state_hasher(int interval_in) {
+	interval = interval_in;
+	checking = false;
+	started = false;
+	diverged = false;
+}
+
+bool state_hasher::open_output(string filename) {
+	out.open(filename.c_str());
+	if (!out) return(false);
+
+	out << "# every " << interval << " cycles: match cycle";
+	for (int counter = 0; counter < SP_NUMPARTS; ++counter)
+		out << " " << state_part_names[counter];
+	out << endl;
+
+	return(true);
+}
+
+bool state_hasher::open_reference(string filename) {
+	reference.open(filename.c_str());
+	reference_name = filename;
+	if (!reference) return(false);
+
+	string header;
+	int ref_interval = 0;
+	getline(reference, header);
+	if (sscanf(header.c_str(), "# every %d", &ref_interval) != 1 ||
+			ref_interval <= 0)
+		return(false);
+
+	interval = ref_interval;
+	checking = true;
+	return(true);
+}
+
+string state_hasher::hash_line(int curmatch, int cycle,
+		const uint64_t hashes[SP_NUMPARTS]) const {
+
+	string line = itos(curmatch) + " " + itos(cycle);
+	char hex[17];
+
+	for (int counter = 0; counter < SP_NUMPARTS; ++counter) {
+		snprintf(hex, sizeof(hex), "%016llx",
+				(unsigned long long)hashes[counter]);
+		line += " " + string(hex);
+	}
+
+	return(line);
+}
+
+void state_hasher::report(int curmatch, int cycle, string what) {
+	cout << "State divergence from " << reference_name << " at match " <<
+		curmatch << ", cycle " << cycle << ": " << what << endl;
+	diverged = true;
+	checking = false;	// Everything after this will differ too.
+}
+
+void state_hasher::hash_state(int curmatch, int cycle,
+		const vector<robot> & robots, const core_storage & core_store,
+		const list<missile> & missiles, const list<mine> & mines) {
+
+	uint64_t hashes[SP_NUMPARTS];
+	hash_world_state(robots, core_store, missiles, mines, hashes);
+
+	if (out.is_open())
+		out << hash_line(curmatch, cycle, hashes) << "\n";
+
+	if (!checking) return;
+
+	// If we resumed from a snapshot, we start partway into the
+	// reference, so skip up to where we are. After that, the reference
+	// should always be where we are; if it's somewhere else, one of the
+	// runs ended a round that the other didn't.
+	string ref_line;
+	stringstream ref_in;
+	int ref_match = -1, ref_cycle = -1;
+
+	for (;;) {
+		if (!getline(reference, ref_line)) {
+			report(curmatch, cycle, "the reference ends here.");
+			return;
+		}
+		if (ref_line.empty() || ref_line[0] == '#') continue;
+
+		ref_in.clear();
+		ref_in.str(ref_line);
+		ref_in >> ref_match >> ref_cycle;
+
+		if (started || ref_match > curmatch || (ref_match == curmatch
+					&& ref_cycle >= cycle))
+			break;
+	}
+
+	started = true;
+
+	if (ref_match != curmatch || ref_cycle != cycle) {
+		report(curmatch, cycle, "the reference is at match " +
+				itos(ref_match) + ", cycle " +
+				itos(ref_cycle) + " instead.");
+		return;
+	}
+
+	string differing;
+	for (int counter = 0; counter < SP_NUMPARTS; ++counter) {
+		string ref_hash;
+		ref_in >> ref_hash;
+		if (strtoull(ref_hash.c_str(), NULL, 16) == hashes[counter])
+			continue;
+
+		if (!differing.empty()) differing += ", ";
+		differing += state_part_names[counter];
+	}
+
+	if (!differing.empty())
+		report(curmatch, cycle, differing + " differ.");
+}
+
+void state_hasher::finish() {
+	if (out.is_open()) out.flush();
+
+	if (!checking) return;
+
+	string ref_line;
+	while (getline(reference, ref_line))
+		if (!ref_line.empty() && ref_line[0] != '#') {
+			cout << "State divergence from " << reference_name <<
+				": the reference continues after the end."
+				<< endl;
+			diverged = true;
+			return;
+		}
+
+	cout << "State hashes agree with " << reference_name << "." << endl;
+}
+
+#endif
@@ -48,6 +48,11 @@ class core_storage {
 				int permitted_lines, bool verbose,
 				bool strict_compile);
 
+		// Adds a core that's already been compiled into another
+		// storage (with the same lengths), so it needn't be compiled
+		// again.
+		void copy_core(const core_storage & source, int index);
+
 		error_container replace_weighting(int index, vector<int> &
 				new_weighting, int permitted_points);
 
@@ -166,6 +171,16 @@ error_container core_storage::insert_core(ifstream & program,
 	return(error_container(CER_NOERR));
 }
 
+void core_storage::copy_core(const core_storage & source, int index) {
+	assert (index >= 0 && index < (int)source.cores.size());
+
+	cores.push_back(source.cores[index]);
+	device_weighting.push_back(source.device_weighting[index]);
+	line_numbers.push_back(source.line_numbers[index]);
+	messages.push_back(source.messages[index]);
+	CPU_speed_info.push_back(source.CPU_speed_info[index]);
+}
+
 error_container core_storage::replace_weighting(int index, vector<int> &
 		new_weighting, int permitted_points) {
 
@@ -4,11 +4,14 @@
 #include <math.h>
 #include <ctype.h>
 #include <sys/time.h>
+#include <time.h>
+#include <stdint.h>
 #include <assert.h>
 #include <sstream>
 #include <algorithm>
 
 #include "cpu/errors.h"
+#include "portable_math.cc"
 
 #include <stdio.h> // Eugh; required to differentiate between file-not-exist
 #include <errno.h> // and file-no-permissions. Such a HACK.
@@ -37,18 +40,31 @@ double hex_to_radian(const double hexdegrees);
 
 void init_coeffs() {
 	for (int counter = 0; counter < 256; ++counter) {
-		cos_coeff[counter] = cos(hex_to_radian(counter));
-		sin_coeff[counter] = sin(hex_to_radian(counter));
+		cos_coeff[counter] = phys_cos(hex_to_radian(counter));
+		sin_coeff[counter] = phys_sin(hex_to_radian(counter));
 	}
 }
 
 double vcos64(int hex) { return(cos_coeff[hex]); }
 double vsin64(int hex) { return(sin_coeff[hex]); }
 
+#ifdef PORTABLE_MATH
+const double PI = 3.1415926535897931160e+00;
+#else
 const double PI = 4 * atan(1);
+#endif
 
 double square(double a) { return(a*a); }
 
+// For measuring how long things take: unlike get_abs_time, it isn't thrown
+// off by changes to the time of day.
+uint64_t get_monotonic_ns() {
+	timespec ts;
+	if (clock_gettime(CLOCK_MONOTONIC, &ts) == 0)
+		return((uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec);
+	else	return(0);
+}
+
 double get_abs_time() {
 	timeval tv;
 	if (gettimeofday(&tv, NULL) == 0)
@@ -485,6 +501,26 @@ compile_error check_filename(const string filename, const compile_error
 	return(passthrough);
 }
 
+// For putting arbitrary text (e.g. robot names) in a JSON string.
+string json_escape(const string & in) {
+	string escaped;
+	char hex[8];
+
+	for (size_t counter = 0; counter < in.size(); ++counter) {
+		unsigned char ch = in[counter];
+		if (ch == '"' || ch == '\\') {
+			escaped += '\\';
+			escaped += ch;
+		} else if (ch < 32) {
+			snprintf(hex, sizeof(hex), "\\u%04x", ch);
+			escaped += hex;
+		} else
+			escaped += ch;
+	}
+
+	return(escaped);
+}
+
 // --- Emulation of rotation ops for ATR2
 
 unsigned short rotate_left(unsigned short in, unsigned char how_far) {